@@ -18,6 +18,8 @@
 % Created: December 2006
 %
 % Based on code by Justin Romberg, Georgia Institute of Technology
+%
+% Util/walsh_mul.c computes the same thing natively (for idx = bitrevorder(1:N)).
 
 function b = A_fw(x, OMEGA, idx, P)
 
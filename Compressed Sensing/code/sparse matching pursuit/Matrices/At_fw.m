@@ -18,6 +18,8 @@
 % Created: October 2006
 %
 % Based on code by Justin Romberg, Georgia Institute of Technology
+%
+% Util/walsh_mul.c computes the same thing natively (for idx = bitrevorder(1:N)).
 
 function x = At_fw(b, OMEGA, idx, P)
 
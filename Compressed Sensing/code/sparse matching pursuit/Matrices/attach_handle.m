@@ -0,0 +1,28 @@
+% matrix = attach_handle(matrix)
+%
+%   Creates a persistent native copy of the matrix with matrix_handle (see
+%   Util/matrix_handle.c) and makes matrix.Afun, matrix.Atfun and
+%   matrix.MedianRecoveryFun use it, so the matrix and its derived indexes are
+%   not rebuilt on every call. Works for explicit matrices (those with a
+%   neighbors field, e.g. 'sparse<d>', 'countmin<d>') and for
+%   'countmin_implicit_twowise<d>' matrices.
+%
+%   The handle is stored in matrix.handle; recovery.m uses it for SSMP. Release
+%   it with matrix_handle('destroy', matrix.handle) when done.
+
+function matrix = attach_handle(matrix)
+
+if isfield(matrix, 'neighbors')
+    matrix.handle = matrix_handle('create', matrix.N, matrix.M, matrix.D, matrix.neighbors);
+elseif isfield(matrix, 'Ps')
+    matrix.handle = matrix_handle('create', matrix.N, matrix.M, matrix.D, matrix.B, ...
+                                  matrix.Ps, matrix.As, matrix.Bs);
+else
+    error('Only explicit and implicit countmin matrices can be attached to a handle.');
+end
+
+h = matrix.handle;
+matrix.Afun  = @(z) matrix_handle('mul', h, z);
+matrix.Atfun = @(z) matrix_handle('mul_transpose', h, z);
+matrix.sparse_input = true;
+matrix.MedianRecoveryFun = @(z) matrix_handle('median', h, z);
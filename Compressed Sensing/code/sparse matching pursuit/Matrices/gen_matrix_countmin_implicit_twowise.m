@@ -44,6 +44,7 @@ end
 
 matrix.Afun  = @(z) countmin_implicit_twowise_mul(N, M, D, matrix.B, matrix.Ps, matrix.As, matrix.Bs, z);
 matrix.Atfun  = @(z) countmin_implicit_twowise_mul_transpose(N, M, D, matrix.B, matrix.Ps, matrix.As, matrix.Bs, z);
+matrix.sparse_input = true;  % Afun also accepts sparse vectors
 
 matrix.MedianRecoveryFun = @(z) median_recovery_implicit_twowise(N, M, D, matrix.B, matrix.Ps, matrix.As, matrix.Bs, z);
 
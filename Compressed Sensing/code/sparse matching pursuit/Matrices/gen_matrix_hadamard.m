@@ -10,10 +10,12 @@ end
 matrix.N = N;
 matrix.M = M;
 
-matrix.idx = bitrevorder(1:N);
-matrix.P = randperm(N);
-matrix.OMEGA = randperm(N);
+% P and OMEGA are kept as uint32; walsh_mul (Util/walsh_mul.c) applies the
+% permutation, the (bit reversed) Walsh transform and the subsampling in one
+% native call, like A_fw/At_fw with idx = bitrevorder(1:N).
+matrix.P = uint32(randperm(N));
+matrix.OMEGA = uint32(randperm(N));
 matrix.OMEGA = matrix.OMEGA(1:M);
 
-matrix.Afun = @(z) A_fw(z, matrix.OMEGA, matrix.idx, matrix.P);
-matrix.Atfun = @(z) At_fw(z, matrix.OMEGA, matrix.idx, matrix.P); 
+matrix.Afun = @(z) walsh_mul(z, matrix.P, matrix.OMEGA);
+matrix.Atfun = @(z) walsh_mul(z, matrix.P, matrix.OMEGA, 1); 
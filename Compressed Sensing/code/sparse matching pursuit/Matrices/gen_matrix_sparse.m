@@ -42,7 +42,8 @@ end
 matrix.A = sparse(L, C, 1, M, N); 
 
 matrix.Afun  = @(z) binsparsemul(matrix.A, z);
-matrix.Atfun = @(z) binsparsemul(matrix.A', z);
+matrix.Atfun = @(z) binsparsemul(N, M, D, matrix.neighbors, z, 1);
+matrix.sparse_input = true;  % Afun also accepts sparse vectors
 
 matrix.MedianRecoveryFun = @(z) median_recovery_explicit(N, M, D, matrix.neighbors, z);
 
@@ -64,5 +64,6 @@ matrix.A = sparse(L, C, 1, M, N);
 
 matrix.Afun  = @(z) binsparsemul(matrix.A, z);
 matrix.Atfun = @(z) binsparsemul(matrix.A', z);
+matrix.sparse_input = true;  % Afun also accepts sparse vectors
 
 disp('Done.');
@@ -0,0 +1,83 @@
+/*
+ * Random matrices and graphs shared by the tests.
+ */
+
+#ifndef FIXTURES_H
+#define FIXTURES_H
+
+#include <stdlib.h>
+#include "../sketch_matrix.h"
+
+int is_prime(unsigned int p)
+{
+    unsigned int d;
+    for (d = 2; d * d <= p; d++)
+        if (p % d == 0)
+            return 0;
+    return p >= 2;
+}
+
+/* Hash parameters of a countmin_twowise matrix with D sections: primes in
+ * [2N, 4N) and random As, Bs */
+void gen_hash_parameters(int N, int D, countmin_term_t *Ps, countmin_term_t *As,
+                         countmin_term_t *Bs)
+{
+    int i;
+    for (i = 0; i < D; i++)
+    {
+        unsigned int p = 2 * N + rand() % (2 * N);
+        while (!is_prime(p))
+            p++;
+        Ps[i] = p;
+        As[i] = 1 + rand() % (p - 1);
+        Bs[i] = 1 + rand() % (p - 1);
+    }
+}
+
+/* Implicit countmin_twowise matrix (with B = M/D), or the explicit matrix
+ * with the same neighbors */
+void gen_matrix(sketch_matrix_t *m, int N, int M, int D, int explicit)
+{
+    countmin_term_t Ps[64], As[64], Bs[64];
+    unsigned int *neighbors;
+
+    gen_hash_parameters(N, D, Ps, As, Bs);
+    SketchMatrixCreateImplicit(m, N, M, D, M / D, Ps, As, Bs);
+    if (explicit)
+    {
+        neighbors = (unsigned int *) malloc((size_t) N * D * sizeof(unsigned int));
+        CountMinNeighbors(&m->hash, neighbors);
+        SketchMatrixDestroy(m);
+        SketchMatrixCreateExplicit(m, N, M, D, neighbors);
+        free(neighbors);
+    }
+}
+
+/* Random N x D neighbors matrix (column-major, values 1..M); with distinct,
+ * the neighbors of each column are distinct */
+unsigned int *gen_neighbors(int N, int M, int D, int distinct)
+{
+    unsigned int *neighbors = (unsigned int *) malloc((size_t) N * D * sizeof(unsigned int));
+    size_t i;
+    int j, k;
+
+    if (!distinct)
+    {
+        for (i = 0; i < (size_t) N * D; i++)
+            neighbors[i] = 1 + rand() % M;
+        return neighbors;
+    }
+    for (i = 0; i < (size_t) N; i++)
+        for (j = 0; j < D; j++)
+        {
+            unsigned int v;
+            do {
+                v = 1 + rand() % M;
+                for (k = 0; k < j && neighbors[i + (size_t) N * k] != v; k++);
+            } while (k < j);
+            neighbors[i + (size_t) N * j] = v;
+        }
+    return neighbors;
+}
+
+#endif  /* FIXTURES_H */
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "fixtures.h"
+
+void test_build(int N, int M, int D)
+{
+    bipartite_graph_t g;
+    unsigned int *neighbors, *degree;
+    int i, j, k;
+    double *x, *y, *z;
+
+    printf("Running build test N=%d M=%d D=%d\n", N, M, D);
+
+    neighbors = gen_neighbors(N, M, D, 0);
+    if (!GraphBuild(&g, N, M, D, neighbors, 1))
+        printf("GraphBuild failed\n");
+
+    for (i = 0; i < N; i++)
+        for (j = 0; j < D; j++)
+            if (g.left[i*D + j] != neighbors[i + N*j] - 1)
+                printf("Incorrect left neighbor (%d, %d)\n", i, j);
+
+    /* Right lists must be increasing and list each (i, k) edge exactly once */
+    degree = (unsigned int *) calloc(M, sizeof(unsigned int));
+    for (i = 0; i < N; i++)
+        for (j = 0; j < D; j++)
+            degree[neighbors[i + N*j] - 1]++;
+    if (g.right_start[0] != 0 || g.right_start[M] != (unsigned int) (N*D))
+        printf("Incorrect right_start bounds\n");
+    for (k = 0; k < M; k++)
+    {
+        unsigned int p;
+        if (GraphRightEnd(&g, k) - GraphRightBegin(&g, k) != degree[k])
+            printf("Incorrect degree for right node %d\n", k);
+        for (p = GraphRightBegin(&g, k); p < GraphRightEnd(&g, k); p++)
+        {
+            if (p > GraphRightBegin(&g, k) && g.right[p] < g.right[p-1])
+                printf("Right list %d not sorted\n", k);
+            for (j = 0; j < D && g.left[g.right[p]*D + j] != (unsigned int) k; j++);
+            if (j == D)
+                printf("Right node %d lists non-neighbor %llu\n", k,
+                       (unsigned long long) g.right[p]);
+        }
+    }
+
+    /* Multiplication against the neighbors matrix directly */
+    x = (double *) malloc(N * sizeof(double));
+    y = (double *) calloc(M, sizeof(double));
+    z = (double *) malloc(M * sizeof(double));
+    for (i = 0; i < N; i++)
+        x[i] = rand() % 100;
+    for (i = 0; i < N; i++)
+        for (j = 0; j < D; j++)
+            y[neighbors[i + N*j] - 1] += x[i];
+    GraphMul(&g, x, z);
+    for (k = 0; k < M; k++)
+        if (y[k] != z[k])
+            printf("GraphMul: y[%d] = %lg, should be %lg\n", k, z[k], y[k]);
+
+    GraphMulTranspose(&g, y, x);
+    for (i = 0; i < N; i++)
+    {
+        double sum = 0;
+        for (j = 0; j < D; j++)
+            sum += y[neighbors[i + N*j] - 1];
+        if (x[i] != sum)
+            printf("GraphMulTranspose: x[%d] = %lg, should be %lg\n", i, x[i], sum);
+    }
+
+    GraphDestroy(&g);
+    free(neighbors);
+    free(degree);
+    free(x); free(y); free(z);
+}
+
+void test_bad_neighbors()
+{
+    bipartite_graph_t g;
+    unsigned int neighbors[6] = {1, 2, 3, 4, 5, 7};
+    printf("Running bad neighbors test\n");
+    if (GraphBuild(&g, 3, 6, 2, neighbors, 1))
+        printf("GraphBuild accepted a neighbor larger than M\n");
+    if (GraphNeighborsValid(3, 6, 2, neighbors))
+        printf("GraphNeighborsValid accepted a neighbor larger than M\n");
+    neighbors[5] = 0;
+    if (GraphBuild(&g, 3, 6, 2, neighbors, 0))
+        printf("GraphBuild accepted a zero neighbor\n");
+    if (GraphNeighborsValid(3, 6, 2, neighbors))
+        printf("GraphNeighborsValid accepted a zero neighbor\n");
+    neighbors[5] = 6;
+    if (!GraphNeighborsValid(3, 6, 2, neighbors))
+        printf("GraphNeighborsValid rejected valid neighbors\n");
+}
+
+int main()
+{
+    test_build(10, 5, 2);
+    test_build(1000, 100, 8);
+    test_build(100000, 5000, 16);
+    test_bad_neighbors();
+
+    printf("Tests complete\n");
+
+    return 0;
+}
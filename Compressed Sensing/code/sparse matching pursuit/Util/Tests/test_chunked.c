@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Small chunks, so that the mapped graph is advised in several pieces */
+#define GRAPH_FILE_CHUNK 4096
+#include "../chunked.h"
+#include "fixtures.h"
+
+#define GRAPH_PATH "/tmp/test_chunked.graph"
+#define MEDIANS_PATH "/tmp/test_chunked.bin"
+
+/* gen_matrix (see fixtures.h) with type 0 (implicit) or 1 (explicit), or the
+ * explicit matrix mapped from a graph file (type 2) */
+void gen_typed_matrix(sketch_matrix_t *m, int N, int M, int D, int type)
+{
+    gen_matrix(m, N, M, D, type > 0);
+    if (type > 1)
+    {
+        GraphFileWrite(GRAPH_PATH, &m->graph);
+        SketchMatrixDestroy(m);
+        if (!SketchMatrixMapExplicit(m, GRAPH_PATH))
+            printf("Error: could not map the graph file\n");
+    }
+}
+
+/* Sink that copies the medians to the buffer context, checking the order */
+sketch_index_t next_column;
+int BufferAdd(void *context, sketch_index_t first, size_t count, const double *x)
+{
+    if (first != next_column)
+        printf("Error: chunk at %ld, expected %ld\n", (long) first, (long) next_column);
+    next_column = first + (sketch_index_t) count;
+    memcpy((double *) context + first, x, count * sizeof(double));
+    return 1;
+}
+
+/* Sink that stops the recovery */
+int StopAdd(void *context, sketch_index_t first, size_t count, const double *x)
+{
+    (void) context; (void) first; (void) count; (void) x;
+    return 0;
+}
+
+/*
+ * Checks that the chunked recovery (to a buffer and to a file) gives the
+ * medians of SketchMatrixMedianRecovery, and that the top K accumulator keeps
+ * the entries SparsifyTopK selects from them. The sketch has few distinct
+ * values, so there are many ties.
+ */
+void test(int N, int M, int D, int type, size_t chunk, size_t K)
+{
+    sketch_matrix_t m;
+    median_topk_t topk;
+    double *y = (double *) malloc(M * sizeof(double));
+    double *x = (double *) malloc(N * sizeof(double));
+    double *expected_x = (double *) malloc(N * sizeof(double));
+    double *work = (double *) malloc((N + 1) * sizeof(double));
+    double *expected_vals = (double *) malloc((K + 1) * sizeof(double));
+    size_t *expected_idx = (size_t *) malloc((K + 1) * sizeof(size_t));
+    size_t num, k;
+    FILE *f;
+    int i;
+
+    printf("Running test N=%d M=%d D=%d type=%d chunk=%lu K=%lu\n", N, M, D, type,
+           (unsigned long) chunk, (unsigned long) K);
+
+    gen_typed_matrix(&m, N, M, D, type);
+    for (i = 0; i < M; i++)
+        y[i] = rand() % 7 - 3;
+    SketchMatrixMedianRecovery(&m, y, expected_x);
+
+    memset(x, 0, N * sizeof(double));
+    next_column = 0;
+    if (!SketchMatrixMedianRecoveryChunked(&m, y, chunk, BufferAdd, x) || next_column != N)
+        printf("Error: chunked recovery did not cover the columns\n");
+    if (memcmp(x, expected_x, N * sizeof(double)))
+        printf("Error: chunked medians differ\n");
+
+    memset(x, 0, N * sizeof(double));
+    f = fopen(MEDIANS_PATH, "wb");
+    if (!SketchMatrixMedianRecoveryChunked(&m, y, chunk, MedianFileAdd, f))
+        printf("Error: chunked recovery to a file failed\n");
+    fclose(f);
+    f = fopen(MEDIANS_PATH, "rb");
+    if (fread(x, sizeof(double), N, f) != (size_t) N || fgetc(f) != EOF)
+        printf("Error: the file does not hold N medians\n");
+    fclose(f);
+    if (memcmp(x, expected_x, N * sizeof(double)))
+        printf("Error: medians written to the file differ\n");
+
+    if (SketchMatrixMedianRecoveryChunked(&m, y, chunk, StopAdd, NULL))
+        printf("Error: a stopping sink is ignored\n");
+
+    num = SparsifyTopK(expected_x, N, K, work, expected_idx, expected_vals);
+    if (!MedianTopKCreate(&topk, K, chunk ? chunk : MEDIAN_CHUNK))
+        printf("Error: MedianTopKCreate failed\n");
+    if (!SketchMatrixMedianRecoveryChunked(&m, y, chunk, MedianTopKAdd, &topk))
+        printf("Error: chunked top K recovery failed\n");
+    if (topk.num != num)
+        printf("Error: %lu entries kept, expected %lu\n", (unsigned long) topk.num,
+               (unsigned long) num);
+    else
+        for (k = 0; k < num; k++)
+            if (topk.idx[k] != expected_idx[k] || topk.vals[k] != expected_vals[k])
+            {
+                printf("Error: top K entry %lu differs\n", (unsigned long) k);
+                break;
+            }
+    MedianTopKDestroy(&topk);
+
+    SketchMatrixDestroy(&m);
+    free(y);
+    free(x);
+    free(expected_x);
+    free(work);
+    free(expected_vals);
+    free(expected_idx);
+}
+
+int main()
+{
+    int type;
+
+    for (type = 0; type < 3; type++)
+    {
+        test(1, 3, 1, type, 0, 1);
+        test(1000, 100, 5, type, 1, 10);
+        test(1000, 100, 5, type, 7, 10);
+        test(1000, 100, 5, type, 1000, 0);
+        test(1000, 100, 5, type, 0, 2000);
+        test(100000, 5000, 8, type, 3001, 100);
+        test(100000, 5000, 8, type, 65536, 5000);
+    }
+
+    remove(GRAPH_PATH);
+    remove(MEDIANS_PATH);
+    printf("Tests complete\n");
+
+    return 0;
+}
@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fixtures.h"
+
+/* Bucket of column col (0-based) in section i, computed directly */
+int bucket(const countmin_hash_t *h, int i, int col)
+{
+    return (int) (((long long) h->As[i] * (col+1) + h->Bs[i]) % h->Ps[i] % h->B);
+}
+
+void gen_hash(countmin_hash_t *h, int N, int M, int D)
+{
+    countmin_term_t Ps[64], As[64], Bs[64];
+
+    gen_hash_parameters(N, D, Ps, As, Bs);
+    if (!CountMinCreate(h, N, M, D, M / D, Ps, As, Bs))
+        printf("CountMinCreate failed\n");
+}
+
+void test_kernels(int N, int M, int D)
+{
+    countmin_hash_t h;
+    int i, col, B;
+    double *x, *y, *z, *w, *vals;
+    unsigned int *neighbors;
+    size_t K, k, *idx;
+    int t, explicit;
+    sketch_matrix_t explicit_matrix;
+
+    printf("Running kernel test N=%d M=%d D=%d\n", N, M, D);
+
+    gen_hash(&h, N, M, D);
+    B = h.B;
+
+    x = (double *) calloc(N, sizeof(double));
+    y = (double *) calloc(M, sizeof(double));
+    z = (double *) calloc(M, sizeof(double));
+    w = (double *) calloc(N, sizeof(double));
+    for (col = 0; col < N; col++)
+        x[col] = (rand() % 3 == 0) ? rand() % 100 - 50 : 0;
+
+    for (col = 0; col < N; col++)
+        for (i = 0; i < D; i++)
+            y[i*B + bucket(&h, i, col)] += x[col];
+    CountMinMul(&h, x, z);
+    for (i = 0; i < M; i++)
+        if (y[i] != z[i])
+            printf("CountMinMul: y[%d] = %lg, should be %lg\n", i, z[i], y[i]);
+
+    CountMinMulTranspose(&h, y, w);
+    for (col = 0; col < N; col++)
+    {
+        double sum = 0;
+        for (i = 0; i < D; i++)
+            sum += y[i*B + bucket(&h, i, col)];
+        if (w[col] != sum)
+            printf("CountMinMulTranspose: x[%d] = %lg, should be %lg\n", col, w[col], sum);
+    }
+
+    /* The explicit version of the matrix must give the same results */
+    neighbors = (unsigned int *) malloc(N * D * sizeof(unsigned int));
+    CountMinNeighbors(&h, neighbors);
+    for (col = 0; col < N; col++)
+        for (i = 0; i < D; i++)
+            if (neighbors[col + N*i] != (unsigned int) (i*B + bucket(&h, i, col) + 1))
+                printf("CountMinNeighbors: wrong neighbor (%d, %d)\n", col, i);
+
+    SketchMatrixCreateExplicit(&explicit_matrix, N, M, D, neighbors);
+    SketchMatrixMul(&explicit_matrix, x, z);
+    for (i = 0; i < M; i++)
+        if (y[i] != z[i])
+            printf("Explicit mul: y[%d] = %lg, should be %lg\n", i, z[i], y[i]);
+
+    /* Sparse inputs, given by the nonzeros of x */
+    idx = (size_t *) calloc(N, sizeof(size_t));
+    vals = (double *) calloc(N, sizeof(double));
+    for (K = 0, col = 0; col < N; col++)
+        if (x[col] != 0)
+        {
+            idx[K] = col;
+            vals[K++] = x[col];
+        }
+    CountMinMulSparse(&h, K, idx, vals, z);
+    for (i = 0; i < M; i++)
+        if (y[i] != z[i])
+            printf("CountMinMulSparse: y[%d] = %lg, should be %lg\n", i, z[i], y[i]);
+    SketchMatrixMulSparse(&explicit_matrix, K, idx, vals, z);
+    for (i = 0; i < M; i++)
+        if (y[i] != z[i])
+            printf("Explicit sparse mul: y[%d] = %lg, should be %lg\n", i, z[i], y[i]);
+    free(idx);
+    free(vals);
+
+    CountMinMedianRecovery(&h, y, w);
+    SketchMatrixMedianRecovery(&explicit_matrix, y, x);
+    for (col = 0; col < N; col++)
+        if (w[col] != x[col])
+            printf("Median recovery differs at %d: %lg vs %lg\n", col, w[col], x[col]);
+
+    /* Candidate subsets, with and without a threshold */
+    K = N / 7;
+    idx = (size_t *) calloc(K, sizeof(size_t));
+    vals = (double *) calloc(K, sizeof(double));
+    for (k = 0; k < K; k++)
+        idx[k] = rand() % N;
+    for (t = 0; t < 3; t++)
+    {
+        double threshold = (t == 0) ? -1 : (t == 1) ? 0 : 20;
+        for (explicit = 0; explicit <= 1; explicit++)
+        {
+            if (explicit)
+                SketchMatrixMedianRecoveryAt(&explicit_matrix, y, K, idx, threshold, vals);
+            else
+                CountMinMedianRecoveryAt(&h, y, K, idx, threshold, vals);
+            for (k = 0; k < K; k++)
+            {
+                double median = w[idx[k]];
+                double expected = (threshold >= 0 && fabs(median) <= threshold) ? 0 : median;
+                if (vals[k] != expected)
+                    printf("Median recovery at candidates (threshold %lg) differs at %d: %lg vs %lg\n",
+                           threshold, (int) idx[k], vals[k], expected);
+            }
+        }
+    }
+    CountMinMulTranspose(&h, y, w);
+    CountMinMulTransposeAt(&h, y, K, idx, vals);
+    for (k = 0; k < K; k++)
+        if (vals[k] != w[idx[k]])
+            printf("CountMinMulTransposeAt differs at %d\n", (int) idx[k]);
+    SketchMatrixMulTransposeAt(&explicit_matrix, y, K, idx, vals);
+    for (k = 0; k < K; k++)
+        if (vals[k] != w[idx[k]])
+            printf("Explicit transpose at candidates differs at %d\n", (int) idx[k]);
+    free(idx);
+    free(vals);
+
+    SketchMatrixDestroy(&explicit_matrix);
+    CountMinDestroy(&h);
+    free(neighbors);
+    free(x); free(y); free(z); free(w);
+}
+
+/* SSMP through a resident implicit matrix, called several times */
+void test_ssmp_handle(int N, int M, int D, int K)
+{
+    countmin_hash_t h;
+    sketch_matrix_t m;
+    double *x, *y;
+    int i, trial;
+
+    printf("Running SSMP handle test N=%d M=%d D=%d K=%d\n", N, M, D, K);
+
+    gen_hash(&h, N, M, D);
+    SketchMatrixCreateImplicit(&m, N, M, D, h.B, h.Ps, h.As, h.Bs);
+
+    x = (double *) malloc(N * sizeof(double));
+    y = (double *) malloc(M * sizeof(double));
+    for (trial = 0; trial < 3; trial++)
+    {
+        ssmp_t *decoder;
+        double err = 0;
+
+        memset(x, 0, N * sizeof(double));
+        for (i = 0; i < K; i++)
+            x[rand() % N] = (rand() % 2) ? 1 : -1;
+        SketchMatrixMul(&m, x, y);
+
+        decoder = SketchMatrixSSMP(&m, y, 2*K, 10, K, 1, NULL, NULL);
+        if (!decoder)
+            printf("SketchMatrixSSMP failed\n");
+        for (i = 0; i < N; i++)
+            err += fabs(decoder->X[i] - x[i]);
+        if (err > 1e-6)
+            printf("Recovery failed (trial %d), L1 error %lg\n", trial, err);
+    }
+
+    SketchMatrixDestroy(&m);
+    CountMinDestroy(&h);
+    free(x);
+    free(y);
+}
+
+/*
+ * CountMinNext against the % formula, with the original (unreduced) As, primes
+ * close to COUNTMIN_MAX_PRIME and small and large B.
+ */
+void test_next(int B)
+{
+    countmin_term_t Ps[4] = { 1999999973u, 1999999943u, 65521u, 7u };
+    countmin_term_t As[4] = { 1999999972u, 3000000000u, 65520u, 12u };
+    countmin_term_t Bs[4] = { 1999999970u, 17u, 0u, 6u };
+    countmin_term_t vals[4];
+    unsigned int rows[4];
+    countmin_hash_t h;
+    int i, col, N = 100000;
+
+    printf("Running CountMinNext test B=%d\n", B);
+
+    if (!CountMinCreate(&h, N, 4 * B, 4, B, Ps, As, Bs))
+        printf("CountMinCreate failed\n");
+    CountMinSeek(&h, vals, 0);
+    for (col = 0; col < N; col++)
+    {
+        CountMinNext(&h, vals, rows);
+        for (i = 0; i < 4; i++)
+        {
+            unsigned int b = (unsigned int) (((unsigned long long) As[i] * (col+1) + Bs[i]) % Ps[i] % B);
+            if (rows[i] != i * B + b)
+            {
+                printf("Wrong row at column %d, section %d\n", col, i);
+                col = N;
+                break;
+            }
+        }
+    }
+    CountMinDestroy(&h);
+}
+
+#if defined(SKETCH_LARGE) && defined(__SIZEOF_INT128__)
+/*
+ * The 64-bit hash terms of the large-scale build: CountMinSeek at columns
+ * past 2^32 and CountMinNext against the % formula computed in 128 bits,
+ * with primes up to COUNTMIN_MAX_PRIME.
+ */
+void test_next_large(int B)
+{
+    countmin_term_t Ps[3] = { 9223372036854775783ull, 1099511627689ull, 4294967311ull };
+    countmin_term_t As[3] = { 9223372036854775782ull, 18446744073709551557ull, 3000000000ull };
+    countmin_term_t Bs[3] = { 18446744073709551615ull, 12345678901ull, 5ull };
+    countmin_term_t vals[3];
+    unsigned int rows[3];
+    countmin_hash_t h;
+    sketch_index_t col, start = 5000000000ll, N = start + 100000;
+    int i;
+
+    printf("Running 64-bit CountMinNext test B=%d\n", B);
+
+    if (!CountMinCreate(&h, N, 3 * B, 3, B, Ps, As, Bs))
+        printf("CountMinCreate failed\n");
+    CountMinSeek(&h, vals, start);
+    for (col = start; col < N; col++)
+    {
+        CountMinNext(&h, vals, rows);
+        for (i = 0; i < 3; i++)
+        {
+            unsigned __int128 term = ((unsigned __int128) As[i] * (col+1) + Bs[i]) % Ps[i];
+            if (rows[i] != i * B + (unsigned int) (term % B) ||
+                CountMinRow(&h, i, col) != rows[i])
+            {
+                printf("Wrong row at column %lld, section %d\n", (long long) col, i);
+                col = N;
+                break;
+            }
+        }
+    }
+    CountMinDestroy(&h);
+}
+#endif
+
+/* Batched kernels against R separate calls, for both matrix types */
+void test_batch(int N, int M, int D, int R)
+{
+    countmin_hash_t h;
+    sketch_matrix_t m[2];
+    unsigned int *neighbors;
+    double *x, *y, *xb, *single_x, *single_y;
+    int i, r, t;
+
+    printf("Running batch test N=%d M=%d D=%d R=%d\n", N, M, D, R);
+
+    gen_hash(&h, N, M, D);
+    neighbors = (unsigned int *) malloc(N * D * sizeof(unsigned int));
+    CountMinNeighbors(&h, neighbors);
+    SketchMatrixCreateImplicit(&m[0], N, M, D, h.B, h.Ps, h.As, h.Bs);
+    SketchMatrixCreateExplicit(&m[1], N, M, D, neighbors);
+
+    x = (double *) calloc(N * R, sizeof(double));
+    y = (double *) calloc(M * R, sizeof(double));
+    xb = (double *) calloc(N * R, sizeof(double));
+    single_x = (double *) calloc(N, sizeof(double));
+    single_y = (double *) calloc(M, sizeof(double));
+    for (i = 0; i < N * R; i++)
+        x[i] = (rand() % 5 == 0) ? rand() % 100 - 50 : 0;
+
+    for (t = 0; t < 2; t++)
+    {
+        SketchMatrixMulBatch(&m[t], R, x, y);
+        for (r = 0; r < R; r++)
+        {
+            for (i = 0; i < N; i++)
+                single_x[i] = x[i*R + r];
+            SketchMatrixMul(&m[t], single_x, single_y);
+            for (i = 0; i < M; i++)
+                if (single_y[i] != y[i*R + r])
+                    printf("Batch mul (type %d) differs at (%d, %d)\n", t, i, r);
+        }
+
+        SketchMatrixMulTransposeBatch(&m[t], R, y, xb);
+        SketchMatrixMedianRecoveryBatch(&m[t], R, y, x);
+        for (r = 0; r < R; r++)
+        {
+            for (i = 0; i < M; i++)
+                single_y[i] = y[i*R + r];
+            SketchMatrixMulTranspose(&m[t], single_y, single_x);
+            for (i = 0; i < N; i++)
+                if (single_x[i] != xb[i*R + r])
+                    printf("Batch transpose (type %d) differs at (%d, %d)\n", t, i, r);
+            SketchMatrixMedianRecovery(&m[t], single_y, single_x);
+            for (i = 0; i < N; i++)
+                if (single_x[i] != x[i*R + r])
+                    printf("Batch median (type %d) differs at (%d, %d)\n", t, i, r);
+        }
+    }
+
+    SketchMatrixDestroy(&m[0]);
+    SketchMatrixDestroy(&m[1]);
+    CountMinDestroy(&h);
+    free(neighbors);
+    free(x); free(y); free(xb); free(single_x); free(single_y);
+}
+
+/*
+ * The float and int32 kernels of implicit and explicit matrices must agree
+ * exactly with the double ones on integer data.
+ */
+void test_value_types(int N, int M, int D)
+{
+    countmin_hash_t h;
+    sketch_matrix_t m[2];
+    unsigned int *neighbors;
+    double *x, *y, *xr;
+    float *xf, *yf, *xrf;
+    int *xi, *yi, *xri;
+    int i, k, t, errors = 0;
+
+    printf("Running value type test N=%d M=%d D=%d\n", N, M, D);
+
+    gen_hash(&h, N, M, D);
+    neighbors = (unsigned int *) malloc((size_t) N * D * sizeof(unsigned int));
+    CountMinNeighbors(&h, neighbors);
+    SketchMatrixCreateImplicit(&m[0], N, M, D, h.B, h.Ps, h.As, h.Bs);
+    SketchMatrixCreateExplicit(&m[1], N, M, D, neighbors);
+
+    x = (double *) malloc(N * sizeof(double));
+    xr = (double *) malloc(N * sizeof(double));
+    y = (double *) malloc(M * sizeof(double));
+    xf = (float *) malloc(N * sizeof(float));
+    xrf = (float *) malloc(N * sizeof(float));
+    yf = (float *) malloc(M * sizeof(float));
+    xi = (int *) malloc(N * sizeof(int));
+    xri = (int *) malloc(N * sizeof(int));
+    yi = (int *) malloc(M * sizeof(int));
+    for (i = 0; i < N; i++)
+    {
+        x[i] = (rand() % 3 == 0) ? rand() % 100 - 50 : 0;
+        xf[i] = (float) x[i];
+        xi[i] = (int) x[i];
+    }
+
+    for (t = 0; t < 2; t++)
+    {
+        SketchMatrixMul(&m[t], x, y);
+        SketchMatrixMulFloat(&m[t], xf, yf);
+        SketchMatrixMulInt32(&m[t], xi, yi);
+        for (k = 0; k < M; k++)
+            errors += (yf[k] != y[k]) + (yi[k] != y[k]);
+
+        SketchMatrixMulTranspose(&m[t], y, xr);
+        SketchMatrixMulTransposeFloat(&m[t], yf, xrf);
+        SketchMatrixMulTransposeInt32(&m[t], yi, xri);
+        for (i = 0; i < N; i++)
+            errors += (xrf[i] != xr[i]) + (xri[i] != xr[i]);
+
+        SketchMatrixMedianRecovery(&m[t], y, xr);
+        SketchMatrixMedianRecoveryFloat(&m[t], yf, xrf);
+        SketchMatrixMedianRecoveryInt32(&m[t], yi, xri);
+        for (i = 0; i < N; i++)
+            errors += (xrf[i] != xr[i]) + (xri[i] != xr[i]);
+    }
+    if (errors)
+        printf("Error: %d float/int32 results differ from double\n", errors);
+
+    SketchMatrixDestroy(&m[0]);
+    SketchMatrixDestroy(&m[1]);
+    CountMinDestroy(&h);
+    free(neighbors);
+    free(x); free(xr); free(y);
+    free(xf); free(xrf); free(yf);
+    free(xi); free(xri); free(yi);
+}
+
+int main()
+{
+    test_next(1);
+    test_next(3);
+    test_next(1000);
+    test_next(500000000);
+#if defined(SKETCH_LARGE) && defined(__SIZEOF_INT128__)
+    test_next_large(1);
+    test_next_large(1000);
+    test_next_large(700000001);
+#endif
+    test_kernels(100, 20, 4);
+    test_kernels(10000, 1000, 10);
+    test_kernels(100000, 2000, 8);  /* several parallel blocks */
+    test_ssmp_handle(10000, 2000, 8, 40);
+    test_batch(1000, 200, 5, 1);
+    test_batch(50000, 2000, 7, 6);
+    test_value_types(1000, 200, 5);
+    test_value_types(100000, 4000, 40);  /* D > MEDIAN_MAX_D */
+
+    printf("Tests complete\n");
+
+    return 0;
+}
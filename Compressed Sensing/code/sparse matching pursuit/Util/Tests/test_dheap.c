@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../absvalheap.h"
+#include "../dheap.h"
+
+#define MAX_BATCH 20
+
+double rand_value()
+{
+    /* Few distinct magnitudes, so there are many ties */
+    return (rand() % 41 - 20) / 4.0;
+}
+
+/* Checks the heap property and the positions */
+int check_heap(dheap_t *heap)
+{
+    int p;
+    for (p = 0; p < heap->size; p++)
+    {
+        if (heap->position[heap->nodes[p].index] != p)
+            return 0;
+        if (p > 0 && fabs(heap->nodes[(p-1) / DHEAP_ARITY].value) < fabs(heap->nodes[p].value))
+            return 0;
+    }
+    return 1;
+}
+
+/* Random operations on a dheap and an abs_val_heap must give tops with the
+ * same value (the indices may differ on ties) */
+void test_random(int n, int ops)
+{
+    dheap_t heap;
+    abs_val_heap_t ref;
+    double *values, v1 = 0, v2;
+    dheap_update_t *updates;
+    sketch_index_t i1;
+    int i, t, i2, errors = 0;
+
+    printf("Running random test n=%d ops=%d\n", n, ops);
+
+    values = (double *) malloc((n+1) * sizeof(double));
+    updates = (dheap_update_t *) malloc(MAX_BATCH * sizeof(dheap_update_t));
+    for (i = 1; i <= n; i++)
+        values[i] = rand_value();
+
+    DHeapCreate(&heap, n);
+    AbsValHeapCreate(&ref, n, 0);
+    DHeapBuild(&heap, n, values);
+    AbsValHeapBuild(&ref, n, values);
+
+    for (t = 0; t < ops && !errors; t++)
+    {
+        int op = rand() % 4;
+        if (op == 0 && DHeapSize(&heap) > 0)
+        {
+            DHeapGetTop(&heap, &i1, &v1);
+            AbsValHeapGetTop(&ref, &i2, &v2);
+            if (fabs(v1) != fabs(v2))
+                errors++;
+            /* Remove the same element from both */
+            DHeapRemoveTop(&heap);
+            AbsValHeapChangeValue(&ref, i1, 1e100);
+            AbsValHeapRemoveTop(&ref);
+            DHeapAdd(&heap, i1, v1);
+            AbsValHeapAdd(&ref, i1, v1);
+        }
+        else if (op == 1)
+        {
+            int count = 1 + rand() % MAX_BATCH;
+            for (i = 0; i < count; i++)
+            {
+                updates[i].index = 1 + rand() % n;
+                updates[i].value = rand_value();
+                AbsValHeapChangeValue(&ref, updates[i].index, updates[i].value);
+            }
+            DHeapChangeValues(&heap, count, updates);
+        }
+        else
+        {
+            i1 = 1 + rand() % n;
+            v1 = rand_value();
+            DHeapChangeValue(&heap, i1, v1);
+            AbsValHeapChangeValue(&ref, i1, v1);
+            DHeapGetValue(&heap, i1, &v2);
+            if (v1 != v2)
+                errors++;
+        }
+        if (!check_heap(&heap))
+            errors++;
+        DHeapGetTop(&heap, &i1, &v1);
+        AbsValHeapGetTop(&ref, &i2, &v2);
+        if (fabs(v1) != fabs(v2))
+            errors++;
+    }
+    if (errors)
+        printf("Heaps differ after %d operations\n", t);
+
+    /* Drain: the values must come out in decreasing absolute value */
+    for (v2 = HUGE_VAL; DHeapGetTop(&heap, &i1, &v1); v2 = fabs(v1))
+    {
+        if (fabs(v1) > v2 || !check_heap(&heap))
+        {
+            printf("Heap order broken while draining\n");
+            break;
+        }
+        DHeapRemoveTop(&heap);
+    }
+
+    DHeapDestroy(&heap);
+    AbsValHeapDestroy(&ref);
+    free(values);
+    free(updates);
+}
+
+int main()
+{
+    test_random(1, 100);
+    test_random(5, 1000);
+    test_random(17, 10000);
+    test_random(1000, 100000);
+
+    printf("Tests complete\n");
+
+    return 0;
+}
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../walsh.h"
+
+/* The original fasterwalsh loop, x = data(idx) followed by the stages */
+void reference(const double *data, const int *idx, int N, double *x)
+{
+    int L, L1, k1, k2, k3, i1, i2, i3, i;
+
+    for (i = 0; i < N; i++)
+        x[i] = data[idx[i] - 1];
+
+    L = 1;
+    while ((1 << L) < N) L++;
+    k1 = N, k2 = 1, k3 = N/2;
+    for (i1 = 1; i1 <= L; i1++)
+    {
+        L1 = 1;
+        for (i2 = 1; i2 <= k2; i2++)
+        {
+            for (i3 = 1; i3 <= k3; i3++)
+            {
+                int i = i3 + L1 - 2;
+                int j = i + k3;
+                double temp1 = x[i],  temp2 = x[j];
+                if (i2 % 2 == 0)
+                {
+                    x[i] = temp1 - temp2;
+                    x[j] = temp1 + temp2;
+                } else
+                {
+                    x[i] = temp1 + temp2;
+                    x[j] = temp1 - temp2;
+                }
+            }
+            L1 = L1 + k1;
+        }
+        k1 = k1/2;
+        k2 = k2*2;
+        k3 = k3/2;
+    }
+}
+
+/* bitrevorder(1:N), computed directly */
+void bitrevorder(int N, int *idx)
+{
+    int i, b, L = FWHTLog2(N);
+    for (i = 0; i < N; i++)
+    {
+        int r = 0;
+        for (b = 0; b < L; b++)
+            if (i & (1 << b))
+                r |= 1 << (L - 1 - b);
+        idx[i] = r + 1;
+    }
+}
+
+void test(int N)
+{
+    double *data, *x, *y;
+    int *idx, i;
+
+    printf("Running test N=%d\n", N);
+
+    data = (double *) calloc(N, sizeof(double));
+    x = (double *) malloc(N * sizeof(double));
+    y = (double *) malloc(N * sizeof(double));
+    idx = (int *) malloc(N * sizeof(int));
+    for (i = 0; i < N; i++)
+        data[i] = (rand() % 2001 - 1000) / 7.0;
+
+    bitrevorder(N, idx);
+    reference(data, idx, N, x);
+    FWHT(data, N, y);
+
+    for (i = 0; i < N; i++)
+        if (x[i] != y[i])
+        {
+            printf("Error: N=%d, position %d is %lg, should be %lg\n", N, i, y[i], x[i]);
+            break;
+        }
+
+    free(data);
+    free(x);
+    free(y);
+    free(idx);
+}
+
+/* WalshMul and WalshMulTranspose against A_fw and At_fw written with the
+ * reference transform, for R signals */
+void test_walsh(int N, int K, int R)
+{
+    unsigned int *P, *omega;
+    int *idx, i, k, r;
+    double *x, *b, *xb, *bb, *tmp, *fx;
+
+    printf("Running Walsh operator test N=%d K=%d R=%d\n", N, K, R);
+
+    P = (unsigned int *) malloc(N * sizeof(unsigned int));
+    omega = (unsigned int *) malloc(N * sizeof(unsigned int));
+    idx = (int *) malloc(N * sizeof(int));
+    x = (double *) calloc(N * R, sizeof(double));
+    xb = (double *) calloc(N * R, sizeof(double));
+    b = (double *) calloc(K * R, sizeof(double));
+    bb = (double *) calloc(K * R, sizeof(double));
+    tmp = (double *) calloc(N, sizeof(double));
+    fx = (double *) calloc(N, sizeof(double));
+
+    /* Random permutations (omega keeps its first K values) */
+    for (i = 0; i < N; i++)
+        P[i] = omega[i] = i + 1;
+    for (i = N - 1; i > 0; i--)
+    {
+        int j = rand() % (i + 1), t;
+        t = P[i]; P[i] = P[j]; P[j] = t;
+        j = rand() % (i + 1);
+        t = omega[i]; omega[i] = omega[j]; omega[j] = t;
+    }
+    bitrevorder(N, idx);
+    for (i = 0; i < N * R; i++)
+        x[i] = (rand() % 2001 - 1000) / 7.0;
+    for (i = 0; i < K * R; i++)
+        b[i] = (rand() % 2001 - 1000) / 7.0;
+
+    WalshMulBlock(N, P, K, omega, R, x, bb, 0);
+    WalshMulBlock(N, P, K, omega, R, b, xb, 1);
+
+    for (r = 0; r < R; r++)
+    {
+        /* b = fx(OMEGA), fx = fasterwalsh(x(P), idx) */
+        for (i = 0; i < N; i++)
+            tmp[i] = x[N*r + P[i] - 1];
+        reference(tmp, idx, N, fx);
+        for (k = 0; k < K; k++)
+            if (bb[K*r + k] != fx[omega[k] - 1])
+            {
+                printf("Error: WalshMul differs at (%d, %d)\n", k, r);
+                break;
+            }
+
+        /* fx(OMEGA) = b; x(P) = fasterwalsh(fx, idx) */
+        memset(fx, 0, N * sizeof(double));
+        for (k = 0; k < K; k++)
+            fx[omega[k] - 1] = b[K*r + k];
+        reference(fx, idx, N, tmp);
+        for (i = 0; i < N; i++)
+            if (xb[N*r + P[i] - 1] != tmp[i])
+            {
+                printf("Error: WalshMulTranspose differs at (%d, %d)\n", i, r);
+                break;
+            }
+    }
+
+    free(P); free(omega); free(idx);
+    free(x); free(xb); free(b); free(bb); free(tmp); free(fx);
+}
+
+int main()
+{
+    int L;
+
+    for (L = 0; L <= 22; L++)
+        test(1 << L);
+    if (FWHTLog2(3) != -1 || FWHTLog2(0) != -1 || FWHTLog2(1024) != 10)
+        printf("Error: FWHTLog2\n");
+    test_walsh(1, 1, 1);
+    test_walsh(1024, 100, 1);
+    test_walsh(4096, 4096, 5);
+    test_walsh(1 << 21, 1000, 2);
+
+    printf("Tests complete\n");
+
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Small chunks, so that the streamed kernels go through several */
+#define GRAPH_FILE_CHUNK 4096
+#include "../graphfile.h"
+#include "fixtures.h"
+
+#define NEIGHBORS_PATH "/tmp/test_graphfile.bin"
+#define GRAPH_PATH "/tmp/test_graphfile.graph"
+
+void write_neighbors(const unsigned int *neighbors, int N, int D)
+{
+    FILE *f = fopen(NEIGHBORS_PATH, "wb");
+    fwrite(neighbors, sizeof(unsigned int), (size_t) N * D, f);
+    fclose(f);
+}
+
+/* Returns 1 if the arrays of the two graphs are the same */
+int same_graph(const bipartite_graph_t *a, const bipartite_graph_t *b)
+{
+    size_t ND = (size_t) a->N * a->D;
+    return a->N == b->N && a->M == b->M && a->D == b->D &&
+           !memcmp(a->left, b->left, ND * sizeof(sketch_bucket_t)) &&
+           !memcmp(a->right_start, b->right_start, (a->M + 1) * sizeof(sketch_offset_t)) &&
+           !memcmp(a->right, b->right, ND * sizeof(sketch_column_t));
+}
+
+/*
+ * Builds the graph file out of core with the given memory budget and with
+ * GraphFileWrite, and checks that the mapped graphs are the graph built in
+ * memory and that the streamed kernels give the results of the in-memory
+ * ones.
+ */
+void test(int N, int M, int D, size_t memory)
+{
+    unsigned int *neighbors = gen_neighbors(N, M, D, 0);
+    bipartite_graph_t g, mapped;
+    double *x = (double *) malloc(N * sizeof(double));
+    double *y = (double *) malloc(M * sizeof(double));
+    double *expected_x = (double *) malloc(N * sizeof(double));
+    double *expected_y = (double *) malloc(M * sizeof(double));
+    float *xf = (float *) malloc(N * sizeof(float));
+    float *yf = (float *) malloc(M * sizeof(float));
+    float *expected_xf = (float *) malloc(N * sizeof(float));
+    int i;
+
+    printf("Running test N=%d M=%d D=%d memory=%lu\n", N, M, D, (unsigned long) memory);
+
+    GraphBuild(&g, N, M, D, neighbors, 1);
+    write_neighbors(neighbors, N, D);
+    if (!GraphFileBuild(GRAPH_PATH, NEIGHBORS_PATH, N, M, D, memory))
+        printf("Error: GraphFileBuild failed\n");
+    if (!GraphFileMap(&mapped, GRAPH_PATH))
+    {
+        printf("Error: GraphFileMap failed\n");
+        return;
+    }
+    if (!mapped.mapped_size || !same_graph(&g, &mapped))
+        printf("Error: the built graph file differs from the graph\n");
+
+    for (i = 0; i < N; i++)
+        xf[i] = x[i] = rand() % 201 - 100;
+    for (i = 0; i < M; i++)
+        yf[i] = y[i] = rand() % 201 - 100;
+
+    GraphMedianRecovery(&g, y, expected_x);
+    GraphStreamMedianRecovery(&mapped, y, x);
+    if (memcmp(x, expected_x, N * sizeof(double)))
+        printf("Error: streamed median recovery differs\n");
+    GraphMedianRecoveryFloat(&g, yf, expected_xf);
+    GraphStreamMedianRecoveryFloat(&mapped, yf, xf);
+    if (memcmp(xf, expected_xf, N * sizeof(float)))
+        printf("Error: streamed float median recovery differs\n");
+
+    for (i = 0; i < N; i++)
+        x[i] = rand() % 201 - 100;
+    GraphMul(&g, x, expected_y);
+    GraphStreamMul(&mapped, x, y);
+    if (memcmp(y, expected_y, M * sizeof(double)))
+        printf("Error: streamed multiply differs\n");
+    GraphDestroy(&mapped);
+
+    if (!GraphFileWrite(GRAPH_PATH, &g) || !GraphFileMap(&mapped, GRAPH_PATH) ||
+        !same_graph(&g, &mapped))
+        printf("Error: the written graph file differs from the graph\n");
+    else
+        GraphDestroy(&mapped);
+
+    GraphDestroy(&g);
+    free(neighbors);
+    free(x);
+    free(y);
+    free(expected_x);
+    free(expected_y);
+    free(xf);
+    free(yf);
+    free(expected_xf);
+}
+
+/* Out of range neighbors and truncated files are rejected */
+void test_invalid(int N, int M, int D)
+{
+    unsigned int *neighbors = gen_neighbors(N, M, D, 0);
+    bipartite_graph_t g;
+    long size;
+    FILE *f;
+
+    printf("Running invalid graph test N=%d M=%d D=%d\n", N, M, D);
+
+    neighbors[N * D / 2] = M + 1;
+    write_neighbors(neighbors, N, D);
+    if (GraphFileBuild(GRAPH_PATH, NEIGHBORS_PATH, N, M, D, 1 << 20))
+        printf("Error: an out of range neighbor is accepted\n");
+    if (GraphFileBuild(GRAPH_PATH, NEIGHBORS_PATH, N + 1, M, D, 1 << 20))
+        printf("Error: a short neighbors file is accepted\n");
+
+    neighbors[N * D / 2] = M;
+    write_neighbors(neighbors, N, D);
+    GraphFileBuild(GRAPH_PATH, NEIGHBORS_PATH, N, M, D, 1 << 20);
+    f = fopen(GRAPH_PATH, "rb");
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fclose(f);
+    if (truncate(GRAPH_PATH, size - 4) || GraphFileMap(&g, GRAPH_PATH))
+        printf("Error: a truncated graph file is accepted\n");
+
+    free(neighbors);
+}
+
+int main()
+{
+    test(1, 1, 1, 1 << 20);
+    test(1000, 100, 3, 1 << 20);
+    test(1000, 100, 3, 64);
+    test(100000, 5000, 8, 1 << 20);
+    test(100000, 5000, 8, 1 << 18);
+    test(100000, 50, 8, 4096);
+    test_invalid(1000, 100, 3);
+
+    remove(NEIGHBORS_PATH);
+    remove(GRAPH_PATH);
+    printf("Tests complete\n");
+
+    return 0;
+}
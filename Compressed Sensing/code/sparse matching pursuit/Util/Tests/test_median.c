@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../median.h"
+#include "../randomized_select.h"
+
+/* Compares Median and MedianLanes (and their float and int32 versions, on
+ * the same integer values) against randomized_select */
+void test(int D, int delta, int trials)
+{
+    double values[100], copy[100], lanes[100 * MEDIAN_LANES], scratch[100];
+    double expected[MEDIAN_LANES], out[MEDIAN_LANES];
+    float fvalues[100], flanes[100 * MEDIAN_LANES], fscratch[100], fout[MEDIAN_LANES];
+    int ivalues[100], ilanes[100 * MEDIAN_LANES], iscratch[100], iout[MEDIAN_LANES];
+    unsigned int seed = 1;
+    int t, j, l;
+
+    for (t = 0; t < trials; t++)
+    {
+        for (l = 0; l < MEDIAN_LANES; l++)
+        {
+            for (j = 0; j < D; j++)
+            {
+                lanes[j * MEDIAN_LANES + l] = values[j] = rand() % delta - delta / 2;
+                flanes[j * MEDIAN_LANES + l] = fvalues[j] = (float) values[j];
+                ilanes[j * MEDIAN_LANES + l] = ivalues[j] = (int) values[j];
+            }
+            memcpy(copy, values, D * sizeof(double));
+            expected[l] = randomized_select(copy, D, (D+1)/2);
+
+            if (Median(values, D, &seed) != expected[l])
+                printf("Error: Median for D=%d is %lg, should be %lg\n",
+                       D, Median(values, D, &seed), expected[l]);
+            if (MedianFloat(fvalues, D, &seed) != expected[l] ||
+                MedianInt32(ivalues, D, &seed) != expected[l])
+                printf("Error: MedianFloat or MedianInt32 for D=%d differs\n", D);
+        }
+        MedianLanes(lanes, D, out, scratch, &seed);
+        for (l = 0; l < MEDIAN_LANES; l++)
+            if (out[l] != expected[l])
+                printf("Error: MedianLanes for D=%d lane %d is %lg, should be %lg\n",
+                       D, l, out[l], expected[l]);
+        MedianLanesFloat(flanes, D, fout, fscratch, &seed);
+        MedianLanesInt32(ilanes, D, iout, iscratch, &seed);
+        for (l = 0; l < MEDIAN_LANES; l++)
+            if (fout[l] != expected[l] || iout[l] != expected[l])
+                printf("Error: MedianLanesFloat or MedianLanesInt32 for D=%d lane %d differs\n",
+                       D, l);
+    }
+}
+
+int main()
+{
+    int D;
+    for (D = 1; D <= 40; D++)
+    {
+        test(D, 1000000, 200);
+        test(D, 5, 200);  /* many ties */
+    }
+    test(100, 1000, 50);
+
+    printf("Tests complete\n");
+
+    return 0;
+}
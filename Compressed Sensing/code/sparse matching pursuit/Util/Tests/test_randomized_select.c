@@ -37,6 +37,31 @@ void gen_random(double *A, int N, int delta)
         A[i] = rand() % delta;
 }
 
+/* The reentrant version must agree with the sorted order too */
+void test_r(double *A, int N)
+{
+    int i;
+    unsigned int seed = 1;
+    double *B, *C;
+
+    B = (double *) malloc(N * sizeof(double));
+    C = (double *) malloc(N * sizeof(double));
+    memcpy(B, A, N * sizeof(double));
+    qsort(B, N, sizeof(double), compare);
+
+    for (i = 0; i < N; i++)
+    {
+        double val;
+        memcpy(C, A, N * sizeof(double));
+        val = randomized_select_r(C, N, i+1, &seed);
+        if (B[i] != val)
+            printf("Error (_r): %d-th element is %lg, should be %lg\n", i+1, val, B[i]);
+    }
+
+    free(B);
+    free(C);
+}
+
 double A[10000];
 int N;
 int main()
@@ -74,6 +99,12 @@ int main()
     gen_random(A, 10000, 1);
     test(A, 10000);
 
+    gen_random(A, 1000, 10);
+    test_r(A, 1000);
+
+    gen_random(A, 1000, 100000);
+    test_r(A, 1000);
+
     printf("Tests complete\n");
 
     return 0;
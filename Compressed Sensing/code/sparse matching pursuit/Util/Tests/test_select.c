@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../select.h"
+
+enum { RANDOM, FEW_VALUES, EQUAL, SORTED, REVERSED, ORGAN_PIPE };
+
+int compare(const void *aptr, const void *bptr)
+{
+    double a = *((double *) aptr);
+    double b = *((double *) bptr);
+    if (a == b) return 0;
+    return a < b ? -1 : 1;
+}
+
+void generate(double *A, size_t N, int kind)
+{
+    size_t i;
+    for (i = 0; i < N; i++)
+        switch (kind)
+        {
+        case RANDOM:     A[i] = rand() / (double) RAND_MAX - 0.5; break;
+        case FEW_VALUES: A[i] = rand() % 3; break;
+        case EQUAL:      A[i] = 7; break;
+        case SORTED:     A[i] = (double) i; break;
+        case REVERSED:   A[i] = (double) (N - i); break;
+        case ORGAN_PIPE: A[i] = (double) (i < N/2 ? i : N - i); break;
+        }
+}
+
+/* Selects ranks 1, N, the median and a few random ones, in double and float
+ * (the float values are exact for the generated data except RANDOM), with
+ * random pivots and with median of medians pivots only */
+void test(size_t N, int kind)
+{
+    double *A, *B, *C, val;
+    float *F;
+    size_t i, r, ranks[8];
+    unsigned int seed = 1;
+    int errors = 0;
+
+    A = (double *) malloc(N * sizeof(double));
+    B = (double *) malloc(N * sizeof(double));
+    C = (double *) malloc(N * sizeof(double));
+    F = (float *) malloc(N * sizeof(float));
+    generate(A, N, kind);
+    memcpy(B, A, N * sizeof(double));
+    qsort(B, N, sizeof(double), compare);
+
+    ranks[0] = 1;
+    ranks[1] = N;
+    ranks[2] = (N + 1) / 2;
+    for (r = 3; r < 8; r++)
+        ranks[r] = 1 + SelectIndex(&seed, N);
+
+    for (r = 0; r < 8; r++)
+    {
+        memcpy(C, A, N * sizeof(double));
+        val = SelectKth(C, N, ranks[r], &seed);
+        if (val != B[ranks[r]-1])
+            errors++;
+
+        memcpy(C, A, N * sizeof(double));
+        val = SelectRounds(C, N, ranks[r], &seed, 0);
+        if (val != B[ranks[r]-1])
+            errors++;
+
+        if (kind != RANDOM)
+        {
+            for (i = 0; i < N; i++)
+                F[i] = (float) A[i];
+            if (SelectKthFloat(F, N, ranks[r], NULL) != (float) B[ranks[r]-1])
+                errors++;
+        }
+    }
+    if (errors)
+        printf("Error: %d wrong selections for N=%lu kind=%d\n", errors, (unsigned long) N, kind);
+
+    free(A);
+    free(B);
+    free(C);
+    free(F);
+}
+
+/* The multithreaded selection must agree with the serial one */
+void test_parallel(size_t N, int kind)
+{
+    double *A, *C, expected, val;
+    size_t r, ranks[3];
+
+    printf("Running parallel test N=%lu kind=%d\n", (unsigned long) N, kind);
+    A = (double *) malloc(N * sizeof(double));
+    C = (double *) malloc(N * sizeof(double));
+    generate(A, N, kind);
+
+    ranks[0] = 1;
+    ranks[1] = N / 2;
+    ranks[2] = N - N / 100;
+    for (r = 0; r < 3; r++)
+    {
+        memcpy(C, A, N * sizeof(double));
+        expected = SelectRounds(C, N, ranks[r], NULL, 0);
+        memcpy(C, A, N * sizeof(double));
+        val = SelectKth(C, N, ranks[r], NULL);
+        if (val != expected)
+            printf("Error: %lu-th element is %lg, should be %lg\n",
+                   (unsigned long) ranks[r], val, expected);
+    }
+
+    free(A);
+    free(C);
+}
+
+int main()
+{
+    int kind;
+    size_t sizes[] = {1, 2, 5, 16, 17, 100, 1000, 100000};
+    size_t s;
+
+    for (kind = RANDOM; kind <= ORGAN_PIPE; kind++)
+        for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+            test(sizes[s], kind);
+
+    test_parallel(SELECT_PARALLEL_MIN * 2, RANDOM);
+    test_parallel(SELECT_PARALLEL_MIN * 2, FEW_VALUES);
+    test_parallel(SELECT_PARALLEL_MIN * 2, SORTED);
+
+    printf("Tests complete\n");
+
+    return 0;
+}
@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../shard.h"
+#include "fixtures.h"
+
+#define PATH "/tmp/test_shard.shard"
+
+/* Descriptor of an implicit countmin_twowise matrix, or of the explicit
+ * matrix with the same neighbors (Ps, As, Bs and neighbors are allocated) */
+void gen_descriptor(sketch_descriptor_t *d, int N, int M, int D, int explicit)
+{
+    sketch_matrix_t m;
+
+    memset(d, 0, sizeof(sketch_descriptor_t));
+    d->type = SKETCH_MATRIX_IMPLICIT;
+    d->N = N;
+    d->M = M;
+    d->D = D;
+    d->B = M / D;
+    d->Ps = (countmin_term_t *) malloc(3 * D * sizeof(countmin_term_t));
+    d->As = d->Ps + D;
+    d->Bs = d->Ps + 2 * D;
+    gen_hash_parameters(N, D, d->Ps, d->As, d->Bs);
+    if (explicit)
+    {
+        ShardCreateMatrix(&m, d);
+        d->type = SKETCH_MATRIX_EXPLICIT;
+        d->B = 0;
+        d->neighbors = (unsigned int *) malloc((size_t) N * D * sizeof(unsigned int));
+        CountMinNeighbors(&m.hash, d->neighbors);
+        SketchMatrixDestroy(&m);
+    }
+}
+
+int count_differences(const double *a, const double *b, int n)
+{
+    int i, diff = 0;
+    for (i = 0; i < n; i++)
+        diff += (a[i] != b[i]);
+    return diff;
+}
+
+/*
+ * Sketches a signal in S slices, each into its own shard written to and read
+ * back from a file, merges the shards as shard_merge does and checks that the
+ * sum is the sketch of the whole signal and that it decodes to the same
+ * vector with the matrix read from the merged shard.
+ */
+void test_merge(int N, int M, int D, int explicit, int S)
+{
+    sketch_descriptor_t d, read;
+    sketch_matrix_t m, read_m;
+    double *x = (double *) calloc(N, sizeof(double));
+    double *y = (double *) malloc(M * sizeof(double));
+    double *merged = (double *) calloc(M, sizeof(double));
+    double *slice = (double *) malloc(N * sizeof(double));
+    double *slice_y = (double *) malloc(M * sizeof(double));
+    double *expected = (double *) malloc(N * sizeof(double));
+    double *shard_y;
+    ssmp_t *decoder;
+    int i, k, s;
+
+    printf("Running merge test N=%d M=%d D=%d explicit=%d slices=%d\n", N, M, D, explicit, S);
+
+    gen_descriptor(&d, N, M, D, explicit);
+    ShardCreateMatrix(&m, &d);
+    for (i = 0; i < 20; i++)
+        x[rand() % N] = rand() % 21 - 10;
+    SketchMatrixMul(&m, x, y);
+
+    for (s = 0; s < S; s++)
+    {
+        int start = (int) ParallelChunkStart(N, s, S), end = (int) ParallelChunkStart(N, s + 1, S);
+        memset(slice, 0, N * sizeof(double));
+        memcpy(slice + start, x + start, (end - start) * sizeof(double));
+        SketchMatrixMul(&m, slice, slice_y);
+        if (!ShardWrite(PATH, &d, slice_y))
+            printf("Error: ShardWrite failed\n");
+        if (!ShardRead(PATH, &read, &shard_y))
+        {
+            printf("Error: ShardRead failed\n");
+            continue;
+        }
+        if (!ShardSameDescriptor(&d, &read))
+            printf("Error: the descriptor read differs from the one written\n");
+        for (k = 0; k < M; k++)
+            merged[k] += shard_y[k];
+        ShardFree(&read);
+        free(shard_y);
+    }
+    if (count_differences(merged, y, M))
+        printf("Error: %d entries of the merged sketch differ\n", count_differences(merged, y, M));
+
+    /* Decode the merged shard with the matrix it describes */
+    decoder = SketchMatrixSSMP(&m, y, 10, 10, 20, 1, NULL, NULL);
+    memcpy(expected, decoder->X, N * sizeof(double));
+    ShardWrite(PATH, &d, merged);
+    if (!ShardRead(PATH, &read, &shard_y) || !ShardCreateMatrix(&read_m, &read))
+        printf("Error: could not read the merged shard\n");
+    else
+    {
+        decoder = SketchMatrixSSMP(&read_m, shard_y, 10, 10, 20, 1, NULL, NULL);
+        if (count_differences(decoder->X, expected, N))
+            printf("Error: %d entries of the decoded vector differ\n",
+                   count_differences(decoder->X, expected, N));
+        SketchMatrixDestroy(&read_m);
+        ShardFree(&read);
+        free(shard_y);
+    }
+
+    SketchMatrixDestroy(&m);
+    free(d.Ps);
+    free(d.neighbors);
+    free(x);
+    free(y);
+    free(merged);
+    free(slice);
+    free(slice_y);
+    free(expected);
+}
+
+/* Shards of another matrix, truncated or of another version are rejected */
+void test_invalid(int N, int M, int D)
+{
+    sketch_descriptor_t d, read;
+    double *y = (double *) calloc(M, sizeof(double)), *read_y;
+    unsigned int version = SHARD_VERSION + 1;
+    long size;
+    FILE *f;
+
+    printf("Running invalid shard test N=%d M=%d D=%d\n", N, M, D);
+
+    gen_descriptor(&d, N, M, D, 0);
+    ShardWrite(PATH, &d, y);
+    ShardRead(PATH, &read, &read_y);
+    read.As[0] = read.As[0] % (read.Ps[0] - 1) + 1;
+    if (read.As[0] == d.As[0] || ShardSameDescriptor(&d, &read))
+        printf("Error: different hash parameters are not detected\n");
+    ShardFree(&read);
+    free(read_y);
+
+    f = fopen(PATH, "rb");
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fclose(f);
+    if (truncate(PATH, size - 1) || ShardRead(PATH, &read, &read_y))
+        printf("Error: a truncated shard is accepted\n");
+
+    ShardWrite(PATH, &d, y);
+    f = fopen(PATH, "r+b");
+    fseek(f, 8, SEEK_SET);
+    fwrite(&version, 4, 1, f);
+    fclose(f);
+    if (ShardRead(PATH, &read, &read_y))
+        printf("Error: a shard of another version is accepted\n");
+
+    free(d.Ps);
+    free(y);
+}
+
+int main()
+{
+    test_merge(1000, 300, 3, 0, 1);
+    test_merge(1000, 300, 3, 0, 4);
+    test_merge(1000, 300, 3, 1, 4);
+    test_merge(50000, 4000, 8, 0, 7);
+    test_merge(50000, 4000, 8, 1, 7);
+    test_invalid(1000, 300, 3);
+
+    remove(PATH);
+    printf("Tests complete\n");
+
+    return 0;
+}
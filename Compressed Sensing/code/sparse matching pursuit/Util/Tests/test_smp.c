@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../smp.h"
+#include "../sparsify.h"
+#include "fixtures.h"
+
+/* The loop of smp.m, with dense vectors */
+void smp_reference(const sketch_matrix_t *m, const double *b, int l, int T,
+                   double convergence_factor, double *x)
+{
+    int N = m->N, M = m->M, i, j;
+    double *c = (double *) malloc(M * sizeof(double));
+    double *u = (double *) malloc(N * sizeof(double));
+
+    memset(x, 0, N * sizeof(double));
+    for (j = 1; j <= T; j++)
+    {
+        SketchMatrixMul(m, x, c);
+        for (i = 0; i < M; i++)
+            c[i] = b[i] - c[i];
+        SketchMatrixMedianRecovery(m, c, u);
+        sparsify(u, N, 2*l);
+        if (j > 1 && convergence_factor > 0)
+        {
+            double nx = 0, nu = 0;
+            for (i = 0; i < N; i++)
+            {
+                nx += fabs(x[i]);
+                nu += fabs(u[i]);
+            }
+            if (nu > nx * convergence_factor)
+                for (i = 0; i < N; i++)
+                    u[i] *= convergence_factor * nx / nu;
+        }
+        for (i = 0; i < N; i++)
+            x[i] += u[i];
+        sparsify(x, N, l);
+    }
+    free(c);
+    free(u);
+}
+
+void test_smp(int N, int M, int D, int K, int T, double convergence_factor, int explicit)
+{
+    sketch_matrix_t m;
+    double *x, *b, *ref, *result, *vals, err = 0, signal_err = 0;
+    size_t *idx, num, k;
+    int i;
+
+    printf("Running SMP test N=%d M=%d D=%d K=%d T=%d cf=%g %s\n", N, M, D, K, T,
+           convergence_factor, explicit ? "explicit" : "implicit");
+
+    gen_matrix(&m, N, M, D, explicit);
+    x = (double *) calloc(N, sizeof(double));
+    ref = (double *) calloc(N, sizeof(double));
+    result = (double *) calloc(N, sizeof(double));
+    b = (double *) calloc(M, sizeof(double));
+    idx = (size_t *) calloc(K, sizeof(size_t));
+    vals = (double *) calloc(K, sizeof(double));
+    for (i = 0; i < K; i++)
+        x[rand() % N] = rand() % 21 - 10;
+    SketchMatrixMul(&m, x, b);
+
+    smp_reference(&m, b, K, T, convergence_factor, ref);
+    if (!SMPRun(&m, b, K, T, convergence_factor, 0, &num, idx, vals, NULL, NULL))
+        printf("SMPRun failed\n");
+    for (k = 0; k < num; k++)
+    {
+        if (k > 0 && idx[k] <= idx[k-1])
+            printf("Indices not increasing\n");
+        result[idx[k]] = vals[k];
+    }
+    for (i = 0; i < N; i++)
+    {
+        err += fabs(result[i] - ref[i]);
+        signal_err += fabs(result[i] - x[i]);
+    }
+    /* With integer signals and no convergence control all the values are
+     * exact, so the result must be the same as that of the dense loop. (With
+     * scaling, the residual updated incrementally is rounded differently than
+     * a recomputed one, which can change ties.) */
+    if (num > (size_t) K)
+        printf("Result has %d > K entries\n", (int) num);
+    if (convergence_factor == 0 && err > 0)
+        printf("Differs from the dense loop: L1 difference %lg\n", err);
+    if (convergence_factor == 0 && signal_err > 1e-9)
+        printf("Recovery failed, L1 error %lg\n", signal_err);
+
+    /* With a tolerance, stops once x does not change any more */
+    memset(result, 0, N * sizeof(double));
+    SMPRun(&m, b, K, 1000, convergence_factor, 1e-12, &num, idx, vals, NULL, NULL);
+    for (k = 0; k < num; k++)
+        result[idx[k]] = vals[k];
+    for (i = 0, err = 0; i < N; i++)
+        err += fabs(result[i] - ref[i]);
+    if (convergence_factor == 0 && err > 1e-9)
+        printf("Early stopping result differs, L1 difference %lg\n", err);
+
+    SketchMatrixDestroy(&m);
+    free(x); free(ref); free(result); free(b); free(idx); free(vals);
+}
+
+int main()
+{
+    test_smp(10000, 2000, 8, 50, 10, 0, 0);
+    test_smp(10000, 2000, 8, 50, 10, 0, 1);
+    test_smp(10000, 1200, 8, 100, 10, 0.5, 0);
+    test_smp(10000, 1200, 7, 100, 10, 0.5, 1);
+    test_smp(1000, 400, 4, 1, 3, 0, 1);
+
+    printf("Tests complete\n");
+
+    return 0;
+}
@@ -28,12 +28,67 @@ void check_result(double *A, double *B, int N, int k)
             printf("A[%d] should be 0, is %d\n", i, A[i]);
 }
 
+/*
+ * Checks that the pairs from SparsifyTopK are the nonzeros of C, the
+ * sparsify() result for the same k
+ */
+void check_top_k(double *A, double *C, int N, int k, double *work)
+{
+    size_t *idx = (size_t *) malloc((k + 1) * sizeof(size_t));
+    double *vals = (double *) malloc((k + 1) * sizeof(double));
+    size_t count, i, j = 0;
+
+    count = SparsifyTopK(A, N, k, work, idx, vals);
+    for (i = 0; i < (size_t) N; i++)
+        if (C[i] != 0)
+        {
+            if (j >= count || idx[j] != i || vals[j] != C[i])
+            {
+                printf("SparsifyTopK failed: k=%d, i=%d\n", k, (int) i);
+                break;
+            }
+            j++;
+        }
+    if (j != count)
+        printf("SparsifyTopK failed: k=%d, %d entries instead of %d\n", k, (int) count, (int) j);
+
+    free(idx);
+    free(vals);
+}
+
+/* The float and int32 versions must zero out the same entries (A holds
+ * integers) */
+void check_value_types(double *A, double *C, int N, int k, double *work)
+{
+    float *F = (float *) malloc(N * sizeof(float));
+    float *fwork = (float *) malloc(N * sizeof(float));
+    int *I = (int *) malloc(N * sizeof(int));
+    int i, errors = 0;
+
+    for (i = 0; i < N; i++)
+    {
+        F[i] = (float) A[i];
+        I[i] = (int) A[i];
+    }
+    SparsifyInPlaceFloat(F, N, k, fwork);
+    SparsifyInPlaceInt32(I, N, k, work);
+    for (i = 0; i < N; i++)
+        errors += (F[i] != C[i]) + (I[i] != C[i]);
+    if (errors)
+        printf("Error: float/int32 sparsify differs for N=%d, k=%d\n", N, k);
+
+    free(F);
+    free(fwork);
+    free(I);
+}
+
 void test(double *A, int N)
 {
-    double *B, *C;
+    double *B, *C, *work;
     int k;
     B = (double *) malloc(N * sizeof(double));
     C = (double *) malloc(N * sizeof(double));
+    work = (double *) malloc(N * sizeof(double));
 
     memcpy(B, A, N * sizeof(double));
     qsort(B, N, sizeof(double), compare_abs);
@@ -42,11 +97,14 @@ void test(double *A, int N)
     {
         memcpy(C, A, N * sizeof(double));
         sparsify(C, N, k);
+        check_top_k(A, C, N, k, work);
+        check_value_types(A, C, N, k, work);
         check_result(C, B, N, k);
     }
 
     free(B);
     free(C);
+    free(work);
 }
 
 void gen_random(double *A, int N, int delta)
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../ssmp.h"
+#include "fixtures.h"
+
+/* K-sparse signal with +1/-1 peaks */
+void gen_signal(double *x, int N, int K)
+{
+    int i;
+    memset(x, 0, N * sizeof(double));
+    for (i = 0; i < K; i++)
+        x[rand() % N] = (rand() % 2) ? 1 : -1;
+}
+
+void sketch(const unsigned int *neighbors, int N, int M, int D, const double *x, double *y)
+{
+    int i, j;
+    memset(y, 0, M * sizeof(double));
+    for (i = 0; i < N; i++)
+        for (j = 0; j < D; j++)
+            y[neighbors[i + N*j] - 1] += x[i];
+}
+
+double l1_error(const double *a, const double *b, int N)
+{
+    int i;
+    double err = 0;
+    for (i = 0; i < N; i++)
+        err += fabs(a[i] - b[i]);
+    return err;
+}
+
+void test_recovery(int N, int M, int D, int K, int batch)
+{
+    unsigned int *neighbors;
+    double *x, *y;
+    bipartite_graph_t graph;
+    ssmp_t decoder;
+
+    printf("Running recovery test N=%d M=%d D=%d K=%d batch=%d\n", N, M, D, K, batch);
+
+    neighbors = gen_neighbors(N, M, D, 1);
+    x = (double *) malloc(N * sizeof(double));
+    y = (double *) malloc(M * sizeof(double));
+    gen_signal(x, N, K);
+    sketch(neighbors, N, M, D, x, y);
+
+    GraphBuild(&graph, N, M, D, neighbors, 1);
+    if (!SSMPCreate(&decoder, &graph))
+        printf("SSMPCreate failed\n");
+    SSMPRunBatched(&decoder, y, 2*K, 10, K, batch, NULL, NULL);
+    if (l1_error(decoder.X, x, N) > 1e-6)
+        printf("Recovery failed, L1 error %lg\n", l1_error(decoder.X, x, N));
+    SSMPDestroy(&decoder);
+    GraphDestroy(&graph);
+
+    free(neighbors);
+    free(x);
+    free(y);
+}
+
+/* Two decoders stepped alternately must give the same results as when run
+ * one after the other */
+void test_reentrant(int N, int M, int D, int K)
+{
+    unsigned int *neighbors;
+    double *x1, *x2, *y1, *y2, *r1, *r2;
+    bipartite_graph_t graph;
+    ssmp_t d1, d2;
+    int step;
+
+    printf("Running reentrancy test N=%d M=%d D=%d K=%d\n", N, M, D, K);
+
+    neighbors = gen_neighbors(N, M, D, 1);
+    x1 = (double *) malloc(N * sizeof(double));
+    x2 = (double *) malloc(N * sizeof(double));
+    r1 = (double *) malloc(N * sizeof(double));
+    r2 = (double *) malloc(N * sizeof(double));
+    y1 = (double *) malloc(M * sizeof(double));
+    y2 = (double *) malloc(M * sizeof(double));
+    gen_signal(x1, N, K);
+    gen_signal(x2, N, K);
+    sketch(neighbors, N, M, D, x1, y1);
+    sketch(neighbors, N, M, D, x2, y2);
+
+    GraphBuild(&graph, N, M, D, neighbors, 1);
+    SSMPCreate(&d1, &graph);
+    SSMPRun(&d1, y1, K, 1, 0, NULL, NULL);
+    memcpy(r1, d1.X, N * sizeof(double));
+    SSMPRun(&d1, y2, K, 1, 0, NULL, NULL);
+    memcpy(r2, d1.X, N * sizeof(double));
+    SSMPDestroy(&d1);
+
+    SSMPCreate(&d1, &graph);
+    SSMPCreate(&d2, &graph);
+    SSMPSetSketch(&d1, y1);
+    SSMPSetSketch(&d2, y2);
+    for (step = 0; step < K; step++)
+    {
+        SSMPStep(&d1);
+        SSMPStep(&d2);
+    }
+    if (l1_error(d1.X, r1, N) > 1e-9 || l1_error(d2.X, r2, N) > 1e-9)
+        printf("Interleaved decoders differ from sequential ones\n");
+    SSMPDestroy(&d1);
+    SSMPDestroy(&d2);
+    GraphDestroy(&graph);
+
+    free(neighbors);
+    free(x1); free(x2); free(r1); free(r2); free(y1); free(y2);
+}
+
+/* After every step, the heap value of each column must be the median of its
+ * bucket values computed from scratch. Repeated neighbors are allowed. */
+void test_incremental(int N, int M, int D, int K, int repeats, int batch)
+{
+    unsigned int *neighbors;
+    double *x, *y;
+    bipartite_graph_t graph;
+    ssmp_t decoder;
+    int i, step, errors = 0;
+
+    printf("Running incremental median test N=%d M=%d D=%d K=%d batch=%d%s\n", N, M, D, K,
+           batch, repeats ? " (repeated neighbors)" : "");
+
+    neighbors = gen_neighbors(N, M, D, 1);
+    if (repeats)
+        for (i = 0; i < N; i++)
+            if (rand() % 2)
+                neighbors[i + N*(D-1)] = neighbors[i];
+    x = (double *) malloc(N * sizeof(double));
+    y = (double *) malloc(M * sizeof(double));
+    gen_signal(x, N, K);
+    sketch(neighbors, N, M, D, x, y);
+
+    GraphBuild(&graph, N, M, D, neighbors, 1);
+    SSMPCreate(&decoder, &graph);
+    SSMPSetSketch(&decoder, y);
+    for (step = 0; step < 4*K && !errors; step++)
+    {
+        if (batch > 1)
+            SSMPBatchStep(&decoder, batch);
+        else
+            SSMPStep(&decoder);
+        for (i = 1; i <= N; i++)
+        {
+            double value = 0;
+            DHeapGetValue(&decoder.uheap, i, &value);
+            if (value != SSMPComputeMedian(&decoder, i))
+                errors++;
+        }
+    }
+    if (errors)
+        printf("Heap values differ from the medians after step %d\n", step);
+    SSMPDestroy(&decoder);
+    GraphDestroy(&graph);
+
+    free(neighbors);
+    free(x);
+    free(y);
+}
+
+int main()
+{
+    test_recovery(1000, 200, 8, 10, 1);
+    test_recovery(10000, 2000, 8, 40, 1);
+    test_recovery(10000, 2000, 8, 40, 8);
+    test_recovery(100000, 20000, 8, 1000, 256);
+    test_reentrant(1000, 200, 8, 10);
+    test_incremental(1000, 200, 8, 10, 0, 1);
+    test_incremental(1000, 200, 9, 10, 1, 1);
+    test_incremental(200, 100, 40, 5, 1, 1);
+    test_incremental(10000, 2000, 8, 100, 0, 64);
+    test_incremental(10000, 2000, 9, 100, 1, 300);
+
+    printf("Tests complete\n");
+
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../stream.h"
+#include "fixtures.h"
+
+int count_differences(const double *a, const double *b, int n)
+{
+    int i, diff = 0;
+    for (i = 0; i < n; i++)
+        diff += (a[i] != b[i]);
+    return diff;
+}
+
+/*
+ * Streams U integer updates in batches (serially and with all the threads)
+ * and compares the snapshot with the batch multiply of the accumulated x.
+ */
+void test_updates(int N, int M, int D, int explicit, int U, int shards)
+{
+    sketch_matrix_t m;
+    sketch_stream_t s;
+    size_t *idx = (size_t *) malloc(U * sizeof(size_t));
+    double *deltas = (double *) malloc(U * sizeof(double));
+    double *x = (double *) calloc(N, sizeof(double));
+    double *y = (double *) malloc(M * sizeof(double));
+    double *expected = (double *) malloc(M * sizeof(double));
+    int k, batch = 100;
+
+    printf("Running update test N=%d M=%d D=%d explicit=%d shards=%d\n",
+           N, M, D, explicit, shards);
+
+    gen_matrix(&m, N, M, D, explicit);
+    if (!SketchStreamCreate(&s, &m, shards))
+        printf("SketchStreamCreate failed\n");
+
+    for (k = 0; k < U; k++)
+    {
+        idx[k] = rand() % N;
+        deltas[k] = rand() % 21 - 10;
+        x[idx[k]] += deltas[k];
+    }
+    for (k = 0; k < U / 2; k += batch)
+        SketchStreamUpdate(&s, k / batch % s.num_shards,
+                           (k + batch < U / 2) ? batch : U / 2 - k, idx + k, deltas + k);
+    SketchStreamUpdateParallel(&s, U - U / 2, idx + U / 2, deltas + U / 2);
+
+    SketchStreamSnapshot(&s, y);
+    SketchMatrixMul(&m, x, expected);
+    if (count_differences(y, expected, M))
+        printf("Error: %d sketch entries differ from the batch multiply\n",
+               count_differences(y, expected, M));
+
+    SketchStreamReset(&s);
+    SketchStreamSnapshot(&s, y);
+    memset(expected, 0, M * sizeof(double));
+    if (count_differences(y, expected, M))
+        printf("Error: the sketch is not zero after a reset\n");
+
+    SketchStreamDestroy(&s);
+    SketchMatrixDestroy(&m);
+    free(idx);
+    free(deltas);
+    free(x);
+    free(y);
+    free(expected);
+}
+
+/*
+ * Writers add batches that cancel out (+d and -d on the same column) while
+ * the master thread takes snapshots; every snapshot must be the sketch of
+ * the initial signal.
+ */
+void test_concurrent(int N, int M, int D, int rounds)
+{
+    sketch_matrix_t m;
+    sketch_stream_t s;
+    double *base = (double *) malloc(M * sizeof(double));
+    double *y = (double *) malloc(M * sizeof(double));
+    size_t idx0[200];
+    double deltas0[200];
+    int k, bad = 0;
+
+    printf("Running concurrent test N=%d M=%d D=%d\n", N, M, D);
+
+    gen_matrix(&m, N, M, D, 0);
+    if (!SketchStreamCreate(&s, &m, 0))
+        printf("SketchStreamCreate failed\n");
+    for (k = 0; k < 200; k++)
+    {
+        idx0[k] = rand() % N;
+        deltas0[k] = rand() % 7 - 3;
+    }
+    SketchStreamUpdate(&s, 0, 200, idx0, deltas0);
+    SketchStreamSnapshot(&s, base);
+
+#pragma omp parallel private(k) reduction(+:bad)
+    {
+        unsigned int seed = ParallelThreadNum() + 1;
+        size_t idx[64];
+        double deltas[64];
+        int r, j;
+
+        for (r = 0; r < rounds; r++)
+        {
+            if (ParallelThreadNum() == 0 && r % 10 == 0)
+            {
+                SketchStreamSnapshot(&s, y);
+                bad += count_differences(y, base, M) > 0;
+            }
+            for (j = 0; j < 64; j += 2)
+            {
+                idx[j] = idx[j+1] = SelectIndex(&seed, N);
+                deltas[j] = 1 + (int) SelectIndex(&seed, 1000);
+                deltas[j+1] = -deltas[j];
+            }
+            SketchStreamUpdate(&s, SketchStreamShard(&s), 64, idx, deltas);
+        }
+    }
+
+    SketchStreamSnapshot(&s, y);
+    bad += count_differences(y, base, M) > 0;
+    if (bad)
+        printf("Error: %d inconsistent snapshots\n", bad);
+
+    SketchStreamDestroy(&s);
+    SketchMatrixDestroy(&m);
+    free(base);
+    free(y);
+}
+
+int main()
+{
+    test_updates(1000, 200, 5, 0, 5000, 1);
+    test_updates(1000, 200, 5, 1, 5000, 3);
+    test_updates(100000, 4000, 8, 0, 200000, 0);
+    test_updates(100000, 4000, 8, 1, 200000, 0);
+    test_concurrent(100000, 4000, 8, 2000);
+
+    printf("Tests complete\n");
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * Helpers for reading and writing raw binary arrays (as produced by Matlab's
+ * fwrite, e.g. fwrite(f, neighbors, 'uint32') or fwrite(f, y, 'double')).
+ */
+
+#ifndef BINIO_H
+#define BINIO_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* 64-bit file positions, so that files over 2 GB can be read on Windows */
+#ifdef _WIN32
+#define BinaryFileSeek(f, offset, whence) _fseeki64(f, (long long) (offset), whence)
+#define BinaryFileTell(f) ((long long) _ftelli64(f))
+#else
+#define BinaryFileSeek(f, offset, whence) fseeko(f, (off_t) (offset), whence)
+#define BinaryFileTell(f) ((long long) ftello(f))
+#endif
+
+/*
+ * Reads the whole file into a newly allocated buffer; the number of elements
+ * of size elem_size is stored in *count. Returns NULL on failure or if the
+ * file size is not a multiple of elem_size.
+ */
+void *ReadBinaryFile(const char *path, size_t elem_size, size_t *count)
+{
+    FILE *f;
+    long long size;
+    void *data;
+
+    f = fopen(path, "rb");
+    if (!f)
+    {
+        fprintf(stderr, "Could not open %s\n", path);
+        return NULL;
+    }
+    BinaryFileSeek(f, 0, SEEK_END);
+    size = BinaryFileTell(f);
+    BinaryFileSeek(f, 0, SEEK_SET);
+
+    if (size < 0 || (size_t) size != (unsigned long long) size)
+    {
+        fprintf(stderr, "Could not get the size of %s, or it does not fit in memory\n", path);
+        fclose(f);
+        return NULL;
+    }
+    if ((size_t) size % elem_size != 0)
+    {
+        fprintf(stderr, "%s: size is not a multiple of %d bytes\n", path, (int) elem_size);
+        fclose(f);
+        return NULL;
+    }
+
+    *count = (size_t) size / elem_size;
+    data = malloc(size > 0 ? (size_t) size : 1);
+    if (!data || fread(data, elem_size, *count, f) != *count)
+    {
+        fprintf(stderr, "Could not read %s\n", path);
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+/* Writes count elements of size elem_size to a file. Returns 0 on failure. */
+int WriteBinaryFile(const char *path, const void *data, size_t elem_size, size_t count)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+    {
+        fprintf(stderr, "Could not open %s for writing\n", path);
+        return 0;
+    }
+    if (fwrite(data, elem_size, count, f) != count)
+    {
+        fprintf(stderr, "Could not write %s\n", path);
+        fclose(f);
+        return 0;
+    }
+    return fclose(f) == 0;
+}
+
+#endif  /* BINIO_H */
@@ -0,0 +1,53 @@
+/*
+ * Builds a graph file (see graphfile.h) from a neighbors matrix, out of core.
+ *
+ * Usage: graph_build N M D neighbors.bin out.graph [memory_mb]
+ *
+ *   neighbors.bin holds the N by D neighbors matrix as uint32 values in
+ *   column-major order (fwrite(f, matrix.neighbors, 'uint32') in Matlab).
+ *   The graph is built with about memory_mb megabytes (default 1024) besides
+ *   two arrays of M offsets, so it does not need to fit in memory; with less
+ *   memory the right adjacency takes more passes over the file. out.graph can
+ *   then be mapped by ssmp_decode, matrix_handle('map', ...),
+ *   binsparsemul and median_recovery_explicit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../graphfile.h"
+
+char* usage =
+"Usage: graph_build N M D neighbors.bin out.graph [memory_mb]\n";
+
+int main(int argc, char *argv[])
+{
+    sketch_index_t N;
+    int M, D;
+    size_t memory_mb = 1024;
+
+    if (argc != 6 && argc != 7)
+    {
+        fprintf(stderr, "%s", usage);
+        return 1;
+    }
+
+    N = (sketch_index_t) atoll(argv[1]);
+    M = atoi(argv[2]);
+    D = atoi(argv[3]);
+    if (argc == 7)
+        memory_mb = (size_t) atoll(argv[6]);
+
+    if (N <= 0 || M <= 0 || D <= 0 || memory_mb == 0)
+    {
+        fprintf(stderr, "N, M, D and memory_mb should be positive.\n");
+        return 1;
+    }
+
+    if (!GraphFileBuild(argv[5], argv[4], N, M, D, memory_mb << 20))
+    {
+        fprintf(stderr, "Could not build the graph: %s must hold N*D uint32 values between 1 and M, "
+                "and %s must be writable.\n", argv[4], argv[5]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,686 @@
+/*
+ * Native microbenchmarks of the Util kernels (no Matlab needed), so that a
+ * kernel regression can be told apart from run-to-run noise.
+ *
+ * Usage: kernel_bench [out.csv [kernels [max_N [D]]]]
+ *        kernel_bench -compare base.csv new.csv [threshold]
+ *
+ *   The first form times each kernel on the grid of benchmark.m:
+ *   N = round(logspace(3, 6, 10)), K = round(0.002*N), M = round(0.10*N),
+ *   with D = 10 (countmin10) by default. kernels is "all" (the default) or a
+ *   comma-separated list of the names below; N above max_N is skipped.
+ *       binsparsemul            y = A*x (GraphMul, right adjacency)
+ *       binsparsemul_transpose  x = A'*y (GraphMulTranspose, left adjacency)
+ *       countmin_mul            y = A*x of the implicit countmin_twowise matrix
+ *       countmin_mul_transpose  x = A'*y of the same matrix
+ *       median_explicit         median recovery with the explicit matrix
+ *       median_implicit         median recovery with the implicit matrix
+ *       fasterwalsh             ordered FWHT of the next power of 2 >= N
+ *       sparsify                SparsifyInPlace to the K largest entries
+ *       randomized_select       selection of the median of N values
+ *       minheap                 MinHeapBuild of N values, then N changes
+ *       dheap                   DHeapBuild of N values, then N changes
+ *       ssmp_step               K steps of SSMP on a K-sparse signal
+ *   The explicit and implicit matrices have the same neighbors.
+ *
+ *   Each kernel is run in BENCH_SAMPLES samples of enough calls to take
+ *   BENCH_MIN_TIME seconds (inputs are restored between the calls, outside
+ *   the timed region). For each kernel and N a line gives the median time
+ *   per call, the minimum and the spread (interquartile range of the samples
+ *   over the median), elements per second (columns; FWHT values; heap
+ *   operations; SSMP steps), GB/s and cycles per element. GB/s counts the
+ *   compulsory traffic: each index and input array read once, each output
+ *   written once and 8 bytes per gathered or scattered edge (nan for the
+ *   heaps and SSMP). The cycles are those of the time stamp counter, which
+ *   runs at the nominal frequency (nan where there is none). out.csv ("-"
+ *   for none) gets the same values, one line per kernel and N.
+ *
+ *   The second form compares two such files: a kernel is reported slower or
+ *   faster when the ratio of the median times is beyond threshold (default
+ *   0.05) plus the spreads of both runs. The exit status is 2 if any kernel
+ *   got slower.
+ *
+ *   Set OMP_NUM_THREADS to choose the number of threads; it is recorded in
+ *   the output.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "../ssmp.h"
+#include "../countmin.h"
+#include "../fwht.h"
+#include "../minheap.h"
+#include "../randomized_select.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define BENCH_HAS_TSC 1
+#define BenchTicks() ((double) __rdtsc())
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define BENCH_HAS_TSC 1
+#define BenchTicks() ((double) __rdtsc())
+#else
+#define BENCH_HAS_TSC 0
+#define BenchTicks() 0.0
+#endif
+
+/* Samples per kernel and N */
+#ifndef BENCH_SAMPLES
+#define BENCH_SAMPLES 7
+#endif
+
+/* Timed seconds per sample */
+#ifndef BENCH_MIN_TIME
+#define BENCH_MIN_TIME 0.02
+#endif
+
+/* Largest number of calls per sample */
+#define BENCH_MAX_CALLS 100000
+
+/* Size of the benchmark.m grid */
+#define BENCH_GRID 10
+
+char* usage =
+"Usage: kernel_bench [out.csv [kernels [max_N [D]]]]\n"
+"       kernel_bench -compare base.csv new.csv [threshold]\n";
+
+double BenchSeconds(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double) counter.QuadPart / frequency.QuadPart;
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+#endif
+}
+
+
+/* The inputs of all the kernels for one point of the grid */
+typedef struct bench_data_t
+{
+    sketch_index_t N;
+    int M, D, K;
+
+    bipartite_graph_t graph;
+    countmin_hash_t hash;
+    ssmp_t decoder;
+    heap_t minheap;
+    dheap_t dheap;
+
+    /* Random signal and sketch, and the outputs */
+    double *x, *y, *out_x, *out_y;
+    /* Sketch of a K-sparse signal, for SSMP */
+    double *sparse_y;
+    /* Input of the in-place kernels (restored before each call), and scratch */
+    double *values, *work;
+    int fwht_N;
+    double *fwht_data, *fwht_x;
+    /* Heap updates: values[1..N] for the builds, then N changes */
+    double *heap_values;
+    dheap_update_t *updates;
+    parallel_progress_t quiet;
+} bench_data_t;
+
+typedef struct bench_kernel_t
+{
+    const char *name;
+    /* Untimed preparation of a call (may be NULL), and the call */
+    void (*reset)(bench_data_t *d);
+    void (*run)(bench_data_t *d);
+    /* Elements processed and compulsory bytes per call (0: unknown) */
+    double (*elements)(const bench_data_t *d);
+    double (*bytes)(const bench_data_t *d);
+} bench_kernel_t;
+
+
+void RunGraphMul(bench_data_t *d)
+{
+    GraphMul(&d->graph, d->x, d->out_y);
+}
+
+void RunGraphMulTranspose(bench_data_t *d)
+{
+    GraphMulTranspose(&d->graph, d->y, d->out_x);
+}
+
+void RunCountMinMul(bench_data_t *d)
+{
+    CountMinMul(&d->hash, d->x, d->out_y);
+}
+
+void RunCountMinMulTranspose(bench_data_t *d)
+{
+    CountMinMulTranspose(&d->hash, d->y, d->out_x);
+}
+
+void RunGraphMedian(bench_data_t *d)
+{
+    GraphMedianRecoveryColumns(&d->graph, d->y, d->out_x, 0, d->N, &d->quiet);
+}
+
+void RunCountMinMedian(bench_data_t *d)
+{
+    CountMinMedianRecoveryColumns(&d->hash, d->y, d->out_x, 0, d->N, &d->quiet);
+}
+
+void RunFWHT(bench_data_t *d)
+{
+    FWHT(d->fwht_data, d->fwht_N, d->fwht_x);
+}
+
+void ResetValues(bench_data_t *d)
+{
+    memcpy(d->values, d->x, d->N * sizeof(double));
+}
+
+void RunSparsify(bench_data_t *d)
+{
+    SparsifyInPlace(d->values, d->N, d->K, d->work);
+}
+
+void RunSelect(bench_data_t *d)
+{
+    randomized_select(d->values, d->N, (d->N + 1) / 2);
+}
+
+void RunMinHeap(bench_data_t *d)
+{
+    sketch_index_t t;
+    MinHeapBuild(&d->minheap, d->N, d->heap_values);
+    for (t = 0; t < d->N; t++)
+        MinHeapChangeValue(&d->minheap, d->updates[t].index, d->updates[t].value);
+}
+
+void RunDHeap(bench_data_t *d)
+{
+    DHeapBuild(&d->dheap, d->N, d->heap_values);
+    DHeapChangeValues(&d->dheap, d->N, d->updates);
+}
+
+void ResetSSMP(bench_data_t *d)
+{
+    SSMPSetSketch(&d->decoder, d->sparse_y);
+}
+
+void RunSSMP(bench_data_t *d)
+{
+    int k;
+    for (k = 0; k < d->K; k++)
+        SSMPStep(&d->decoder);
+}
+
+
+double Columns(const bench_data_t *d)
+{
+    return (double) d->N;
+}
+
+double FWHTValues(const bench_data_t *d)
+{
+    return (double) d->fwht_N;
+}
+
+double Steps(const bench_data_t *d)
+{
+    return (double) d->K;
+}
+
+double Unknown(const bench_data_t *d)
+{
+    (void) d;
+    return 0;
+}
+
+/* Edges of the graph */
+#define BenchEdges(d) ((double) (d)->N * (d)->D)
+
+double GraphMulBytes(const bench_data_t *d)
+{
+    return BenchEdges(d) * (sizeof(sketch_column_t) + 8) +
+           (d->M + 1.0) * sizeof(sketch_offset_t) + d->M * 8.0;
+}
+
+double GraphLeftBytes(const bench_data_t *d)
+{
+    return BenchEdges(d) * (sizeof(sketch_bucket_t) + 8) + d->N * 8.0;
+}
+
+double CountMinBytes(const bench_data_t *d)
+{
+    return BenchEdges(d) * 8 + d->N * 8.0;
+}
+
+double CountMinMulBytes(const bench_data_t *d)
+{
+    return BenchEdges(d) * 8 + d->N * 8.0 + d->M * 8.0;
+}
+
+double FWHTBytes(const bench_data_t *d)
+{
+    return d->fwht_N * 16.0;
+}
+
+double SparsifyBytes(const bench_data_t *d)
+{
+    return d->N * 16.0;
+}
+
+double SelectBytes(const bench_data_t *d)
+{
+    return d->N * 8.0;
+}
+
+bench_kernel_t kernels[] =
+{
+    { "binsparsemul",           NULL,        RunGraphMul,             Columns,    GraphMulBytes },
+    { "binsparsemul_transpose", NULL,        RunGraphMulTranspose,    Columns,    GraphLeftBytes },
+    { "countmin_mul",           NULL,        RunCountMinMul,          Columns,    CountMinMulBytes },
+    { "countmin_mul_transpose", NULL,        RunCountMinMulTranspose, Columns,    CountMinBytes },
+    { "median_explicit",        NULL,        RunGraphMedian,          Columns,    GraphLeftBytes },
+    { "median_implicit",        NULL,        RunCountMinMedian,       Columns,    CountMinBytes },
+    { "fasterwalsh",            NULL,        RunFWHT,                 FWHTValues, FWHTBytes },
+    { "sparsify",               ResetValues, RunSparsify,             Columns,    SparsifyBytes },
+    { "randomized_select",      ResetValues, RunSelect,               Columns,    SelectBytes },
+    { "minheap",                NULL,        RunMinHeap,              Columns,    Unknown },
+    { "dheap",                  NULL,        RunDHeap,                Columns,    Unknown },
+    { "ssmp_step",              ResetSSMP,   RunSSMP,                 Steps,      Unknown },
+};
+
+#define NUM_KERNELS ((int) (sizeof(kernels) / sizeof(kernels[0])))
+
+
+int IsPrime(countmin_term_t p)
+{
+    countmin_term_t q;
+    for (q = 2; q * q <= p; q++)
+        if (p % q == 0)
+            return 0;
+    return p >= 2;
+}
+
+void BenchDestroy(bench_data_t *d)
+{
+    GraphDestroy(&d->graph);
+    CountMinDestroy(&d->hash);
+    SSMPDestroy(&d->decoder);
+    MinHeapDestroy(&d->minheap);
+    DHeapDestroy(&d->dheap);
+    free(d->x);
+    free(d->y);
+    free(d->out_x);
+    free(d->out_y);
+    free(d->sparse_y);
+    free(d->values);
+    free(d->work);
+    free(d->fwht_data);
+    free(d->fwht_x);
+    free(d->heap_values);
+    free(d->updates);
+}
+
+/*
+ * Generates the matrices and inputs for N, M, D, K (with the seed fixed, so
+ * that runs are comparable). The implicit matrix has B = M/D buckets per
+ * hash and primes in [2N, 4N), as countmin_twowise matrices; the explicit
+ * matrix has its neighbors. Returns 0 if the memory could not be allocated.
+ */
+int BenchCreate(bench_data_t *d, sketch_index_t N, int M, int D, int K)
+{
+    countmin_term_t *Ps, *As, *Bs;
+    unsigned int *neighbors, state = 1;
+    double *signal;
+    sketch_index_t i;
+    int j, ok;
+
+    memset(d, 0, sizeof(bench_data_t));
+    d->N = N;
+    d->M = M;
+    d->D = D;
+    d->K = K;
+    ParallelProgressInit(&d->quiet, 1LL << 62);
+
+    Ps = (countmin_term_t *) malloc(3 * D * sizeof(countmin_term_t));
+    As = Ps + D;
+    Bs = As + D;
+    for (j = 0; j < D; j++)
+    {
+        Ps[j] = 2 * (countmin_term_t) N + SelectIndex(&state, 2 * (size_t) N);
+        while (!IsPrime(Ps[j]))
+            Ps[j]++;
+        As[j] = 1 + SelectIndex(&state, (size_t) Ps[j] - 1);
+        Bs[j] = 1 + SelectIndex(&state, (size_t) Ps[j] - 1);
+    }
+    ok = CountMinCreate(&d->hash, N, M, D, M / D, Ps, As, Bs);
+    free(Ps);
+    if (!ok)
+        return 0;
+
+    neighbors = (unsigned int *) malloc((size_t) N * D * sizeof(unsigned int));
+    if (!neighbors)
+        return 0;
+    CountMinNeighbors(&d->hash, neighbors);
+    ok = GraphBuild(&d->graph, N, M, D, neighbors, 1);
+    free(neighbors);
+    if (!ok || !SSMPCreate(&d->decoder, &d->graph))
+        return 0;
+
+    for (d->fwht_N = 1; d->fwht_N < N; d->fwht_N *= 2)
+        ;
+    d->x = (double *) malloc(N * sizeof(double));
+    d->y = (double *) malloc(M * sizeof(double));
+    d->out_x = (double *) malloc(N * sizeof(double));
+    d->out_y = (double *) malloc(M * sizeof(double));
+    d->sparse_y = (double *) malloc(M * sizeof(double));
+    d->values = (double *) malloc(N * sizeof(double));
+    d->work = (double *) malloc((N + 1) * sizeof(double));
+    d->fwht_data = (double *) malloc(d->fwht_N * sizeof(double));
+    d->fwht_x = (double *) malloc(d->fwht_N * sizeof(double));
+    d->heap_values = (double *) malloc((N + 1) * sizeof(double));
+    d->updates = (dheap_update_t *) malloc(N * sizeof(dheap_update_t));
+    signal = (double *) calloc(N, sizeof(double));
+    MinHeapCreate(&d->minheap, N);
+    if (!d->x || !d->y || !d->out_x || !d->out_y || !d->sparse_y || !d->values ||
+        !d->work || !d->fwht_data || !d->fwht_x || !d->heap_values || !d->updates ||
+        !signal || !d->minheap.nodes || !d->minheap.position || !DHeapCreate(&d->dheap, N))
+    {
+        free(signal);
+        return 0;
+    }
+
+    for (i = 0; i < N; i++)
+        d->x[i] = SelectNext(&state) / 4294967296.0 - 0.5;
+    for (j = 0; j < M; j++)
+        d->y[j] = SelectNext(&state) / 4294967296.0 - 0.5;
+    for (j = 0; j < d->fwht_N; j++)
+        d->fwht_data[j] = SelectNext(&state) / 4294967296.0 - 0.5;
+    for (i = 1; i <= N; i++)
+        d->heap_values[i] = SelectNext(&state) / 4294967296.0;
+    for (i = 0; i < N; i++)
+    {
+        d->updates[i].index = 1 + (sketch_index_t) SelectIndex(&state, (size_t) N);
+        d->updates[i].value = SelectNext(&state) / 4294967296.0;
+    }
+
+    /* The plus_minus_one_peaks signal of benchmark.m */
+    for (j = 0; j < K; j++)
+        signal[SelectIndex(&state, (size_t) N)] = (SelectNext(&state) & 1) ? 1 : -1;
+    GraphMul(&d->graph, signal, d->sparse_y);
+    free(signal);
+    return 1;
+}
+
+
+int CompareDoubles(const void *a, const void *b)
+{
+    double u = *(const double *) a, v = *(const double *) b;
+    return (u > v) - (u < v);
+}
+
+/* Result of one kernel at one point of the grid */
+typedef struct bench_result_t
+{
+    long calls;
+    double median, min, spread, ticks;
+} bench_result_t;
+
+/*
+ * Times kernel k on d: one warm-up call, which also sets the number of calls
+ * per sample, then BENCH_SAMPLES samples. The ticks are those of the median
+ * sample.
+ */
+void BenchRun(const bench_kernel_t *k, bench_data_t *d, bench_result_t *r)
+{
+    double seconds[BENCH_SAMPLES], sorted[BENCH_SAMPLES], ticks[BENCH_SAMPLES];
+    double start, start_ticks, first;
+    long call;
+    int s;
+
+    if (k->reset)
+        k->reset(d);
+    start = BenchSeconds();
+    k->run(d);
+    first = BenchSeconds() - start;
+    r->calls = (first * BENCH_MAX_CALLS < BENCH_MIN_TIME) ? BENCH_MAX_CALLS :
+               (long) ceil(BENCH_MIN_TIME / (first > 0 ? first : 1e-9));
+
+    for (s = 0; s < BENCH_SAMPLES; s++)
+    {
+        seconds[s] = ticks[s] = 0;
+        for (call = 0; call < r->calls; call++)
+        {
+            if (k->reset)
+                k->reset(d);
+            start_ticks = BenchTicks();
+            start = BenchSeconds();
+            k->run(d);
+            seconds[s] += BenchSeconds() - start;
+            ticks[s] += BenchTicks() - start_ticks;
+        }
+        seconds[s] /= r->calls;
+        ticks[s] /= r->calls;
+        sorted[s] = seconds[s];
+    }
+
+    qsort(sorted, BENCH_SAMPLES, sizeof(double), CompareDoubles);
+    r->median = sorted[BENCH_SAMPLES / 2];
+    r->min = sorted[0];
+    r->spread = (sorted[(3 * BENCH_SAMPLES) / 4] - sorted[BENCH_SAMPLES / 4]) / r->median;
+    for (s = 0; s < BENCH_SAMPLES; s++)
+        if (seconds[s] == r->median)
+            r->ticks = ticks[s];
+}
+
+/* Returns 1 if kernel name is in the comma-separated list (or "all") */
+int Selected(const char *list, const char *name)
+{
+    size_t n = strlen(name);
+    const char *p;
+
+    if (!strcmp(list, "all"))
+        return 1;
+    for (p = list; (p = strstr(p, name)) != NULL; p += n)
+        if ((p == list || p[-1] == ',') && (p[n] == ',' || p[n] == '\0'))
+            return 1;
+    return 0;
+}
+
+int Benchmark(const char *out_path, const char *list, long long max_N, int D)
+{
+    FILE *out = NULL;
+    bench_data_t d;
+    bench_result_t r;
+    int g, k;
+
+    for (k = 0; k < NUM_KERNELS; k++)
+        if (Selected(list, kernels[k].name))
+            break;
+    if (k == NUM_KERNELS)
+    {
+        fprintf(stderr, "No kernel selected by %s.\n", list);
+        return 1;
+    }
+    if (strcmp(out_path, "-") && !(out = fopen(out_path, "w")))
+    {
+        fprintf(stderr, "Could not open %s.\n", out_path);
+        return 1;
+    }
+    if (out)
+        fprintf(out, "kernel,N,K,M,D,threads,calls,elements,bytes,median_s,min_s,spread,"
+                     "elements_per_s,gb_per_s,cycles_per_element\n");
+
+    printf("%d threads, %d samples of at least %g s per kernel%s\n", ParallelMaxThreads(),
+           BENCH_SAMPLES, BENCH_MIN_TIME, BENCH_HAS_TSC ? "" : ", no cycle counter");
+    printf("%-23s %8s %5s %6s %12s %7s %13s %8s %10s\n", "kernel", "N", "K", "M",
+           "median (s)", "spread", "elements/s", "GB/s", "cycles/el");
+
+    for (g = 0; g < BENCH_GRID; g++)
+    {
+        /* round(logspace(3, 6, 10)) and the K, M of benchmark.m */
+        long long N = (long long) floor(pow(10.0, 3 + g / 3.0) + 0.5);
+        int K = (int) floor(N * 0.002 + 0.5), M = (int) floor(N * 0.10 + 0.5);
+
+        if (N > max_N)
+            break;
+        if (M < D || (sketch_index_t) N != N)
+        {
+            fprintf(stderr, "Skipping N=%lld: M is below D, or N too large for this build.\n", N);
+            continue;
+        }
+        if (!BenchCreate(&d, (sketch_index_t) N, M, D, K))
+        {
+            fprintf(stderr, "Out of memory for N=%lld.\n", N);
+            BenchDestroy(&d);
+            break;
+        }
+
+        for (k = 0; k < NUM_KERNELS; k++)
+        {
+            const bench_kernel_t *kernel = &kernels[k];
+            double elements = kernel->elements(&d), bytes = kernel->bytes(&d);
+            double gb, cycles;
+
+            if (!Selected(list, kernel->name) || elements == 0)
+                continue;
+            BenchRun(kernel, &d, &r);
+            gb = bytes > 0 ? bytes / r.median / 1e9 : NAN;
+            cycles = BENCH_HAS_TSC ? r.ticks / elements : NAN;
+
+            printf("%-23s %8lld %5d %6d %12.4e %6.1f%% %13.4e %8.2f %10.2f\n", kernel->name,
+                   N, K, M, r.median, 100 * r.spread, elements / r.median, gb, cycles);
+            if (out)
+                fprintf(out, "%s,%lld,%d,%d,%d,%d,%ld,%.0f,%.0f,%.6e,%.6e,%.4f,%.6e,%.4f,%.4f\n",
+                        kernel->name, N, K, M, D, ParallelMaxThreads(), r.calls, elements,
+                        bytes, r.median, r.min, r.spread, elements / r.median, gb, cycles);
+            fflush(stdout);
+        }
+        BenchDestroy(&d);
+    }
+
+    if (out && fclose(out))
+    {
+        fprintf(stderr, "Could not write %s.\n", out_path);
+        return 1;
+    }
+    return 0;
+}
+
+
+/* One line of a results file */
+typedef struct bench_line_t
+{
+    char kernel[64];
+    long long N;
+    double median, spread;
+} bench_line_t;
+
+/* Reads the kernel, N, median and spread of each line of a results file.
+ * Returns the number of lines, or -1 if the file could not be read. */
+int ReadResults(const char *path, bench_line_t **lines)
+{
+    FILE *f = fopen(path, "r");
+    char buffer[1024], *field;
+    int num = 0, capacity = 64, column;
+
+    if (!f)
+    {
+        fprintf(stderr, "Could not open %s.\n", path);
+        return -1;
+    }
+    *lines = (bench_line_t *) malloc(capacity * sizeof(bench_line_t));
+    while (fgets(buffer, sizeof(buffer), f))
+    {
+        bench_line_t *l;
+        if (!strncmp(buffer, "kernel,", 7))
+            continue;
+        if (num == capacity)
+        {
+            capacity *= 2;
+            *lines = (bench_line_t *) realloc(*lines, capacity * sizeof(bench_line_t));
+        }
+        l = &(*lines)[num];
+        for (column = 0, field = strtok(buffer, ",\n"); field;
+             column++, field = strtok(NULL, ",\n"))
+            if (column == 0)
+            {
+                strncpy(l->kernel, field, sizeof(l->kernel) - 1);
+                l->kernel[sizeof(l->kernel) - 1] = '\0';
+            }
+            else if (column == 1)
+                l->N = atoll(field);
+            else if (column == 9)
+                l->median = atof(field);
+            else if (column == 11)
+                l->spread = atof(field);
+        if (column >= 15)
+            num++;
+    }
+    fclose(f);
+    return num;
+}
+
+int Compare(const char *base_path, const char *new_path, double threshold)
+{
+    bench_line_t *base, *current;
+    int num_base, num_current, i, j, slower = 0;
+
+    if ((num_base = ReadResults(base_path, &base)) < 0)
+        return 1;
+    if ((num_current = ReadResults(new_path, &current)) < 0)
+        return 1;
+
+    printf("%-23s %8s %12s %12s %8s %8s\n", "kernel", "N", "base (s)", "new (s)", "ratio",
+           "noise");
+    for (j = 0; j < num_current; j++)
+        for (i = 0; i < num_base; i++)
+            if (!strcmp(base[i].kernel, current[j].kernel) && base[i].N == current[j].N)
+            {
+                double ratio = current[j].median / base[i].median;
+                double limit = 1 + threshold + base[i].spread + current[j].spread;
+                const char *verdict = (ratio > limit) ? "slower" :
+                                      (ratio * limit < 1) ? "faster" : "";
+                printf("%-23s %8lld %12.4e %12.4e %8.3f %7.1f%% %s\n", current[j].kernel,
+                       current[j].N, base[i].median, current[j].median, ratio,
+                       100 * (limit - 1), verdict);
+                if (ratio > limit)
+                    slower++;
+                break;
+            }
+
+    printf("%d slower\n", slower);
+    free(base);
+    free(current);
+    return slower ? 2 : 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    if (argc >= 2 && !strcmp(argv[1], "-compare"))
+    {
+        if (argc != 4 && argc != 5)
+        {
+            fprintf(stderr, "%s", usage);
+            return 1;
+        }
+        return Compare(argv[2], argv[3], argc == 5 ? atof(argv[4]) : 0.05);
+    }
+    if (argc > 5 || (argc >= 2 && argv[1][0] == '-' && argv[1][1] != '\0'))
+    {
+        fprintf(stderr, "%s", usage);
+        return 1;
+    }
+    return Benchmark(argc >= 2 ? argv[1] : "-", argc >= 3 ? argv[2] : "all",
+                     argc >= 4 ? atoll(argv[3]) : 1000000, argc >= 5 ? atoi(argv[4]) : 10);
+}
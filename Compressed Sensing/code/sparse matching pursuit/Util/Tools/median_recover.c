@@ -0,0 +1,126 @@
+/*
+ * Standalone chunked median recovery (see chunked.h), for signals whose
+ * estimate does not fit in memory.
+ *
+ * Usage: median_recover matrix y.bin x.bin [K [chunk]]
+ *
+ *   matrix is a graph file (see graph_build and graphfile.h), which is mapped
+ *   and streamed through, or a shard (see shard.h). y.bin holds the sketch of
+ *   length M as doubles; with a shard it can be "-" to use the shard's own
+ *   sketch (e.g. the result of shard_merge).
+ *   The medians are computed chunk columns at a time (default 2^20). Without
+ *   K (or with K = 0) the N medians are written to x.bin as doubles; with
+ *   K > 0 only the K largest in absolute value are kept, and x.bin gets one
+ *   (index, value) pair of doubles for each of them, with 1-based increasing
+ *   indices. The peak memory is then the sketch, the chunk and the K entries.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../chunked.h"
+#include "../shard.h"
+#include "binio.h"
+
+char* usage =
+"Usage: median_recover matrix y.bin x.bin [K [chunk]]\n";
+
+int main(int argc, char *argv[])
+{
+    sketch_matrix_t m;
+    sketch_descriptor_t d;
+    median_topk_t topk;
+    double *y = NULL, *pairs;
+    size_t count, K = 0, chunk = 0, k;
+    FILE *f;
+    int ok;
+
+    if (argc < 4 || argc > 6)
+    {
+        fprintf(stderr, "%s", usage);
+        return 1;
+    }
+    if (argc >= 5)
+        K = (size_t) atoll(argv[4]);
+    if (argc == 6)
+        chunk = (size_t) atoll(argv[5]);
+
+    if (GraphFileIs(argv[1]))
+    {
+        if (!SketchMatrixMapExplicit(&m, argv[1]))
+        {
+            fprintf(stderr, "%s is not a graph file of this build.\n", argv[1]);
+            return 1;
+        }
+    }
+    else
+    {
+        if (!ShardRead(argv[1], &d, &y))
+        {
+            fprintf(stderr, "%s is neither a graph file nor a version %d shard.\n",
+                    argv[1], SHARD_VERSION);
+            return 1;
+        }
+        if (!ShardCreateMatrix(&m, &d))
+        {
+            fprintf(stderr, "Invalid matrix descriptor or out of memory.\n");
+            return 1;
+        }
+        ShardFree(&d);
+    }
+
+    if (strcmp(argv[2], "-"))
+    {
+        free(y);
+        y = (double *) ReadBinaryFile(argv[2], sizeof(double), &count);
+        if (!y)
+            return 1;
+        if (count != (size_t) m.M)
+        {
+            fprintf(stderr, "y must hold a sketch of size M.\n");
+            return 1;
+        }
+    }
+    else if (!y)
+    {
+        fprintf(stderr, "y.bin can only be - with a shard.\n");
+        return 1;
+    }
+
+    if (K == 0)
+    {
+        if (!(f = fopen(argv[3], "wb")))
+        {
+            fprintf(stderr, "Could not open %s.\n", argv[3]);
+            return 1;
+        }
+        ok = SketchMatrixMedianRecoveryChunked(&m, y, chunk, MedianFileAdd, f);
+        if (fclose(f) || !ok)
+        {
+            fprintf(stderr, "Could not write %s.\n", argv[3]);
+            return 1;
+        }
+    }
+    else
+    {
+        if (!MedianTopKCreate(&topk, K, chunk ? chunk : MEDIAN_CHUNK) ||
+            !SketchMatrixMedianRecoveryChunked(&m, y, chunk, MedianTopKAdd, &topk))
+        {
+            fprintf(stderr, "Out of memory.\n");
+            return 1;
+        }
+        pairs = (double *) malloc((2 * topk.num + 1) * sizeof(double));
+        for (k = 0; k < topk.num; k++)
+        {
+            pairs[2 * k] = (double) (topk.idx[k] + 1);
+            pairs[2 * k + 1] = topk.vals[k];
+        }
+        if (!WriteBinaryFile(argv[3], pairs, sizeof(double), 2 * topk.num))
+            return 1;
+        free(pairs);
+        MedianTopKDestroy(&topk);
+    }
+
+    SketchMatrixDestroy(&m);
+    free(y);
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * Merges sketch shards (see shard.h) by adding their sketches.
+ *
+ * Usage: shard_merge out.shard in1.shard [in2.shard ...]
+ *
+ *   All the input shards must have the same matrix descriptor; out.shard gets
+ *   that descriptor and the sum of their sketches. out.shard may be one of
+ *   the inputs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../shard.h"
+
+char* usage =
+"Usage: shard_merge out.shard in1.shard [in2.shard ...]\n";
+
+int main(int argc, char *argv[])
+{
+    sketch_descriptor_t total, shard;
+    double *y, *shard_y;
+    int i, k;
+
+    if (argc < 3)
+    {
+        fprintf(stderr, "%s", usage);
+        return 1;
+    }
+
+    if (!ShardRead(argv[2], &total, &y))
+    {
+        fprintf(stderr, "Could not read %s (missing, truncated or not a version %d shard).\n",
+                argv[2], SHARD_VERSION);
+        return 1;
+    }
+
+    for (i = 3; i < argc; i++)
+    {
+        if (!ShardRead(argv[i], &shard, &shard_y))
+        {
+            fprintf(stderr, "Could not read %s (missing, truncated or not a version %d shard).\n",
+                    argv[i], SHARD_VERSION);
+            return 1;
+        }
+        if (!ShardSameDescriptor(&total, &shard))
+        {
+            fprintf(stderr, "%s has a different matrix than %s.\n", argv[i], argv[2]);
+            return 1;
+        }
+        for (k = 0; k < total.M; k++)
+            y[k] += shard_y[k];
+        ShardFree(&shard);
+        free(shard_y);
+    }
+
+    if (!ShardWrite(argv[1], &total, y))
+    {
+        fprintf(stderr, "Could not write %s\n", argv[1]);
+        return 1;
+    }
+
+    fprintf(stderr, "Merged %d shards (N = %lld, M = %d, D = %d).\n",
+            argc - 2, (long long) total.N, total.M, total.D);
+
+    ShardFree(&total);
+    free(y);
+    return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * Sketches a slice of a signal into a sketch shard (see shard.h).
+ *
+ * Usage: shard_sketch in.shard x.bin first out.shard
+ *
+ *   x.bin holds the doubles x(first), x(first+1), ... of a slice of the
+ *   signal (first is 1-based). A*x_slice is added to the sketch of in.shard
+ *   and the result is written to out.shard with the same matrix descriptor;
+ *   in.shard can be a shard with a zero sketch that only carries the matrix.
+ *   The slice is sketched by all the threads (see stream.h). Workers that
+ *   sketch disjoint slices produce shards that shard_merge adds up to the
+ *   sketch of the whole signal.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../shard.h"
+#include "../stream.h"
+#include "binio.h"
+
+char* usage =
+"Usage: shard_sketch in.shard x.bin first out.shard\n";
+
+int main(int argc, char *argv[])
+{
+    sketch_descriptor_t d;
+    sketch_matrix_t m;
+    sketch_stream_t s;
+    double *y, *x, *sum;
+    long long first, block, num_blocks;
+    size_t count;
+    int k, ok = 1;
+
+    if (argc != 5)
+    {
+        fprintf(stderr, "%s", usage);
+        return 1;
+    }
+
+    if (!ShardRead(argv[1], &d, &y))
+    {
+        fprintf(stderr, "Could not read %s (missing, truncated or not a version %d shard).\n",
+                argv[1], SHARD_VERSION);
+        return 1;
+    }
+    x = (double *) ReadBinaryFile(argv[2], sizeof(double), &count);
+    if (!x)
+        return 1;
+    first = atoll(argv[3]);
+    if (first < 1 || first - 1 + (long long) count > (long long) d.N)
+    {
+        fprintf(stderr, "The slice must be within columns 1 to N = %lld.\n", (long long) d.N);
+        return 1;
+    }
+    if (!ShardCreateMatrix(&m, &d) || !SketchStreamCreate(&s, &m, 0))
+    {
+        fprintf(stderr, "Invalid matrix descriptor or out of memory.\n");
+        return 1;
+    }
+
+    /* Each thread adds blocks of the slice to its shard of the stream */
+    num_blocks = ((long long) count + PARALLEL_BLOCK_SIZE - 1) / PARALLEL_BLOCK_SIZE;
+#pragma omp parallel reduction(&&:ok)
+    {
+        size_t *idx = (size_t *) malloc(PARALLEL_BLOCK_SIZE * sizeof(size_t)), i;
+
+        if (!idx)
+            ok = 0;
+
+#pragma omp for schedule(dynamic)
+        for (block = 0; block < num_blocks; block++)
+        {
+            size_t start = (size_t) block * PARALLEL_BLOCK_SIZE;
+            size_t end = (start + PARALLEL_BLOCK_SIZE < count) ? start + PARALLEL_BLOCK_SIZE : count;
+            if (!idx)
+                continue;
+            for (i = start; i < end; i++)
+                idx[i - start] = (size_t) (first - 1) + i;
+            SketchStreamUpdate(&s, SketchStreamShard(&s), end - start, idx, x + start);
+        }
+        free(idx);
+    }
+
+    if (!ok || !(sum = (double *) realloc(x, d.M * sizeof(double))))
+    {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+    x = sum;
+    SketchStreamSnapshot(&s, x);
+    for (k = 0; k < d.M; k++)
+        y[k] += x[k];
+
+    if (!ShardWrite(argv[4], &d, y))
+    {
+        fprintf(stderr, "Could not write %s\n", argv[4]);
+        return 1;
+    }
+
+    SketchStreamDestroy(&s);
+    SketchMatrixDestroy(&m);
+    ShardFree(&d);
+    free(x);
+    free(y);
+    return 0;
+}
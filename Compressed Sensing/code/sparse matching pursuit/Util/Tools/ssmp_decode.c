@@ -0,0 +1,183 @@
+/*
+ * Standalone SSMP decoder (no Matlab needed).
+ *
+ * Usage: ssmp_decode N M D neighbors.bin y.bin inner_steps outer_steps sparsity x.bin [batch]
+ *        ssmp_decode y.shard inner_steps outer_steps sparsity x.bin [batch]
+ *
+ *   neighbors.bin holds the N by D neighbors matrix as uint32 values in
+ *   column-major order (fwrite(f, matrix.neighbors, 'uint32') in Matlab), or
+ *   is a graph file (see graph_build and graphfile.h), which is mapped
+ *   instead of loaded.
+ *   y.bin holds one or more sketches of length M as doubles. Each sketch is
+ *   decoded independently (in parallel, when compiled with OpenMP) and the
+ *   recovered vectors of length N are written one after another to x.bin.
+ *   All decoders share one copy of the graph. With batch > 1, each decoder
+ *   updates up to batch columns with disjoint buckets at once (see
+ *   SSMPBatchStep); the sketches are then decoded one after another, each
+ *   with all the threads.
+ *
+ *   The second form decodes the sketch of a shard (see shard.h), typically
+ *   the result of shard_merge, with the matrix the shard describes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../ssmp.h"
+#include "../graphfile.h"
+#include "../shard.h"
+#include "binio.h"
+
+char* usage =
+"Usage: ssmp_decode N M D neighbors.bin y.bin inner_steps outer_steps sparsity x.bin [batch]\n"
+"       ssmp_decode y.shard inner_steps outer_steps sparsity x.bin [batch]\n";
+
+/* Decodes the sketch of a shard; argv as in the second form of the usage */
+int DecodeShard(int argc, char *argv[])
+{
+    sketch_descriptor_t d;
+    sketch_matrix_t m;
+    ssmp_t *decoder;
+    double *y;
+    int inner_steps, outer_steps, sparsity, batch = 1;
+
+    inner_steps = atoi(argv[2]);
+    outer_steps = atoi(argv[3]);
+    sparsity = atoi(argv[4]);
+    if (argc == 7)
+        batch = atoi(argv[6]);
+
+    if (!ShardRead(argv[1], &d, &y))
+    {
+        fprintf(stderr, "Could not read %s (missing, truncated or not a version %d shard).\n",
+                argv[1], SHARD_VERSION);
+        return 1;
+    }
+    if (!ShardCreateMatrix(&m, &d))
+    {
+        fprintf(stderr, "Invalid matrix descriptor or out of memory.\n");
+        return 1;
+    }
+
+    fprintf(stderr, "Performing queued SMP on %s: %d inner steps, %d outer steps, %d sparsity, batch %d\n",
+            argv[1], inner_steps, outer_steps, sparsity, batch);
+
+    decoder = SketchMatrixSSMP(&m, y, inner_steps, outer_steps, sparsity, batch, NULL, NULL);
+    if (!decoder)
+    {
+        fprintf(stderr, "Could not allocate the SSMP decoder.\n");
+        return 1;
+    }
+    if (!WriteBinaryFile(argv[5], decoder->X, sizeof(double), (size_t) d.N))
+        return 1;
+
+    SketchMatrixDestroy(&m);
+    ShardFree(&d);
+    free(y);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    sketch_index_t N;
+    int M, D, inner_steps, outer_steps, sparsity, batch = 1, R, r, failed = 0;
+    size_t count;
+    unsigned int *neighbors;
+    double *y, *x;
+    bipartite_graph_t graph;
+
+    if (argc == 6 || argc == 7)
+        return DecodeShard(argc, argv);
+    if (argc != 10 && argc != 11)
+    {
+        fprintf(stderr, "%s", usage);
+        return 1;
+    }
+
+    N = (sketch_index_t) atoll(argv[1]);
+    M = atoi(argv[2]);
+    D = atoi(argv[3]);
+    inner_steps = atoi(argv[6]);
+    outer_steps = atoi(argv[7]);
+    sparsity = atoi(argv[8]);
+    if (argc == 11)
+        batch = atoi(argv[10]);
+
+    if (N <= 0 || M <= 0 || D <= 0)
+    {
+        fprintf(stderr, "N, M and D should be positive.\n");
+        return 1;
+    }
+
+    if (GraphFileIs(argv[4]))
+    {
+        if (!GraphFileMap(&graph, argv[4]) || !graph.right_start ||
+            graph.N != N || graph.M != M || graph.D != D)
+        {
+            fprintf(stderr, "%s is not a graph file of this build with N, M, D and the right adjacency.\n",
+                    argv[4]);
+            return 1;
+        }
+    }
+    else
+    {
+        neighbors = (unsigned int *) ReadBinaryFile(argv[4], sizeof(unsigned int), &count);
+        if (!neighbors)
+            return 1;
+        if (count != (size_t) N * D)
+        {
+            fprintf(stderr, "neighbors must hold N*D uint32 values.\n");
+            return 1;
+        }
+        if (!GraphBuild(&graph, N, M, D, neighbors, 1))
+        {
+            fprintf(stderr, "neighbors must be between 1 and M.\n");
+            return 1;
+        }
+        free(neighbors);
+    }
+
+    y = (double *) ReadBinaryFile(argv[5], sizeof(double), &count);
+    if (!y)
+        return 1;
+    if (count == 0 || count % M != 0)
+    {
+        fprintf(stderr, "y must hold one or more sketches of size M.\n");
+        return 1;
+    }
+    R = count / M;
+
+    x = (double *) malloc((size_t) N * R * sizeof(double));
+
+    fprintf(stderr, "Performing queued SMP on %d sketches: %d inner steps, %d outer steps, %d sparsity, batch %d\n",
+            R, inner_steps, outer_steps, sparsity, batch);
+
+#pragma omp parallel for schedule(dynamic) if (batch <= 1)
+    for (r = 0; r < R; r++)
+    {
+        ssmp_t decoder;
+        if (!SSMPCreate(&decoder, &graph))
+        {
+            failed = 1;
+            continue;
+        }
+        if (!SSMPRunBatched(&decoder, y + (size_t) r * M, inner_steps, outer_steps, sparsity,
+                            batch, NULL, NULL))
+            failed = 1;
+        memcpy(x + (size_t) r * N, decoder.X, N * sizeof(double));
+        SSMPDestroy(&decoder);
+    }
+
+    if (failed)
+    {
+        fprintf(stderr, "Could not allocate the SSMP decoder.\n");
+        return 1;
+    }
+
+    if (!WriteBinaryFile(argv[9], x, sizeof(double), (size_t) N * R))
+        return 1;
+
+    free(x);
+    free(y);
+    GraphDestroy(&graph);
+    return 0;
+}
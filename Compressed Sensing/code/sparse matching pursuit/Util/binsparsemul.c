@@ -2,12 +2,190 @@
  * Routine that implements a faster sparse matrix (with vector) multiplication
  * for the special case when the sparse matrix is binary.
  *
+ * The matrix can also be given by its N by D neighbors matrix (as generated by
+ * gen_matrix_sparse or gen_matrix_countmin), in which case the multiplication
+ * uses the bipartite graph in bipartite.h; with a non-zero transpose argument
+ * it computes A'*y without forming A'.
+ *
+ * For A*x, x can also be a Matlab sparse vector or given by its nonzeros as
+ * (index, value) pairs; then only the columns of the nonzeros are visited.
+ *
+ * The matrix can also be a graph file (see graphfile.h), which is mapped and
+ * streamed through instead of loaded.
+ *
  * Written by Radu Berinde, MIT, Jan. 2008
  */
 #include <stdio.h>
 #include <string.h>
 #include "mex.h"
 #include "matrix.h"
+#include "graphfile.h"
+#include "mexutil.h"
+
+char* usage =
+"Usage: y = binsparsemul(A, x), where A is a sparse matrix and x is a real vector\n"
+"   or: y = binsparsemul(N, M, D, neighbors, x [, transpose])\n"
+"   or: y = binsparsemul(A, idx, vals), y = binsparsemul(N, M, D, neighbors, idx, vals)\n"
+"  neighbors is an N by D uint32 matrix with the D neighbors of each column (numbers between 1 and M)\n"
+"  x is a real vector of size N (or of size M if transpose is non-zero); it can be sparse\n"
+"  x can also be a block of R signals (N by R, or M by R); y then has R columns\n"
+"  with neighbors, a single or int32 vector x gives y of the same class\n"
+"  idx (uint32, 1-based) and vals give the nonzero entries of x\n"
+"   or: y = binsparsemul(path, x [, transpose]), where path is a graph file\n"
+"  (see graphfile.h); x can be double, single or int32\n";
+
+/*
+ * y = A*x for the sparse x given by idx (0-based) and vals, where column col
+ * of A has ones in rows neighbors[col + N*j] (1-based), j < D. Reads only the
+ * neighbors of the K nonzero columns.
+ */
+void NeighborsMulSparse(sketch_index_t N, int M, int D, const unsigned int *neighbors,
+                        size_t K, const size_t *idx, const double *vals, double *y)
+{
+    size_t k;
+    int j;
+
+    for (k = 0; k < K; k++)
+    {
+        double v = vals[k];
+        if (v > -1e-10 && v < 1e-10)
+            continue;  /* zero vector entry */
+        for (j = 0; j < D; j++)
+        {
+            unsigned int row = neighbors[idx[k] + (size_t) N * j];
+            if (row < 1 || row > (unsigned int) M)
+                mexErrMsgTxt("neighbors must be between 1 and M.");
+            y[row - 1] += v;
+        }
+    }
+}
+
+/* y = binsparsemul(N, M, D, neighbors, x [, transpose]) */
+void
+NeighborsMul(int nlhs, mxArray *plhs[],
+             int nrhs, const mxArray *prhs[])
+{
+    sketch_index_t N;
+    int M, D, i, R, transpose = 0, pairs, value_class;
+    bipartite_graph_t graph;
+
+    for (i = 0; i < 3; i++)
+        if (!mxIsDouble(prhs[i]) || mxIsComplex(prhs[i]) ||
+            mxGetNumberOfElements(prhs[i]) != 1)
+            mexErrMsgTxt("First three arguments should be real scalars.");
+
+    N = (sketch_index_t) (mxGetScalar(prhs[0]) + 0.1);
+    M = (int) (mxGetScalar(prhs[1]) + 0.1);
+    D = (int) (mxGetScalar(prhs[2]) + 0.1);
+    pairs = (nrhs == 6 && mxIsClass(prhs[4], "uint32"));
+    if (nrhs == 6 && !pairs)
+        transpose = (mxGetScalar(prhs[5]) != 0);
+
+    if (!mxIsClass(prhs[3], "uint32") || mxGetNumberOfElements(prhs[3]) != (size_t) N * D)
+        mexErrMsgTxt("neighbors must be a uint32 NxD matrix.");
+
+    if (pairs || (!transpose && mxIsSparse(prhs[4])))
+    {
+        size_t K, *idx;
+        const double *vals;
+        if (!GetSparseVector(prhs[4], pairs ? prhs[5] : NULL, N, &K, &idx, &vals))
+            mexErrMsgTxt("x must be a sparse real Nx1 vector, or idx (uint32, between 1 and N) and vals real vectors of the same size.");
+        plhs[0] = mxCreateDoubleMatrix(M, 1, mxREAL);
+        NeighborsMulSparse(N, M, D, (const unsigned int *) mxGetData(prhs[3]),
+                           K, idx, vals, mxGetPr(plhs[0]));
+        mxFree(idx);
+        return;
+    }
+
+    value_class = GetValueClass(prhs[4], transpose ? M : N);
+    if (value_class == VALUE_SINGLE || value_class == VALUE_INT32)
+    {
+        if (!GraphBuild(&graph, N, M, D, (const unsigned int *) mxGetData(prhs[3]), !transpose))
+            mexErrMsgTxt("neighbors must be between 1 and M.");
+        plhs[0] = CreateValueMatrix(transpose ? N : M, 1, value_class);
+        if (value_class == VALUE_SINGLE && transpose)
+            GraphMulTransposeFloat(&graph, (const float *) mxGetData(prhs[4]), (float *) mxGetData(plhs[0]));
+        else if (value_class == VALUE_SINGLE)
+            GraphMulFloat(&graph, (const float *) mxGetData(prhs[4]), (float *) mxGetData(plhs[0]));
+        else if (transpose)
+            GraphMulTransposeInt32(&graph, (const int *) mxGetData(prhs[4]), (int *) mxGetData(plhs[0]));
+        else
+            GraphMulInt32(&graph, (const int *) mxGetData(prhs[4]), (int *) mxGetData(plhs[0]));
+        GraphDestroy(&graph);
+        return;
+    }
+
+    if (!(R = GetBlockColumns(prhs[4], transpose ? M : N)))
+        mexErrMsgTxt("x must be a real vector of size N (M for the transpose), or a block of such columns.");
+
+    /* The transpose only needs the left adjacency */
+    if (!GraphBuild(&graph, N, M, D, (const unsigned int *) mxGetData(prhs[3]), !transpose))
+        mexErrMsgTxt("neighbors must be between 1 and M.");
+
+    plhs[0] = mxCreateDoubleMatrix(transpose ? N : M, R, mxREAL);
+    if (R == 1)
+    {
+        if (transpose)
+            GraphMulTranspose(&graph, mxGetPr(prhs[4]), mxGetPr(plhs[0]));
+        else
+            GraphMul(&graph, mxGetPr(prhs[4]), mxGetPr(plhs[0]));
+    }
+    else
+    {
+        double *in = InterleavedCopy(prhs[4], transpose ? M : N, R);
+        double *out = (double *) mxMalloc((size_t) (transpose ? N : M) * R * sizeof(double));
+        if (transpose)
+            GraphMulTransposeBatch(&graph, R, in, out);
+        else
+            GraphMulBatch(&graph, R, in, out);
+        SetFromInterleaved(plhs[0], out);
+        mxFree(in);
+    }
+
+    GraphDestroy(&graph);
+}
+
+/* y = binsparsemul(path, x [, transpose]) */
+void
+FileMul(int nlhs, mxArray *plhs[],
+        int nrhs, const mxArray *prhs[])
+{
+    char path[4096];
+    int transpose = (nrhs == 3 && mxGetScalar(prhs[2]) != 0), value_class;
+    size_t in_rows, out_rows;
+    bipartite_graph_t graph;
+
+    if (mxGetString(prhs[0], path, sizeof(path)) || !GraphFileMap(&graph, path))
+        mexErrMsgTxt("Could not map the graph file (missing, or of another version or build).");
+    if (!transpose && !graph.right_start)
+    {
+        GraphDestroy(&graph);
+        mexErrMsgTxt("The graph file has no right adjacency, which A*x needs.");
+    }
+    in_rows = transpose ? graph.M : graph.N;
+    out_rows = transpose ? graph.N : graph.M;
+
+    value_class = GetValueClass(prhs[1], in_rows);
+    if (!value_class)
+    {
+        GraphDestroy(&graph);
+        mexErrMsgTxt("x must be a real vector of size N (M for the transpose).");
+    }
+    plhs[0] = CreateValueMatrix(out_rows, 1, value_class);
+    if (value_class == VALUE_SINGLE && transpose)
+        GraphMulTransposeFloat(&graph, (const float *) mxGetData(prhs[1]), (float *) mxGetData(plhs[0]));
+    else if (value_class == VALUE_SINGLE)
+        GraphStreamMulFloat(&graph, (const float *) mxGetData(prhs[1]), (float *) mxGetData(plhs[0]));
+    else if (value_class == VALUE_INT32 && transpose)
+        GraphMulTransposeInt32(&graph, (const int *) mxGetData(prhs[1]), (int *) mxGetData(plhs[0]));
+    else if (value_class == VALUE_INT32)
+        GraphStreamMulInt32(&graph, (const int *) mxGetData(prhs[1]), (int *) mxGetData(plhs[0]));
+    else if (transpose)
+        GraphMulTranspose(&graph, mxGetPr(prhs[1]), mxGetPr(plhs[0]));
+    else
+        GraphStreamMul(&graph, mxGetPr(prhs[1]), mxGetPr(plhs[0]));
+    GraphDestroy(&graph);
+}
 
 
 /* mexFunction is the gateway routine for the MEX-file. */ 
@@ -17,22 +195,91 @@ mexFunction(int nlhs, mxArray *plhs[],
 {
     const mxArray *A, *x;
     size_t *ir, *jc;
-    int col, N, M;
+    int col, N, M, R;
     double *xv, *y;
 
-    if (nlhs != 1 || nrhs != 2 || !mxIsSparse(prhs[0]) || !mxIsDouble (prhs[1]) || mxIsComplex (prhs[1]))
-       mexErrMsgTxt ("Usage: y = binsparsemul(A, x), where A is a sparse matrix and x is a real vector\n");
+    if (nlhs == 1 && (nrhs == 5 || nrhs == 6))
+    {
+        NeighborsMul(nlhs, plhs, nrhs, prhs);
+        return;
+    }
+
+    if (nlhs == 1 && (nrhs == 2 || nrhs == 3) && mxIsChar(prhs[0]))
+    {
+        FileMul(nlhs, plhs, nrhs, prhs);
+        return;
+    }
+
+    if (nlhs != 1 || (nrhs != 2 && nrhs != 3) || !mxIsSparse(prhs[0]))
+       mexErrMsgTxt (usage);
 
     A = prhs[0];
     x = prhs[1];
     N = mxGetN(A);
     M = mxGetM(A);
 
+    if (nrhs == 3 || mxIsSparse(x))
+    {
+        /* Sparse x: only visit the columns of its nonzeros */
+        size_t K, k, *idx;
+        const double *vals;
+
+        if (!GetSparseVector(x, nrhs == 3 ? prhs[2] : NULL, N, &K, &idx, &vals))
+            mexErrMsgTxt("x must be a sparse real Nx1 vector, or idx (uint32, between 1 and N) and vals real vectors of the same size.");
+
+        plhs[0] = mxCreateDoubleMatrix(M, 1, mxREAL);
+        y = mxGetPr(plhs[0]);
+        ir = mxGetIr(A);
+        jc = mxGetJc(A);
+
+        for (k = 0; k < K; k++)
+        {
+            size_t i;
+            double v = vals[k];
+            if (v > -1e-10 && v < 1e-10)
+                continue;  /* zero vector entry */
+            for (i = jc[idx[k]]; i < jc[idx[k]+1]; i++)
+                y[ir[i]] += v;
+        }
+        mxFree(idx);
+        return;
+    }
+
+    if (!mxIsDouble (x) || mxIsComplex (x))
+       mexErrMsgTxt (usage);
+
     {
         int ndims = mxGetNumberOfDimensions (x);
         const size_t *dims = mxGetDimensions (x);
-        if (ndims != 2 || dims[1] != 1 || dims[0] != N)
-            mexErrMsgTxt ("The second argument must be a column vector; inner sizes must agree.\n");
+        if (ndims != 2 || dims[0] != N)
+            mexErrMsgTxt ("The second argument must be a column vector (or block of columns); inner sizes must agree.\n");
+        R = dims[1];
+    }
+
+    if (R != 1)
+    {
+        /* Block of R signals: visit each column of A once for all of them */
+        double *xt = InterleavedCopy(x, N, R);
+        double *yt = (double *) mxCalloc((size_t) M * R + 1, sizeof(double));
+        int r;
+
+        plhs[0] = mxCreateDoubleMatrix(M, R, mxREAL);
+        ir = mxGetIr(A);
+        jc = mxGetJc(A);
+        for (col = 0; col < N; col++)
+        {
+            size_t i;
+            const double *in = xt + (size_t) col * R;
+            for (i = jc[col]; i < jc[col+1]; i++)
+            {
+                double *out = yt + ir[i] * R;
+                for (r = 0; r < R; r++)
+                    out[r] += in[r];
+            }
+        }
+        SetFromInterleaved(plhs[0], yt);
+        mxFree(xt);
+        return;
     }
 
     plhs[0] = mxCreateDoubleMatrix(M, 1, mxREAL);
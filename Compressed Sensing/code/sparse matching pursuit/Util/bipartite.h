@@ -0,0 +1,533 @@
+/*
+ * Bipartite graph of a binary sparse matrix with D ones per column (e.g. an
+ * expander from gen_matrix_sparse or gen_matrix_countmin).
+ *
+ * Both directions are stored in flat arrays carved out of a single
+ * allocation:
+ *   left[i*D .. i*D+D)                        neighbors of left (signal) node i
+ *   right[right_start[k] .. right_start[k+1]) neighbors of right (sketch) node k
+ * All indices are 0-based. The right lists are sorted increasingly. The left
+ * lists hold 32-bit bucket ids; the right lists and their offsets are 32-bit,
+ * or 64-bit in the large-scale build (see indices.h).
+ *
+ * The right adjacency is built with a (parallel) counting sort: each thread
+ * counts the right nodes of a contiguous range of left nodes, the counts are
+ * turned into per-thread offsets, and each thread scatters its range.
+ *
+ * A graph can also be mapped from a file instead of built (see graphfile.h);
+ * the kernels below work the same on it.
+ */
+
+#ifndef BIPARTITE_H
+#define BIPARTITE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parallel.h"
+#include "median.h"
+#include "indices.h"
+#include "mapfile.h"
+
+typedef struct bipartite_graph_t
+{
+    sketch_index_t N;
+    int M, D;
+    sketch_bucket_t *left;
+    /* NULL if the graph was built without the right adjacency */
+    sketch_offset_t *right_start;
+    sketch_column_t *right;
+    /* The single allocation holding right_start, right and left, or the
+     * mapping of a graph file holding them (see graphfile.h) */
+    void *arena;
+    /* Size of the mapping; 0 if arena was allocated */
+    size_t mapped_size;
+} bipartite_graph_t;
+
+
+/* Neighbors of right node k are g->right[GraphRightBegin(g,k) .. GraphRightEnd(g,k)) */
+#define GraphRightBegin(g, k) ((g)->right_start[k])
+#define GraphRightEnd(g, k)   ((g)->right_start[(k)+1])
+
+
+/* Returns 1 if the N*D neighbors are all between 1 and M, so that a failure
+ * of GraphBuild can be told apart from an invalid matrix */
+int GraphNeighborsValid(sketch_index_t N, int M, int D, const unsigned int *neighbors)
+{
+    long long p, ND = (long long) N * D;
+    int ok = 1;
+
+#pragma omp parallel for schedule(static) reduction(&&:ok)
+    for (p = 0; p < ND; p++)
+        ok = ok && neighbors[p] >= 1 && neighbors[p] <= (unsigned int) M;
+    return ok;
+}
+
+/*
+ * Builds the graph from an N by D column-major matrix of neighbors with values
+ * between 1 and M (the Matlab matrix.neighbors layout). If build_right is zero
+ * only the left adjacency is built. Returns 0 if a neighbor is out of range, if
+ * N*D does not fit in a sketch_offset_t or if the memory could not be
+ * allocated.
+ */
+int GraphBuild(bipartite_graph_t *g, sketch_index_t N, int M, int D,
+               const unsigned int *neighbors, int build_right)
+{
+    size_t ND = (size_t) N * D, arena_size;
+    int T, bad = 0;
+    sketch_offset_t *counts = NULL;
+
+    memset(g, 0, sizeof(bipartite_graph_t));
+    if (N <= 0 || M <= 0 || D <= 0 || ND / D != (size_t) N || ND >= SKETCH_MAX_OFFSET)
+        return 0;
+
+    arena_size = ND * sizeof(sketch_bucket_t);
+    if (build_right)
+        arena_size += (M + 1) * sizeof(sketch_offset_t) + ND * sizeof(sketch_column_t);
+    g->arena = malloc(arena_size);
+    if (!g->arena)
+        return 0;
+
+    g->N = N;
+    g->M = M;
+    g->D = D;
+    if (build_right)
+    {
+        g->right_start = (sketch_offset_t *) g->arena;
+        g->right = (sketch_column_t *) (g->right_start + M + 1);
+        g->left = (sketch_bucket_t *) (g->right + ND);
+    }
+    else
+        g->left = (sketch_bucket_t *) g->arena;
+
+    /* Per-thread counts of each right node (thread t uses counts[t*M..t*M+M)) */
+    T = ParallelMaxThreads();
+    if (build_right)
+    {
+        counts = (sketch_offset_t *) calloc((size_t) T * M, sizeof(sketch_offset_t));
+        if (!counts)
+        {
+            free(g->arena);
+            memset(g, 0, sizeof(bipartite_graph_t));
+            return 0;
+        }
+    }
+
+#pragma omp parallel num_threads(T) reduction(|:bad)
+    {
+        int t = ParallelThreadNum(), nt = ParallelNumThreads();
+        sketch_index_t lo = ParallelChunkStart(N, t, nt), hi = ParallelChunkStart(N, t+1, nt);
+        sketch_index_t i;
+        int j, k;
+        sketch_offset_t *cnt = counts ? counts + (size_t) t * M : NULL;
+
+        /* Transpose to the row-major left adjacency and count */
+        for (i = lo; i < hi; i++)
+            for (j = 0; j < D; j++)
+            {
+                unsigned int v = neighbors[i + (size_t) N * j];
+                if (v < 1 || v > (unsigned int) M)
+                {
+                    bad = 1;
+                    v = 1;
+                }
+                g->left[(size_t) i * D + j] = v - 1;
+                if (cnt)
+                    cnt[v-1]++;
+            }
+
+        if (build_right)
+        {
+#pragma omp barrier
+            /* Degree of each right node */
+#pragma omp for
+            for (k = 0; k < M; k++)
+            {
+                sketch_offset_t deg = 0;
+                int s;
+                for (s = 0; s < nt; s++)
+                    deg += counts[(size_t) s * M + k];
+                g->right_start[k+1] = deg;
+            }
+
+#pragma omp single
+            {
+                g->right_start[0] = 0;
+                for (k = 0; k < M; k++)
+                    g->right_start[k+1] += g->right_start[k];
+            }
+
+            /* Turn the counts into the per-thread insertion points */
+#pragma omp for
+            for (k = 0; k < M; k++)
+            {
+                sketch_offset_t pos = g->right_start[k];
+                int s;
+                for (s = 0; s < nt; s++)
+                {
+                    sketch_offset_t c = counts[(size_t) s * M + k];
+                    counts[(size_t) s * M + k] = pos;
+                    pos += c;
+                }
+            }
+
+            /* Scatter; thread t handles the same left range as before */
+            for (i = lo; i < hi; i++)
+                for (j = 0; j < D; j++)
+                    g->right[cnt[g->left[(size_t) i * D + j]]++] = i;
+        }
+    }
+
+    free(counts);
+
+    if (bad)
+    {
+        free(g->arena);
+        memset(g, 0, sizeof(bipartite_graph_t));
+        return 0;
+    }
+    return 1;
+}
+
+void GraphDestroy(bipartite_graph_t *g)
+{
+    if (g->mapped_size)
+        MapFileUnmap(g->arena, g->mapped_size);
+    else
+        free(g->arena);
+    memset(g, 0, sizeof(bipartite_graph_t));
+}
+
+
+/*
+ * Y = A*X for R signals stored interleaved: X(i, r) is x[i*R + r] and Y(k, r)
+ * goes to y[k*R + r]. Needs the right adjacency, which is read once for all
+ * R signals.
+ */
+void GraphMulBatch(const bipartite_graph_t *g, int R, const double *x, double *y)
+{
+    int k;
+#pragma omp parallel for schedule(static)
+    for (k = 0; k < g->M; k++)
+    {
+        sketch_offset_t p, end = GraphRightEnd(g, k);
+        double *out = y + (size_t) k * R;
+        int r;
+        for (r = 0; r < R; r++)
+            out[r] = 0;
+        for (p = GraphRightBegin(g, k); p < end; p++)
+        {
+            const double *in = x + (size_t) g->right[p] * R;
+            for (r = 0; r < R; r++)
+                out[r] += in[r];
+        }
+    }
+}
+
+/*
+ * y += A*x for a sparse x with K nonzeros, x(idx[k]) = vals[k] (0-based
+ * indices). Uses the left adjacency; takes O(K*D) time.
+ */
+void GraphMulSparseAdd(const bipartite_graph_t *g, size_t K, const size_t *idx,
+                       const double *vals, double *y)
+{
+    size_t k;
+    int j, D = g->D;
+
+    for (k = 0; k < K; k++)
+    {
+        const sketch_bucket_t *nb = g->left + idx[k] * D;
+        for (j = 0; j < D; j++)
+            y[nb[j]] += vals[k];
+    }
+}
+
+/* y = A*x for a sparse x (see GraphMulSparseAdd) */
+void GraphMulSparse(const bipartite_graph_t *g, size_t K, const size_t *idx,
+                    const double *vals, double *y)
+{
+    memset(y, 0, g->M * sizeof(double));
+    GraphMulSparseAdd(g, K, idx, vals, y);
+}
+
+/* X = A'*Y for R interleaved signals (y[k*R + r], x[i*R + r]) */
+void GraphMulTransposeBatch(const bipartite_graph_t *g, int R, const double *y, double *x)
+{
+    sketch_index_t i;
+    int D = g->D;
+#pragma omp parallel for schedule(static)
+    for (i = 0; i < g->N; i++)
+    {
+        const sketch_bucket_t *nb = g->left + (size_t) i * D;
+        double *out = x + (size_t) i * R;
+        int j, r;
+        for (r = 0; r < R; r++)
+            out[r] = 0;
+        for (j = 0; j < D; j++)
+        {
+            const double *in = y + (size_t) nb[j] * R;
+            for (r = 0; r < R; r++)
+                out[r] += in[r];
+        }
+    }
+}
+
+/*
+ * Single-signal kernels, defined by DEFINE_GRAPH_KERNELS for double, float
+ * (suffix Float) and int (suffix Int32) values; the sums are computed in the
+ * value type, so int32 counters stay exact as long as they fit in 32 bits.
+ *
+ * GraphMul##S: y = A*x, where y has length M and x has length N. Needs the
+ * right adjacency.
+ * GraphMulRows##S: the same for rows first to last-1 only; row k goes to
+ * y[k - first].
+ * GraphMulTranspose##S: x = A'*y.
+ * GraphMedianRecovery##S: x(i) = median of y(neighbors(i)). With OpenMP the
+ * columns are split in blocks across threads.
+ * GraphMedianRecoveryColumns##S: the same for columns first to last-1 only;
+ * the median of column i goes to x[i - first]. The columns done are added to
+ * progress.
+ * The median recoveries return 0 if the workspace could not be allocated.
+ */
+#define DEFINE_GRAPH_KERNELS(T, S)                                                  \
+void GraphMulRows##S(const bipartite_graph_t *g, const T *x, T *y, int first,      \
+                    int last)                                                       \
+{                                                                                   \
+    int k;                                                                          \
+_Pragma("omp parallel for schedule(static)")                                        \
+    for (k = first; k < last; k++)                                                  \
+    {                                                                               \
+        sketch_offset_t p, end = GraphRightEnd(g, k);                               \
+        T sum = 0;                                                                  \
+        for (p = GraphRightBegin(g, k); p < end; p++)                               \
+            sum += x[g->right[p]];                                                  \
+        y[k - first] = sum;                                                         \
+    }                                                                               \
+}                                                                                   \
+                                                                                    \
+void GraphMul##S(const bipartite_graph_t *g, const T *x, T *y)                      \
+{                                                                                   \
+    GraphMulRows##S(g, x, y, 0, g->M);                                              \
+}                                                                                   \
+                                                                                    \
+void GraphMulTranspose##S(const bipartite_graph_t *g, const T *y, T *x)             \
+{                                                                                   \
+    sketch_index_t i;                                                               \
+    int D = g->D;                                                                   \
+_Pragma("omp parallel for schedule(static)")                                        \
+    for (i = 0; i < g->N; i++)                                                      \
+    {                                                                               \
+        const sketch_bucket_t *nb = g->left + (size_t) i * D;                       \
+        T sum = 0;                                                                  \
+        int j;                                                                      \
+        for (j = 0; j < D; j++)                                                     \
+            sum += y[nb[j]];                                                        \
+        x[i] = sum;                                                                 \
+    }                                                                               \
+}                                                                                   \
+                                                                                    \
+int GraphMedianRecoveryColumns##S(const bipartite_graph_t *g, const T *y, T *x,    \
+                                  sketch_index_t first, sketch_index_t last,        \
+                                  parallel_progress_t *progress)                    \
+{                                                                                   \
+    long long block;                                                                \
+    long long num_blocks =                                                          \
+        (last - first + PARALLEL_BLOCK_SIZE - 1) / PARALLEL_BLOCK_SIZE;             \
+    int D = g->D, ok = 1;                                                           \
+                                                                                    \
+_Pragma("omp parallel reduction(&&:ok)")                                            \
+    {                                                                               \
+        T *bucket_values = (T *) malloc(D * sizeof(T));                             \
+        T *lane_values = (T *) malloc(D * MEDIAN_LANES * sizeof(T));                \
+        unsigned int seed = ParallelThreadNum() + 1;                                \
+        sketch_index_t i;                                                           \
+        int j, l;                                                                   \
+                                                                                    \
+        if (!bucket_values || !lane_values)                                         \
+            ok = 0;                                                                 \
+                                                                                    \
+_Pragma("omp for schedule(dynamic)")                                                \
+        for (block = 0; block < num_blocks; block++)                                \
+        {                                                                           \
+            sketch_index_t start =                                                  \
+                first + (sketch_index_t) block * PARALLEL_BLOCK_SIZE;               \
+            sketch_index_t end = (start + PARALLEL_BLOCK_SIZE < last) ?             \
+                start + PARALLEL_BLOCK_SIZE : last;                                 \
+                                                                                    \
+            if (!ok)                                                                \
+                continue;                                                           \
+                                                                                    \
+            /* MEDIAN_LANES columns at a time */                                    \
+            for (i = start; i + MEDIAN_LANES <= end; i += MEDIAN_LANES)             \
+            {                                                                       \
+                for (l = 0; l < MEDIAN_LANES; l++)                                  \
+                {                                                                   \
+                    const sketch_bucket_t *nb = g->left + (size_t) (i + l) * D;     \
+                    for (j = 0; j < D; j++)                                         \
+                        lane_values[j * MEDIAN_LANES + l] = y[nb[j]];               \
+                }                                                                   \
+                MedianLanes##S(lane_values, D, x + (i - first), bucket_values,      \
+                               &seed);                                              \
+            }                                                                       \
+            for (; i < end; i++)                                                    \
+            {                                                                       \
+                const sketch_bucket_t *nb = g->left + (size_t) i * D;               \
+                for (j = 0; j < D; j++)                                             \
+                    bucket_values[j] = y[nb[j]];                                    \
+                x[i - first] = Median##S(bucket_values, D, &seed);                  \
+            }                                                                       \
+            ParallelProgressAdd(progress, end - start);                             \
+        }                                                                           \
+                                                                                    \
+        free(bucket_values);                                                        \
+        free(lane_values);                                                          \
+    }                                                                               \
+    return ok;                                                                      \
+}                                                                                   \
+                                                                                    \
+int GraphMedianRecovery##S(const bipartite_graph_t *g, const T *y, T *x)            \
+{                                                                                   \
+    parallel_progress_t progress;                                                   \
+                                                                                    \
+    ParallelProgressInit(&progress, 1000000);                                       \
+    return GraphMedianRecoveryColumns##S(g, y, x, 0, g->N, &progress);              \
+}
+
+DEFINE_GRAPH_KERNELS(double, )
+DEFINE_GRAPH_KERNELS(float, Float)
+DEFINE_GRAPH_KERNELS(int, Int32)
+
+#undef DEFINE_GRAPH_KERNELS
+
+/*
+ * Median recovery for R interleaved sketches (y[k*R + r]); the medians go to
+ * x[i*R + r]. The neighbors of each column are read once, and the medians of
+ * MEDIAN_LANES sketches are computed together. Returns 0 if the workspace
+ * could not be allocated.
+ */
+int GraphMedianRecoveryBatch(const bipartite_graph_t *g, int R, const double *y, double *x)
+{
+    long long block, num_blocks = (g->N + PARALLEL_BLOCK_SIZE - 1) / PARALLEL_BLOCK_SIZE;
+    int D = g->D, ok = 1;
+    parallel_progress_t progress;
+
+    ParallelProgressInit(&progress, 1000000);
+
+#pragma omp parallel reduction(&&:ok)
+    {
+        double *bucket_values = (double *) malloc(D * sizeof(double));
+        double *lane_values = (double *) malloc(D * MEDIAN_LANES * sizeof(double));
+        unsigned int seed = ParallelThreadNum() + 1;
+        sketch_index_t i;
+        int j, l, r;
+
+        if (!bucket_values || !lane_values)
+            ok = 0;
+
+#pragma omp for schedule(dynamic)
+        for (block = 0; block < num_blocks; block++)
+        {
+            sketch_index_t start = (sketch_index_t) block * PARALLEL_BLOCK_SIZE;
+            sketch_index_t end = (start + PARALLEL_BLOCK_SIZE < g->N) ? start + PARALLEL_BLOCK_SIZE : g->N;
+
+            if (!ok)
+                continue;
+            for (i = start; i < end; i++)
+            {
+                const sketch_bucket_t *nb = g->left + (size_t) i * D;
+                double *out = x + (size_t) i * R;
+
+                for (r = 0; r + MEDIAN_LANES <= R; r += MEDIAN_LANES)
+                {
+                    for (j = 0; j < D; j++)
+                        for (l = 0; l < MEDIAN_LANES; l++)
+                            lane_values[j * MEDIAN_LANES + l] = y[(size_t) nb[j] * R + r + l];
+                    MedianLanes(lane_values, D, out + r, bucket_values, &seed);
+                }
+                for (; r < R; r++)
+                {
+                    for (j = 0; j < D; j++)
+                        bucket_values[j] = y[(size_t) nb[j] * R + r];
+                    out[r] = Median(bucket_values, D, &seed);
+                }
+            }
+            ParallelProgressAdd(&progress, end - start);
+        }
+
+        free(bucket_values);
+        free(lane_values);
+    }
+    return ok;
+}
+
+/*
+ * x(k) = (A'*y)(idx[k]) for the K candidate columns idx (0-based). idx may be
+ * NULL, meaning columns 0 to K-1 (e.g. for a graph built from the neighbors
+ * of the candidates only).
+ */
+void GraphMulTransposeAt(const bipartite_graph_t *g, const double *y, size_t K,
+                         const size_t *idx, double *x)
+{
+    long long k;
+    int D = g->D;
+
+#pragma omp parallel for schedule(static)
+    for (k = 0; k < (long long) K; k++)
+    {
+        const sketch_bucket_t *nb = g->left + (idx ? idx[k] : (size_t) k) * D;
+        double sum = 0;
+        int j;
+        for (j = 0; j < D; j++)
+            sum += y[nb[j]];
+        x[k] = sum;
+    }
+}
+
+/*
+ * x(k) = median of y(neighbors(idx[k])) for the K candidate columns idx
+ * (0-based, or NULL as above). If threshold >= 0, x(k) is set to 0 as soon as
+ * the median is known to be in [-threshold, threshold] (see MedianWithin).
+ * Returns 0 if the workspace could not be allocated.
+ */
+int GraphMedianRecoveryAt(const bipartite_graph_t *g, const double *y, size_t K,
+                          const size_t *idx, double threshold, double *x)
+{
+    int D = g->D, ok = 1;
+
+#pragma omp parallel reduction(&&:ok)
+    {
+        double *bucket_values = (double *) malloc(D * sizeof(double));
+        unsigned int seed = ParallelThreadNum() + 1;
+        long long k;
+
+        if (!bucket_values)
+            ok = 0;
+
+#pragma omp for schedule(static)
+        for (k = 0; k < (long long) K; k++)
+        {
+            const sketch_bucket_t *nb = g->left + (idx ? idx[k] : (size_t) k) * D;
+            int j, below = 0, above = 0;
+            if (!bucket_values)
+                continue;
+            for (j = 0; j < D; j++)
+            {
+                double v = y[nb[j]];
+                bucket_values[j] = v;
+                if (threshold >= 0)
+                {
+                    below += (v <= threshold);
+                    above += (v >= -threshold);
+                    if (MedianWithin(below, above, D))
+                        break;
+                }
+            }
+            x[k] = (j < D) ? 0 : Median(bucket_values, D, &seed);
+        }
+
+        free(bucket_values);
+    }
+    return ok;
+}
+
+#endif  /* BIPARTITE_H */
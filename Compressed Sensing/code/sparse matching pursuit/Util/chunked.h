@@ -0,0 +1,158 @@
+/*
+ * Median recovery in chunks of columns, for signals whose N-length estimate
+ * does not fit in memory.
+ *
+ * SketchMatrixMedianRecoveryChunked computes the medians of one range of
+ * columns at a time into a buffer of chunk values and hands each range to a
+ * sink, so the peak memory is the sketch, the chunk and what the sink keeps.
+ * Two sinks are provided:
+ *   MedianFileAdd   appends the medians to a file (as doubles, in order);
+ *   MedianTopKAdd   keeps the K largest medians in absolute value, as
+ *                   SparsifyTopK of the whole estimate would (ties keep the
+ *                   rightmost columns), in O(K + chunk) memory.
+ * For a mapped graph file (see graphfile.h) the next chunk of the graph is
+ * prefetched and the finished ones are released, as in the streamed kernels.
+ */
+
+#ifndef CHUNKED_H
+#define CHUNKED_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sketch_matrix.h"
+#include "sparsify.h"
+
+/* Default number of columns per chunk */
+#define MEDIAN_CHUNK (1 << 20)
+
+/* Receives the medians x[0 .. count) of columns first .. first+count-1.
+ * Returns 0 to stop the recovery (e.g. on a write error). */
+typedef int (*median_chunk_fn)(void *context, sketch_index_t first, size_t count,
+                               const double *x);
+
+/*
+ * Median recovery of sketch y (see SketchMatrixMedianRecovery), handed to
+ * sink in increasing chunks of at most chunk columns. Returns 0 if the memory
+ * could not be allocated or the sink stopped.
+ */
+int SketchMatrixMedianRecoveryChunked(const sketch_matrix_t *m, const double *y,
+                                      size_t chunk, median_chunk_fn sink, void *context)
+{
+    const bipartite_graph_t *g = &m->graph;
+    const sketch_bucket_t *left = g->left;
+    sketch_index_t first, last, next;
+    parallel_progress_t progress;
+    double *x;
+    int ok;
+
+    if (chunk == 0)
+        chunk = MEDIAN_CHUNK;
+    if ((size_t) m->N < chunk)
+        chunk = (size_t) m->N;
+    x = (double *) malloc(chunk * sizeof(double));
+    ok = x != NULL;
+
+    ParallelProgressInit(&progress, 1000000);
+    for (first = 0; ok && first < m->N; first = last)
+    {
+        last = ((size_t) (m->N - first) < chunk) ? m->N : first + (sketch_index_t) chunk;
+        if (m->type == SKETCH_MATRIX_EXPLICIT)
+        {
+            next = ((size_t) (m->N - last) < chunk) ? m->N : last + (sketch_index_t) chunk;
+            GraphAdvise(g, left + (size_t) last * m->D, left + (size_t) next * m->D,
+                        MAP_FILE_WILLNEED);
+            ok = GraphMedianRecoveryColumns(g, y, x, first, last, &progress);
+            GraphAdvise(g, left + (size_t) first * m->D, left + (size_t) last * m->D,
+                        MAP_FILE_DONTNEED);
+        }
+        else
+            ok = CountMinMedianRecoveryColumns(&m->hash, y, x, first, last, &progress);
+        ok = ok && sink(context, first, (size_t) (last - first), x);
+    }
+
+    free(x);
+    return ok;
+}
+
+/* Sink that writes the medians to the FILE * context */
+int MedianFileAdd(void *context, sketch_index_t first, size_t count, const double *x)
+{
+    (void) first;
+    return fwrite(x, sizeof(double), count, (FILE *) context) == count;
+}
+
+
+typedef struct median_topk_t
+{
+    size_t K;
+    /* The num <= K largest medians so far: 0-based indices (increasing) and
+     * values */
+    size_t num;
+    size_t *idx;
+    double *vals;
+
+    /* Scratch space: the candidates (the kept medians followed by the
+     * largest ones of a chunk), and the selection workspace */
+    size_t *candidate_idx, *pos;
+    double *candidate_vals, *work;
+} median_topk_t;
+
+void MedianTopKDestroy(median_topk_t *t)
+{
+    free(t->idx);
+    free(t->vals);
+    free(t->candidate_idx);
+    free(t->pos);
+    free(t->candidate_vals);
+    free(t->work);
+    memset(t, 0, sizeof(median_topk_t));
+}
+
+/* Creates an accumulator of the K largest medians, for chunks of at most
+ * chunk columns. Returns 0 if the memory could not be allocated. */
+int MedianTopKCreate(median_topk_t *t, size_t K, size_t chunk)
+{
+    size_t work_size = (chunk > 2 * K) ? chunk : 2 * K;
+
+    t->K = K;
+    t->num = 0;
+    t->idx = (size_t *) malloc((K + 1) * sizeof(size_t));
+    t->vals = (double *) malloc((K + 1) * sizeof(double));
+    t->candidate_idx = (size_t *) malloc((2 * K + 1) * sizeof(size_t));
+    t->pos = (size_t *) malloc((K + 1) * sizeof(size_t));
+    t->candidate_vals = (double *) malloc((2 * K + 1) * sizeof(double));
+    t->work = (double *) malloc((work_size + 1) * sizeof(double));
+    if (t->idx && t->vals && t->candidate_idx && t->pos && t->candidate_vals && t->work)
+        return 1;
+    MedianTopKDestroy(t);
+    return 0;
+}
+
+/*
+ * Sink that merges the largest medians of a chunk into the median_topk_t
+ * context. The K largest of a union are the K largest of the K largest of
+ * each part, and the chunks come in increasing column order, so the result
+ * is that of SparsifyTopK on the whole estimate.
+ */
+int MedianTopKAdd(void *context, sketch_index_t first, size_t count, const double *x)
+{
+    median_topk_t *t = (median_topk_t *) context;
+    size_t k, num = t->num;
+
+    if (t->K == 0)
+        return 1;
+
+    memcpy(t->candidate_idx, t->idx, num * sizeof(size_t));
+    memcpy(t->candidate_vals, t->vals, num * sizeof(double));
+    k = SparsifyTopK(x, count, t->K, t->work, t->candidate_idx + num, t->candidate_vals + num);
+    for (; k > 0; k--, num++)
+        t->candidate_idx[num] += (size_t) first;
+
+    t->num = SparsifyTopK(t->candidate_vals, num, t->K, t->work, t->pos, t->vals);
+    for (k = 0; k < t->num; k++)
+        t->idx[k] = t->candidate_idx[t->pos[k]];
+    return 1;
+}
+
+#endif  /* CHUNKED_H */
@@ -1,5 +1,26 @@
 #!/bin/sh
 
+# Set OPENMP=1 to build the multithreaded versions of the kernels (needs a
+# compiler with OpenMP support, e.g. gcc).
+# Set LARGE=1 for the large-scale build (64-bit signal indices and hash terms,
+# no 65535 limit on D for SSMP; see indices.h).
+MEXFLAGS=
+TOOLFLAGS=
+if [ -n "$LARGE" ]; then
+    MEXFLAGS="-largeArrayDims -DSKETCH_LARGE"
+    TOOLFLAGS="-DSKETCH_LARGE"
+fi
 for i in *.c; do
-    mex $i
+    if [ -n "$OPENMP" ]; then
+        mex $MEXFLAGS CFLAGS='$CFLAGS -fopenmp' LDFLAGS='$LDFLAGS -fopenmp' $i
+    else
+        mex $MEXFLAGS $i
+    fi
+done
+
+# Standalone (non-Matlab) tools
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:-"-O2 -fopenmp"}
+for i in Tools/*.c; do
+    $CC $CFLAGS $TOOLFLAGS -o ${i%.c} $i -lm
 done
@@ -0,0 +1,736 @@
+/*
+ * Kernels for the implicit countmin_twowise matrix (see
+ * Matrices/gen_matrix_countmin_implicit_twowise.m). The matrix has D row
+ * sections of B rows each; column col (1-based) has a one in row
+ *     i*B + ((As[i] * col + Bs[i]) mod Ps[i]) mod B
+ * of each section i (0-based rows).
+ *
+ * The kernels avoid integer divisions: the hash terms are updated with a
+ * conditional subtraction and the reduction mod B uses a precomputed
+ * reciprocal (see CountMinNext). The buckets are the same as with % .
+ *
+ * The hash terms are 32-bit, or 64-bit in the large-scale build (see
+ * indices.h), where the primes can be up to 2^63.
+ *
+ * Written by Radu Berinde, MIT, Jan. 2008
+ */
+
+#ifndef COUNTMIN_H
+#define COUNTMIN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "median.h"
+#include "parallel.h"
+#include "indices.h"
+
+#ifdef SKETCH_LARGE
+/* The sum of two terms must fit in 64 bits */
+#define COUNTMIN_MAX_PRIME (1ull << 63)
+#define COUNTMIN_MAX_PRIME_TEXT "2^63"
+#else
+/* Impose a 2 billion limit on the P primes, so we won't overflow. */
+#define COUNTMIN_MAX_PRIME 2000000000u
+#define COUNTMIN_MAX_PRIME_TEXT "2 billion"
+#endif
+
+typedef struct countmin_hash_t
+{
+    sketch_index_t N;
+    int M, D, B;
+    /* Parameters of the D hash functions (owned copies; As and Bs are reduced
+     * mod Ps) */
+    countmin_term_t *Ps, *As, *Bs;
+    /* floor(2^32 / B), or floor((2^64-1) / B) in the large-scale build, for
+     * reducing mod B without a division */
+    unsigned long long Brecip;
+} countmin_hash_t;
+
+
+/*
+ * Initializes the hash family, copying the parameters. Returns 0 if B*D > M,
+ * if a prime is larger than COUNTMIN_MAX_PRIME or if the memory could not be
+ * allocated.
+ */
+int CountMinCreate(countmin_hash_t *h, sketch_index_t N, int M, int D, int B,
+                   const countmin_term_t *Ps, const countmin_term_t *As,
+                   const countmin_term_t *Bs)
+{
+    int i;
+
+    memset(h, 0, sizeof(countmin_hash_t));
+    if (N <= 0 || D <= 0 || B <= 0 || (long long) B * D > M)
+        return 0;
+    for (i = 0; i < D; i++)
+        if (Ps[i] > COUNTMIN_MAX_PRIME || Ps[i] == 0)
+            return 0;
+
+    h->Ps = (countmin_term_t *) malloc(3 * D * sizeof(countmin_term_t));
+    if (!h->Ps)
+        return 0;
+    h->As = h->Ps + D;
+    h->Bs = h->As + D;
+    memcpy(h->Ps, Ps, D * sizeof(countmin_term_t));
+    for (i = 0; i < D; i++)
+    {
+        h->As[i] = As[i] % Ps[i];
+        h->Bs[i] = Bs[i] % Ps[i];
+    }
+#ifdef SKETCH_LARGE
+    h->Brecip = ~0ull / B;
+#else
+    h->Brecip = (1ull << 32) / B;
+#endif
+
+    h->N = N;
+    h->M = M;
+    h->D = D;
+    h->B = B;
+    return 1;
+}
+
+void CountMinDestroy(countmin_hash_t *h)
+{
+    free(h->Ps);
+    memset(h, 0, sizeof(countmin_hash_t));
+}
+
+/*
+ * Returns (As[i] * col + Bs[i]) mod Ps[i]. In the large-scale build the
+ * product needs 128 bits; without a 128-bit type it is computed by doubling.
+ */
+static inline countmin_term_t CountMinTerm(const countmin_hash_t *h, int i,
+                                           unsigned long long col)
+{
+    countmin_term_t P = h->Ps[i];
+#if !defined(SKETCH_LARGE)
+    return (countmin_term_t) (((unsigned long long) h->As[i] * col + h->Bs[i]) % P);
+#elif defined(__SIZEOF_INT128__)
+    return (countmin_term_t) (((unsigned __int128) h->As[i] * col + h->Bs[i]) % P);
+#else
+    countmin_term_t a = h->As[i], prod = h->Bs[i];
+    col %= P;
+    while (col)
+    {
+        if (col & 1)
+        {
+            prod += a;
+            prod -= (prod >= P) ? P : 0;
+        }
+        a += a;
+        a -= (a >= P) ? P : 0;
+        col >>= 1;
+    }
+    return prod;
+#endif
+}
+
+/*
+ * Returns v mod B, given Brecip = h->Brecip. For v < 2^32,
+ * q = (v * floor(2^32/B)) >> 32 is either floor(v/B) or one less, so one
+ * conditional subtraction gives v mod B; the 64-bit terms use
+ * floor((2^64-1)/B) and the high half of the 128-bit product the same way.
+ */
+static inline unsigned int CountMinModB(countmin_term_t v, unsigned int B,
+                                        unsigned long long Brecip)
+{
+#if !defined(SKETCH_LARGE)
+    unsigned int q = (unsigned int) ((v * Brecip) >> 32), r = v - q * B;
+    return r - ((r >= B) ? B : 0);
+#elif defined(__SIZEOF_INT128__)
+    unsigned long long q = (unsigned long long) (((unsigned __int128) v * Brecip) >> 64);
+    unsigned int r = (unsigned int) (v - q * B);
+    return r - ((r >= B) ? B : 0);
+#else
+    return (unsigned int) (v % B);
+#endif
+}
+
+/*
+ * At each column we want to compute
+ *     pos = (int) (((long long) As[i] * (col+1) + Bs[i]) % Ps[i] % B);
+ *
+ * To speed this up, we mainain the (((long long) As[i] * (col+1) + Bs[i]) %
+ * Ps[i] terms in vals, and just add As[i] at each step.
+ *
+ * CountMinSeek sets vals to the terms for column col (0-based), i.e. the state
+ * before processing column col, so that a worker can start anywhere. The terms
+ * are always less than Ps[i].
+ */
+void CountMinSeek(const countmin_hash_t *h, countmin_term_t *vals, sketch_index_t col)
+{
+    int i;
+    for (i = 0; i < h->D; i++)
+        vals[i] = CountMinTerm(h, i, col);
+}
+
+void CountMinStart(const countmin_hash_t *h, countmin_term_t *vals)
+{
+    CountMinSeek(h, vals, 0);
+}
+
+/*
+ * Advances vals to the next column and stores the row of that column in each
+ * section in rows[0..D). Equivalent to
+ *     vals[i] = (vals[i] + As[i]) % Ps[i];
+ *     rows[i] = i*B + vals[i] % B;
+ * Since vals[i] and As[i] are less than Ps[i] (at most COUNTMIN_MAX_PRIME),
+ * the sum does not overflow and needs at most one subtraction; the reduction
+ * mod B is CountMinModB. The loop has no branches, so the compiler can
+ * vectorize it across the D hash functions.
+ */
+void CountMinNext(const countmin_hash_t *h, countmin_term_t *vals, unsigned int *rows)
+{
+    int i, D = h->D;
+    unsigned int B = h->B;
+    unsigned long long Brecip = h->Brecip;
+    const countmin_term_t *As = h->As, *Ps = h->Ps;
+
+    for (i = 0; i < D; i++)
+    {
+        countmin_term_t v = vals[i] + As[i];
+        v -= (v >= Ps[i]) ? Ps[i] : 0;
+        vals[i] = v;
+        rows[i] = i * B + CountMinModB(v, B, Brecip);
+    }
+}
+
+/* Allocates the hash terms and rows of D functions, in one block */
+static inline countmin_term_t *CountMinAllocTerms(int D, unsigned int **rows)
+{
+    countmin_term_t *vals = (countmin_term_t *)
+        malloc(D * (sizeof(countmin_term_t) + sizeof(unsigned int)));
+    *rows = (unsigned int *) (vals + D);
+    return vals;
+}
+
+
+/*
+ * Adds the contribution of columns [start, end) to row section i of A*x,
+ * for R signals stored interleaved (x[col*R + r]); section points to the B
+ * rows of the section (section[row*R + r]). Only hash function i is
+ * evaluated, once per column for all R signals.
+ */
+void CountMinMulSection(const countmin_hash_t *h, int i, int R, const double *x,
+                        sketch_index_t start, sketch_index_t end, double *section)
+{
+    sketch_index_t col;
+    int r;
+    unsigned int B = h->B;
+    countmin_term_t A = h->As[i], P = h->Ps[i];
+    unsigned long long Brecip = h->Brecip;
+    countmin_term_t v = CountMinTerm(h, i, start);
+
+    for (col = start; col < end; col++)
+    {
+        const double *xc = x + (size_t) col * R;
+        double *out;
+        v += A;
+        v -= (v >= P) ? P : 0;
+        if (R == 1 && xc[0] > -1e-10 && xc[0] < 1e-10)
+            continue;  /* zero vector entry */
+        out = section + (size_t) CountMinModB(v, B, Brecip) * R;
+        for (r = 0; r < R; r++)
+            out[r] += xc[r];
+    }
+}
+
+/*
+ * Y = A*X for R signals stored interleaved: X is N by R with X(col, r) in
+ * x[col*R + r], and Y(row, r) goes to y[row*R + r].
+ *
+ * Hash function i only writes to rows [i*B, (i+1)*B), so the work is split by
+ * row section and needs no atomics. When there are fewer sections than
+ * threads, the columns are also split in chunks; chunk 0 of each section adds
+ * into y and the others into partial copies of y that are summed at the end.
+ */
+void CountMinMulBatch(const countmin_hash_t *h, int R, const double *x, double *y)
+{
+    int D = h->D, B = h->B;
+    size_t MR = (size_t) h->M * R;
+    int chunks = 1, unit, threads = ParallelMaxThreads();
+    long long max_chunks = (h->N + PARALLEL_BLOCK_SIZE - 1) / PARALLEL_BLOCK_SIZE;
+    double *partial = NULL;
+
+    if (threads > D)
+        chunks = (threads + D - 1) / D;
+    if (chunks > max_chunks)
+        chunks = max_chunks;
+    if (chunks > 1)
+    {
+        partial = (double *) calloc((chunks - 1) * MR, sizeof(double));
+        if (!partial)
+            chunks = 1;
+    }
+
+    memset(y, 0, MR * sizeof(double));
+
+#pragma omp parallel for schedule(dynamic)
+    for (unit = 0; unit < D * chunks; unit++)
+    {
+        int i = unit / chunks, chunk = unit % chunks;
+        double *out = chunk ? partial + (chunk - 1) * MR : y;
+        CountMinMulSection(h, i, R, x,
+                           ParallelChunkStart(h->N, chunk, chunks),
+                           ParallelChunkStart(h->N, chunk + 1, chunks),
+                           out + (size_t) i * B * R);
+    }
+
+    if (partial)
+    {
+        long long row;
+        int chunk;
+#pragma omp parallel for private(chunk)
+        for (row = 0; row < (long long) D * B * R; row++)
+            for (chunk = 1; chunk < chunks; chunk++)
+                y[row] += partial[(chunk - 1) * MR + row];
+        free(partial);
+    }
+}
+
+/* Row (0-based) of column col (0-based) in section i, computed directly */
+static inline size_t CountMinRow(const countmin_hash_t *h, int i, size_t col)
+{
+    return (size_t) i * h->B + CountMinTerm(h, i, col + 1) % h->B;
+}
+
+/*
+ * y += A*x for a sparse x with K nonzeros, x(idx[k]) = vals[k] (0-based
+ * indices). Unlike CountMinMulSparse, small values are not skipped, so the
+ * result can be used to update a residual exactly.
+ */
+void CountMinMulSparseAdd(const countmin_hash_t *h, size_t K, const size_t *idx,
+                          const double *vals, double *y)
+{
+    size_t k;
+    int i, D = h->D;
+
+    for (k = 0; k < K; k++)
+        for (i = 0; i < D; i++)
+            y[CountMinRow(h, i, idx[k])] += vals[k];
+}
+
+/*
+ * y = A*x for a sparse x with K nonzeros, x(idx[k]) = vals[k] (0-based
+ * indices). The rows of each nonzero column are computed directly from the
+ * hash functions, so this takes O(K*D) time instead of O(N*D).
+ */
+void CountMinMulSparse(const countmin_hash_t *h, size_t K, const size_t *idx,
+                       const double *vals, double *y)
+{
+    size_t k;
+    int i, D = h->D;
+
+    memset(y, 0, h->M * sizeof(double));
+
+    for (k = 0; k < K; k++)
+    {
+        double val = vals[k];
+        if (val > -1e-10 && val < 1e-10)
+            continue;  /* zero vector entry */
+        for (i = 0; i < D; i++)
+            y[CountMinRow(h, i, idx[k])] += val;
+    }
+}
+
+/*
+ * X = A'*Y for R interleaved signals (Y(row, r) in y[row*R + r], X(col, r) in
+ * x[col*R + r]). With OpenMP the output columns are split in blocks across
+ * threads.
+ */
+void CountMinMulTransposeBatch(const countmin_hash_t *h, int R, const double *y, double *x)
+{
+    long long block, num_blocks = (h->N + PARALLEL_BLOCK_SIZE - 1) / PARALLEL_BLOCK_SIZE;
+    int D = h->D;
+
+#pragma omp parallel
+    {
+        unsigned int *rows;
+        countmin_term_t *vals = CountMinAllocTerms(D, &rows);
+        sketch_index_t col;
+        int i, r;
+
+#pragma omp for schedule(dynamic)
+        for (block = 0; block < num_blocks; block++)
+        {
+            sketch_index_t start = (sketch_index_t) block * PARALLEL_BLOCK_SIZE;
+            sketch_index_t end = (start + PARALLEL_BLOCK_SIZE < h->N) ? start + PARALLEL_BLOCK_SIZE : h->N;
+
+            CountMinSeek(h, vals, start);
+            for (col = start; col < end; col++)
+            {
+                double *out = x + (size_t) col * R;
+                CountMinNext(h, vals, rows);
+                if (R == 1)
+                {
+                    double sum = 0;
+                    for (i = 0; i < D; i++)
+                        sum += y[rows[i]];
+                    out[0] = sum;
+                    continue;
+                }
+                for (r = 0; r < R; r++)
+                    out[r] = 0;
+                for (i = 0; i < D; i++)
+                {
+                    const double *in = y + (size_t) rows[i] * R;
+                    for (r = 0; r < R; r++)
+                        out[r] += in[r];
+                }
+            }
+        }
+
+        free(vals);
+    }
+}
+
+/*
+ * Single-signal kernels, defined by DEFINE_COUNTMIN_KERNELS for double, float
+ * (suffix Float) and int (suffix Int32) values; the sums are computed in the
+ * value type, so int32 counters stay exact as long as they fit in 32 bits.
+ *
+ * CountMinMul##S: y = A*x, where y has length M and x has length N; the work
+ * is split as in CountMinMulBatch (CountMinMulColumns##S adds columns
+ * [start, end) to row section i).
+ * CountMinMulTranspose##S: x = A'*y.
+ * CountMinMedianRecovery##S: x(i) = median of y(neighbors(i)). With OpenMP the
+ * columns are split in blocks across threads; each block seeks the hash
+ * recurrence to its first column.
+ * CountMinMedianRecoveryColumns##S: the same for columns first to last-1
+ * only; the median of column i goes to x[i - first]. The columns done are
+ * added to progress.
+ * The median recoveries return 0 if the workspace could not be allocated.
+ */
+#define DEFINE_COUNTMIN_KERNELS(T, S)                                               \
+void CountMinMulColumns##S(const countmin_hash_t *h, int i, const T *x,             \
+                           sketch_index_t start, sketch_index_t end, T *section)    \
+{                                                                                   \
+    sketch_index_t col;                                                             \
+    unsigned int B = h->B;                                                          \
+    countmin_term_t A = h->As[i], P = h->Ps[i];                                     \
+    unsigned long long Brecip = h->Brecip;                                          \
+    countmin_term_t v = CountMinTerm(h, i, start);                                  \
+                                                                                    \
+    for (col = start; col < end; col++)                                             \
+    {                                                                               \
+        v += A;                                                                     \
+        v -= (v >= P) ? P : 0;                                                      \
+        if (x[col] > -1e-10 && x[col] < 1e-10)                                      \
+            continue;  /* zero vector entry */                                      \
+        section[CountMinModB(v, B, Brecip)] += x[col];                              \
+    }                                                                               \
+}                                                                                   \
+                                                                                    \
+void CountMinMul##S(const countmin_hash_t *h, const T *x, T *y)                     \
+{                                                                                   \
+    int D = h->D, B = h->B, M = h->M;                                               \
+    int chunks = 1, unit, threads = ParallelMaxThreads();                           \
+    long long max_chunks = (h->N + PARALLEL_BLOCK_SIZE - 1) / PARALLEL_BLOCK_SIZE;  \
+    T *partial = NULL;                                                              \
+                                                                                    \
+    if (threads > D)                                                                \
+        chunks = (threads + D - 1) / D;                                             \
+    if (chunks > max_chunks)                                                        \
+        chunks = max_chunks;                                                        \
+    if (chunks > 1)                                                                 \
+    {                                                                               \
+        partial = (T *) calloc((size_t) (chunks - 1) * M, sizeof(T));               \
+        if (!partial)                                                               \
+            chunks = 1;                                                             \
+    }                                                                               \
+                                                                                    \
+    memset(y, 0, M * sizeof(T));                                                    \
+                                                                                    \
+_Pragma("omp parallel for schedule(dynamic)")                                       \
+    for (unit = 0; unit < D * chunks; unit++)                                       \
+    {                                                                               \
+        int i = unit / chunks, chunk = unit % chunks;                               \
+        T *out = chunk ? partial + (size_t) (chunk - 1) * M : y;                    \
+        CountMinMulColumns##S(h, i, x,                                              \
+                              ParallelChunkStart(h->N, chunk, chunks),              \
+                              ParallelChunkStart(h->N, chunk + 1, chunks),          \
+                              out + (size_t) i * B);                                \
+    }                                                                               \
+                                                                                    \
+    if (partial)                                                                    \
+    {                                                                               \
+        int row, chunk;                                                             \
+_Pragma("omp parallel for private(chunk)")                                          \
+        for (row = 0; row < D * B; row++)                                           \
+            for (chunk = 1; chunk < chunks; chunk++)                                \
+                y[row] += partial[(size_t) (chunk - 1) * M + row];                  \
+        free(partial);                                                              \
+    }                                                                               \
+}                                                                                   \
+                                                                                    \
+void CountMinMulTranspose##S(const countmin_hash_t *h, const T *y, T *x)            \
+{                                                                                   \
+    long long block;                                                                \
+    long long num_blocks = (h->N + PARALLEL_BLOCK_SIZE - 1) / PARALLEL_BLOCK_SIZE;  \
+    int D = h->D;                                                                   \
+                                                                                    \
+_Pragma("omp parallel")                                                             \
+    {                                                                               \
+        unsigned int *rows;                                                         \
+        countmin_term_t *vals = CountMinAllocTerms(D, &rows);                       \
+        sketch_index_t col;                                                         \
+        int i;                                                                      \
+                                                                                    \
+_Pragma("omp for schedule(dynamic)")                                                \
+        for (block = 0; block < num_blocks; block++)                                \
+        {                                                                           \
+            sketch_index_t start = (sketch_index_t) block * PARALLEL_BLOCK_SIZE;    \
+            sketch_index_t end = (start + PARALLEL_BLOCK_SIZE < h->N) ?             \
+                start + PARALLEL_BLOCK_SIZE : h->N;                                 \
+                                                                                    \
+            CountMinSeek(h, vals, start);                                           \
+            for (col = start; col < end; col++)                                     \
+            {                                                                       \
+                T sum = 0;                                                          \
+                CountMinNext(h, vals, rows);                                        \
+                for (i = 0; i < D; i++)                                             \
+                    sum += y[rows[i]];                                              \
+                x[col] = sum;                                                       \
+            }                                                                       \
+        }                                                                           \
+                                                                                    \
+        free(vals);                                                                 \
+    }                                                                               \
+}                                                                                   \
+                                                                                    \
+int CountMinMedianRecoveryColumns##S(const countmin_hash_t *h, const T *y, T *x,    \
+                                     sketch_index_t first, sketch_index_t last,     \
+                                     parallel_progress_t *progress)                 \
+{                                                                                   \
+    long long block;                                                                \
+    long long num_blocks =                                                          \
+        (last - first + PARALLEL_BLOCK_SIZE - 1) / PARALLEL_BLOCK_SIZE;             \
+    int D = h->D, ok = 1;                                                           \
+                                                                                    \
+_Pragma("omp parallel reduction(&&:ok)")                                            \
+    {                                                                               \
+        unsigned int *rows;                                                         \
+        countmin_term_t *vals = CountMinAllocTerms(D, &rows);                       \
+        T *bucket_values = (T *) malloc(D * sizeof(T));                             \
+        T *lane_values = (T *) malloc(D * MEDIAN_LANES * sizeof(T));                \
+        unsigned int seed = ParallelThreadNum() + 1;                                \
+        sketch_index_t col;                                                         \
+        int i, l;                                                                   \
+                                                                                    \
+        if (!vals || !bucket_values || !lane_values)                                \
+            ok = 0;                                                                 \
+                                                                                    \
+_Pragma("omp for schedule(dynamic)")                                                \
+        for (block = 0; block < num_blocks; block++)                                \
+        {                                                                           \
+            sketch_index_t start =                                                  \
+                first + (sketch_index_t) block * PARALLEL_BLOCK_SIZE;               \
+            sketch_index_t end = (start + PARALLEL_BLOCK_SIZE < last) ?             \
+                start + PARALLEL_BLOCK_SIZE : last;                                 \
+                                                                                    \
+            if (!ok)                                                                \
+                continue;                                                           \
+            CountMinSeek(h, vals, start);                                           \
+                                                                                    \
+            /* MEDIAN_LANES columns at a time */                                    \
+            for (col = start; col + MEDIAN_LANES <= end; col += MEDIAN_LANES)       \
+            {                                                                       \
+                for (l = 0; l < MEDIAN_LANES; l++)                                  \
+                {                                                                   \
+                    CountMinNext(h, vals, rows);                                    \
+                    for (i = 0; i < D; i++)                                         \
+                        lane_values[i * MEDIAN_LANES + l] = y[rows[i]];             \
+                }                                                                   \
+                MedianLanes##S(lane_values, D, x + (col - first), bucket_values,    \
+                               &seed);                                              \
+            }                                                                       \
+            for (; col < end; col++)                                                \
+            {                                                                       \
+                CountMinNext(h, vals, rows);                                        \
+                for (i = 0; i < D; i++)                                             \
+                    bucket_values[i] = y[rows[i]];                                  \
+                x[col - first] = Median##S(bucket_values, D, &seed);                \
+            }                                                                       \
+            ParallelProgressAdd(progress, end - start);                             \
+        }                                                                           \
+                                                                                    \
+        free(vals);                                                                 \
+        free(bucket_values);                                                        \
+        free(lane_values);                                                          \
+    }                                                                               \
+    return ok;                                                                      \
+}                                                                                   \
+                                                                                    \
+int CountMinMedianRecovery##S(const countmin_hash_t *h, const T *y, T *x)           \
+{                                                                                   \
+    parallel_progress_t progress;                                                   \
+                                                                                    \
+    ParallelProgressInit(&progress, 1000000);                                       \
+    return CountMinMedianRecoveryColumns##S(h, y, x, 0, h->N, &progress);           \
+}
+
+DEFINE_COUNTMIN_KERNELS(double, )
+DEFINE_COUNTMIN_KERNELS(float, Float)
+DEFINE_COUNTMIN_KERNELS(int, Int32)
+
+#undef DEFINE_COUNTMIN_KERNELS
+
+/*
+ * Median recovery for R interleaved sketches (y[row*R + r]); the medians go
+ * to x[col*R + r]. The hash functions are evaluated once per column, and the
+ * medians of MEDIAN_LANES sketches are computed together. Returns 0 if the
+ * workspace could not be allocated.
+ */
+int CountMinMedianRecoveryBatch(const countmin_hash_t *h, int R, const double *y, double *x)
+{
+    long long block, num_blocks = (h->N + PARALLEL_BLOCK_SIZE - 1) / PARALLEL_BLOCK_SIZE;
+    int D = h->D, ok = 1;
+    parallel_progress_t progress;
+
+    ParallelProgressInit(&progress, 1000000);
+
+#pragma omp parallel reduction(&&:ok)
+    {
+        unsigned int *rows;
+        countmin_term_t *vals = CountMinAllocTerms(D, &rows);
+        double *bucket_values = (double *) malloc(D * sizeof(double));
+        double *lane_values = (double *) malloc(D * MEDIAN_LANES * sizeof(double));
+        unsigned int seed = ParallelThreadNum() + 1;
+        sketch_index_t col;
+        int i, l, r;
+
+        if (!vals || !bucket_values || !lane_values)
+            ok = 0;
+
+#pragma omp for schedule(dynamic)
+        for (block = 0; block < num_blocks; block++)
+        {
+            sketch_index_t start = (sketch_index_t) block * PARALLEL_BLOCK_SIZE;
+            sketch_index_t end = (start + PARALLEL_BLOCK_SIZE < h->N) ? start + PARALLEL_BLOCK_SIZE : h->N;
+
+            if (!ok)
+                continue;
+            CountMinSeek(h, vals, start);
+            for (col = start; col < end; col++)
+            {
+                double *out = x + (size_t) col * R;
+                CountMinNext(h, vals, rows);
+
+                /* MEDIAN_LANES sketches at a time */
+                for (r = 0; r + MEDIAN_LANES <= R; r += MEDIAN_LANES)
+                {
+                    for (i = 0; i < D; i++)
+                        for (l = 0; l < MEDIAN_LANES; l++)
+                            lane_values[i * MEDIAN_LANES + l] = y[(size_t) rows[i] * R + r + l];
+                    MedianLanes(lane_values, D, out + r, bucket_values, &seed);
+                }
+                for (; r < R; r++)
+                {
+                    for (i = 0; i < D; i++)
+                        bucket_values[i] = y[(size_t) rows[i] * R + r];
+                    out[r] = Median(bucket_values, D, &seed);
+                }
+            }
+            ParallelProgressAdd(&progress, end - start);
+        }
+
+        free(vals);
+        free(bucket_values);
+        free(lane_values);
+    }
+    return ok;
+}
+
+/*
+ * x(k) = (A'*y)(idx[k]) for the K candidate columns idx (0-based); takes
+ * O(K*D) time.
+ */
+void CountMinMulTransposeAt(const countmin_hash_t *h, const double *y, size_t K,
+                            const size_t *idx, double *x)
+{
+    long long k;
+    int D = h->D;
+
+#pragma omp parallel for schedule(static)
+    for (k = 0; k < (long long) K; k++)
+    {
+        double sum = 0;
+        int i;
+        for (i = 0; i < D; i++)
+            sum += y[CountMinRow(h, i, idx[k])];
+        x[k] = sum;
+    }
+}
+
+/*
+ * x(k) = median of y(neighbors(idx[k])) for the K candidate columns idx
+ * (0-based). If threshold >= 0, x(k) is set to 0 as soon as the median is
+ * known to be in [-threshold, threshold], without looking at the remaining
+ * buckets (see MedianWithin). A negative threshold disables this. Returns 0
+ * if the workspace could not be allocated.
+ */
+int CountMinMedianRecoveryAt(const countmin_hash_t *h, const double *y, size_t K,
+                             const size_t *idx, double threshold, double *x)
+{
+    int D = h->D, ok = 1;
+
+#pragma omp parallel reduction(&&:ok)
+    {
+        double *bucket_values = (double *) malloc(D * sizeof(double));
+        unsigned int seed = ParallelThreadNum() + 1;
+        long long k;
+
+        if (!bucket_values)
+            ok = 0;
+
+#pragma omp for schedule(static)
+        for (k = 0; k < (long long) K; k++)
+        {
+            int i, below = 0, above = 0;
+            if (!bucket_values)
+                continue;
+            for (i = 0; i < D; i++)
+            {
+                double v = y[CountMinRow(h, i, idx[k])];
+                bucket_values[i] = v;
+                if (threshold >= 0)
+                {
+                    below += (v <= threshold);
+                    above += (v >= -threshold);
+                    if (MedianWithin(below, above, D))
+                        break;
+                }
+            }
+            x[k] = (i < D) ? 0 : Median(bucket_values, D, &seed);
+        }
+
+        free(bucket_values);
+    }
+    return ok;
+}
+
+/*
+ * Writes the explicit N by D column-major neighbors matrix (values between 1
+ * and M, the layout of matrix.neighbors) of the implicit matrix.
+ */
+void CountMinNeighbors(const countmin_hash_t *h, unsigned int *neighbors)
+{
+    sketch_index_t col, N = h->N;
+    int i, D = h->D;
+    unsigned int *rows;
+    countmin_term_t *vals = CountMinAllocTerms(D, &rows);
+
+    CountMinStart(h, vals);
+
+    for (col = 0; col < N; col++)
+    {
+        CountMinNext(h, vals, rows);
+        for (i = 0; i < D; i++)
+            neighbors[col + (size_t) N * i] = rows[i] + 1;
+    }
+
+    free(vals);
+}
+
+#endif  /* COUNTMIN_H */
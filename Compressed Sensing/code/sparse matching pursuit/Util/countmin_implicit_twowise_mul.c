@@ -7,29 +7,36 @@
 #include <string.h>
 #include "mex.h"
 #include "matrix.h"
+#include "countmin.h"
+#include "mexutil.h"
 
-/* Arguments: N, M, D, B, Ps, As, Bs, x */
+/* Arguments: N, M, D, B, Ps, As, Bs, x  or  N, M, D, B, Ps, As, Bs, idx, vals
+ * x can be a Matlab sparse vector; idx (uint32, 1-based) and vals give the
+ * nonzeros of x directly. For sparse inputs only the nonzero columns are
+ * hashed. x can also be an N by R block of R signals; y is then M by R. A
+ * single or int32 vector x gives y of the same class. */
 /* mexFunction is the gateway routine for the MEX-file. */ 
 void
 mexFunction(int nlhs, mxArray *plhs[],
             int nrhs, const mxArray *prhs[])
 {
-    int N, M, D, B, i;
-    const unsigned int *Ps, *As, *Bs;
-    const double *x;
-    double *y;
-    int col;
-    unsigned int vals[128];
+    sketch_index_t N;
+    int M, D, B, i, sparse, R = 1, value_class;
+    countmin_term_t *Ps, *As, *Bs;
+    countmin_hash_t hash;
+    size_t K = 0, *idx = NULL;
+    const double *vals = NULL;
 
-    if (nrhs != 8 && nlhs != 1)
-        mexErrMsgTxt("Usage: y = countmin_implicit_twowise_mul(N, M, D, B, Ps, As, Bs, x)");
+    if (nrhs != 8 && nrhs != 9)
+        mexErrMsgTxt("Usage: y = countmin_implicit_twowise_mul(N, M, D, B, Ps, As, Bs, x)\n"
+                     "   or: y = countmin_implicit_twowise_mul(N, M, D, B, Ps, As, Bs, idx, vals)");
 
     for (i = 0; i < 4; i++)
         if (!mxIsDouble(prhs[i]) || mxIsComplex(prhs[i]) ||
             mxGetNumberOfElements(prhs[i]) != 1)
             mexErrMsgTxt("First four arguments should be real scalars.");
 
-    N = (int) (mxGetScalar(prhs[0]) + 0.1);
+    N = (sketch_index_t) (mxGetScalar(prhs[0]) + 0.1);
     M = (int) (mxGetScalar(prhs[1]) + 0.1);
     D = (int) (mxGetScalar(prhs[2]) + 0.1);
     B = (int) (mxGetScalar(prhs[3]) + 0.1);
@@ -37,56 +44,54 @@ mexFunction(int nlhs, mxArray *plhs[],
     if (B*D > M)
         mexErrMsgTxt("D*B should be at most M");
 
-    if (D >= 128)
-        mexErrMsgTxt("D should be less than 128");
+    Ps = GetHashParameters(prhs[4], D);
+    As = GetHashParameters(prhs[5], D);
+    Bs = GetHashParameters(prhs[6], D);
+    if (!Ps || !As || !Bs)
+        mexErrMsgTxt("Ps, As, Bs must be uint32 or uint64 vectors of size D.");
 
-    for (i = 4; i <= 6; i++)
-        if (!mxIsClass(prhs[i], "uint32") || mxGetNumberOfElements(prhs[i]) != D)
-            mexErrMsgTxt("Ps, As, Bs must be uint32 vectors of size D.");
-
-    Ps = (const unsigned int *) mxGetData(prhs[4]);
-    As = (const unsigned int *) mxGetData(prhs[5]);
-    Bs = (const unsigned int *) mxGetData(prhs[6]);
-
-    if (!mxIsDouble(prhs[7]) || mxIsComplex(prhs[7]) || mxGetNumberOfElements(prhs[7]) != N)
-        mexErrMsgTxt("x must be a real vector of size N.");
-
-    x = mxGetPr(prhs[7]);
+    sparse = (nrhs == 9 || mxIsSparse(prhs[7]));
+    value_class = sparse ? VALUE_DOUBLE : GetValueClass(prhs[7], N);
+    if (value_class == VALUE_SINGLE || value_class == VALUE_INT32)
+        R = 1;
+    else if (sparse)
+    {
+        if (!GetSparseVector(prhs[7], nrhs == 9 ? prhs[8] : NULL, N, &K, &idx, &vals))
+            mexErrMsgTxt("x must be a sparse real Nx1 vector, or idx (uint32, between 1 and N) and vals real vectors of the same size.");
+    }
+    else if (!(R = GetBlockColumns(prhs[7], N)))
+        mexErrMsgTxt("x must be a real vector of size N (or an N by R matrix).");
 
-    plhs[0] = mxCreateDoubleMatrix(M, 1, mxREAL);
-    y = mxGetPr(plhs[0]);
+    for (i = 0; i < D; i++)
+        if (Ps[i] > COUNTMIN_MAX_PRIME)
+            mexErrMsgTxt("Ps should be at most " COUNTMIN_MAX_PRIME_TEXT ".");
 
-    /* At each column we want to compute
-         pos = (int) (((long long) As[i] * (col+1) + Bs[i]) % Ps[i] % B);
+    if (!CountMinCreate(&hash, N, M, D, B, Ps, As, Bs))
+        mexErrMsgTxt("Invalid hash parameters.");
+    mxFree(Ps);
+    mxFree(As);
+    mxFree(Bs);
 
-       To speed this up, we mainain the (((long long) As[i] * (col+1) + Bs[i]) %
-       Ps[i] terms, and just add As[i] at each step.
-     */
-    for (i = 0; i < D; i++) 
+    plhs[0] = CreateValueMatrix(M, R, R == 1 ? value_class : VALUE_DOUBLE);
+    if (value_class == VALUE_SINGLE)
+        CountMinMulFloat(&hash, (const float *) mxGetData(prhs[7]), (float *) mxGetData(plhs[0]));
+    else if (value_class == VALUE_INT32)
+        CountMinMulInt32(&hash, (const int *) mxGetData(prhs[7]), (int *) mxGetData(plhs[0]));
+    else if (sparse)
     {
-        vals[i] = Bs[i];
-        /* Impose a 2 billion limit on the P primes, so we won't overflow. */
-        if (Ps[i] > 2000000000)
-            mexErrMsgTxt("Ps should be less than 2 billion.");
+        CountMinMulSparse(&hash, K, idx, vals, mxGetPr(plhs[0]));
+        mxFree(idx);
     }
-
-    for (col = 0; col < N; col++)
+    else if (R == 1)
+        CountMinMul(&hash, mxGetPr(prhs[7]), mxGetPr(plhs[0]));
+    else
     {
-        double val = x[col];
-        if (val > -1e-10 && val < 1e-10)
-        {
-            /* Update vals */
-            for (i = 0; i < D; i++)
-                vals[i] = (vals[i] + As[i]) % Ps[i];
-            continue;  /* zero vector entry */
-        }
-        for (i = 0; i < D; i++)
-        {
-            int pos;
-            vals[i] = (vals[i] + As[i]) % Ps[i];
-            /* pos = (int) (((long long) As[i] * (col+1) + Bs[i]) % Ps[i] % B); */
-            pos = vals[i] % B;
-            y[i*B + pos] += val;
-        }
+        double *x = InterleavedCopy(prhs[7], N, R);
+        double *y = (double *) mxMalloc((size_t) M * R * sizeof(double));
+        CountMinMulBatch(&hash, R, x, y);
+        SetFromInterleaved(plhs[0], y);
+        mxFree(x);
     }
+
+    CountMinDestroy(&hash);
 }
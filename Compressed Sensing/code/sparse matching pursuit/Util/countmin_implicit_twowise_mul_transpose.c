@@ -7,29 +7,34 @@
 #include <string.h>
 #include "mex.h"
 #include "matrix.h"
+#include "countmin.h"
+#include "mexutil.h"
 
-/* Arguments: N, M, D, B, Ps, As, Bs, x */
+/* Arguments: N, M, D, B, Ps, As, Bs, y [, idx]
+ * With idx (uint32, 1-based candidate indices) only x(idx) is computed and
+ * returned, as a vector of the size of idx. y can also be an M by R block of
+ * R sketches; x is then N by R. A single or int32 vector y (without idx)
+ * gives x of the same class. */
 /* mexFunction is the gateway routine for the MEX-file. */ 
 void
 mexFunction(int nlhs, mxArray *plhs[],
             int nrhs, const mxArray *prhs[])
 {
-    int N, M, D, B, i;
-    const unsigned int *Ps, *As, *Bs;
-    const double *x;
-    double *y;
-    int col;
-    unsigned int vals[128];
+    sketch_index_t N;
+    int M, D, B, i, R, value_class;
+    countmin_term_t *Ps, *As, *Bs;
+    countmin_hash_t hash;
+    size_t K = 0, *idx = NULL;
 
-    if (nrhs != 8 && nlhs != 1)
-        mexErrMsgTxt("Usage: y = countmin_implicit_twowise_mul(N, M, D, B, Ps, As, Bs, x)");
+    if (nrhs != 8 && nrhs != 9)
+        mexErrMsgTxt("Usage: x = countmin_implicit_twowise_mul_transpose(N, M, D, B, Ps, As, Bs, y [, idx])");
 
     for (i = 0; i < 4; i++)
         if (!mxIsDouble(prhs[i]) || mxIsComplex(prhs[i]) ||
             mxGetNumberOfElements(prhs[i]) != 1)
             mexErrMsgTxt("First four arguments should be real scalars.");
 
-    N = (int) (mxGetScalar(prhs[0]) + 0.1);
+    N = (sketch_index_t) (mxGetScalar(prhs[0]) + 0.1);
     M = (int) (mxGetScalar(prhs[1]) + 0.1);
     D = (int) (mxGetScalar(prhs[2]) + 0.1);
     B = (int) (mxGetScalar(prhs[3]) + 0.1);
@@ -37,46 +42,61 @@ mexFunction(int nlhs, mxArray *plhs[],
     if (B*D > M)
         mexErrMsgTxt("D*B should be at most M");
 
-    if (D >= 128)
-        mexErrMsgTxt("D should be less than 128");
+    Ps = GetHashParameters(prhs[4], D);
+    As = GetHashParameters(prhs[5], D);
+    Bs = GetHashParameters(prhs[6], D);
+    if (!Ps || !As || !Bs)
+        mexErrMsgTxt("Ps, As, Bs must be uint32 or uint64 vectors of size D.");
 
-    for (i = 4; i <= 6; i++)
-        if (!mxIsClass(prhs[i], "uint32") || mxGetNumberOfElements(prhs[i]) != D)
-            mexErrMsgTxt("Ps, As, Bs must be uint32 vectors of size D.");
+    value_class = GetValueClass(prhs[7], M);
+    if ((value_class == VALUE_SINGLE || value_class == VALUE_INT32) && nrhs == 9)
+        mexErrMsgTxt("idx needs a double y.");
+    if (value_class == VALUE_SINGLE || value_class == VALUE_INT32)
+        R = 1;
+    else if (!(R = GetBlockColumns(prhs[7], M)) || (nrhs == 9 && R != 1))
+        mexErrMsgTxt("y must be a real vector of size M (or an M by R matrix without idx).");
 
-    Ps = (const unsigned int *) mxGetData(prhs[4]);
-    As = (const unsigned int *) mxGetData(prhs[5]);
-    Bs = (const unsigned int *) mxGetData(prhs[6]);
+    for (i = 0; i < D; i++)
+        if (Ps[i] > COUNTMIN_MAX_PRIME)
+            mexErrMsgTxt("Ps should be at most " COUNTMIN_MAX_PRIME_TEXT ".");
 
-    if (!mxIsDouble(prhs[7]) || mxIsComplex(prhs[7]) || mxGetNumberOfElements(prhs[7]) != M)
-        mexErrMsgTxt("x must be a real vector of size M.");
+    if (nrhs == 9 && !(idx = GetIndexList(prhs[8], N, &K)))
+        mexErrMsgTxt("idx must be a uint32 vector with values between 1 and N.");
 
-    x = mxGetPr(prhs[7]);
+    if (!CountMinCreate(&hash, N, M, D, B, Ps, As, Bs))
+        mexErrMsgTxt("Invalid hash parameters.");
+    mxFree(Ps);
+    mxFree(As);
+    mxFree(Bs);
 
-    plhs[0] = mxCreateDoubleMatrix(N, 1, mxREAL);
-    y = mxGetPr(plhs[0]);
-
-    /* At each column we want to compute
-         pos = (int) (((long long) As[i] * (col+1) + Bs[i]) % Ps[i] % B);
-
-       To speed this up, we mainain the (((long long) As[i] * (col+1) + Bs[i]) %
-       Ps[i] terms, and just add As[i] at each step.
-     */
-    for (i = 0; i < D; i++) 
+    if (idx)
+    {
+        plhs[0] = mxCreateDoubleMatrix(K, 1, mxREAL);
+        CountMinMulTransposeAt(&hash, mxGetPr(prhs[7]), K, idx, mxGetPr(plhs[0]));
+        mxFree(idx);
+    }
+    else if (R == 1)
+    {
+        /* A single or int32 y gives x of the same class */
+        plhs[0] = CreateValueMatrix(N, 1, value_class);
+        if (value_class == VALUE_SINGLE)
+            CountMinMulTransposeFloat(&hash, (const float *) mxGetData(prhs[7]),
+                                      (float *) mxGetData(plhs[0]));
+        else if (value_class == VALUE_INT32)
+            CountMinMulTransposeInt32(&hash, (const int *) mxGetData(prhs[7]),
+                                      (int *) mxGetData(plhs[0]));
+        else
+            CountMinMulTranspose(&hash, mxGetPr(prhs[7]), mxGetPr(plhs[0]));
+    }
+    else
     {
-        vals[i] = Bs[i];
-        /* Impose a 2 billion limit on the P primes, so we won't overflow. */
-        if (Ps[i] > 2000000000)
-            mexErrMsgTxt("Ps should be less than 2 billion.");
+        double *y = InterleavedCopy(prhs[7], M, R);
+        double *x = (double *) mxMalloc((size_t) N * R * sizeof(double));
+        plhs[0] = mxCreateDoubleMatrix(N, R, mxREAL);
+        CountMinMulTransposeBatch(&hash, R, y, x);
+        SetFromInterleaved(plhs[0], x);
+        mxFree(y);
     }
 
-    for (col = 0; col < N; col++)
-        for (i = 0; i < D; i++)
-        {
-            int pos;
-            vals[i] = (vals[i] + As[i]) % Ps[i];
-            /* pos = (int) (((long long) As[i] * (col+1) + Bs[i]) % Ps[i] % B); */
-            pos = vals[i] % B;
-            y[col] += x[i*B + pos];
-        }
+    CountMinDestroy(&hash);
 }
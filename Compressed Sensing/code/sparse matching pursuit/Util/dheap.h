@@ -0,0 +1,279 @@
+/*
+ * Indexed max heap on absolute values, used as the SSMP priority queue.
+ *
+ * Elements are indices between 1 and the capacity, each with a signed value;
+ * the top is the element with the largest absolute value. Compared to
+ * absvalheap.h:
+ *  - the heap is DHEAP_ARITY-ary, so it is about half as deep as a binary
+ *    heap, and the nodes are aligned so that the children of a node fill
+ *    exactly one 64 byte cache line;
+ *  - the nodes hold the signed value, so there is no separate sign array;
+ *    comparisons use the absolute value;
+ *  - sifting moves a hole instead of swapping, so each node on the path is
+ *    written once and position[] is written once per moved node;
+ *  - DHeapChangeValues applies a batch of updates, prefetching the positions
+ *    and nodes of the next updates while the current one is sifted.
+ *
+ * Based on minheap.h and absvalheap.h, written by Radu Berinde, Feb 2008
+ */
+
+#ifndef DHEAP_H
+#define DHEAP_H
+
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+#include "indices.h"
+
+#define DHEAP_ARITY 4
+
+/* How many updates ahead DHeapChangeValues prefetches */
+#define DHEAP_PREFETCH 8
+
+#ifdef __GNUC__
+#define DHeapPrefetch(p) __builtin_prefetch(p)
+#else
+#define DHeapPrefetch(p)
+#endif
+
+typedef struct dheap_node_t
+{
+    double          value;
+    sketch_index_t  index;
+} dheap_node_t;
+
+typedef struct dheap_t
+{
+    sketch_index_t  size;
+    sketch_index_t  capacity;
+    /* The heap, 0-based: the children of node p are nodes
+     * DHEAP_ARITY*p+1 .. DHEAP_ARITY*p+DHEAP_ARITY */
+    dheap_node_t    *nodes;
+    /* Position in heap of each element (nodes[position[i]].index = i), or -1
+     * if the element is not in the heap */
+    sketch_index_t  *position;
+    /* The allocation holding the nodes */
+    void            *arena;
+} dheap_t;
+
+/* One element to update with DHeapChangeValues */
+typedef struct dheap_update_t
+{
+    sketch_index_t  index;
+    double          value;
+} dheap_update_t;
+
+
+/* Creates an empty heap for indices 1..capacity. Returns 0 if the memory could
+ * not be allocated. */
+int DHeapCreate(dheap_t *heap, sketch_index_t capacity)
+{
+    sketch_index_t i;
+    size_t line = DHEAP_ARITY * sizeof(dheap_node_t);
+
+    heap->size = 0;
+    heap->capacity = capacity;
+    heap->arena = malloc(((size_t) capacity + 2 * DHEAP_ARITY) * sizeof(dheap_node_t));
+    heap->position = (sketch_index_t *) malloc(((size_t) capacity + 1) * sizeof(sketch_index_t));
+    if (!heap->arena || !heap->position)
+    {
+        free(heap->arena);
+        free(heap->position);
+        heap->arena = NULL;
+        heap->position = NULL;
+        return 0;
+    }
+
+    /* Child groups start at the nodes 1 mod DHEAP_ARITY; align nodes + 1 */
+    heap->nodes = (dheap_node_t *) (((size_t) heap->arena + sizeof(dheap_node_t) + line - 1)
+                                    / line * line) - 1;
+    for (i = 0; i <= capacity; i++)
+        heap->position[i] = -1;
+    return 1;
+}
+
+void DHeapDestroy(dheap_t *heap)
+{
+    free(heap->arena);
+    free(heap->position);
+}
+
+void DHeapClear(dheap_t *heap)
+{
+    sketch_index_t p;
+    for (p = 0; p < heap->size; p++)
+        heap->position[heap->nodes[p].index] = -1;
+    heap->size = 0;
+}
+
+sketch_index_t DHeapSize(dheap_t *heap)
+{
+    return heap->size;
+}
+
+/* Puts node in the hole at pos and moves it up to its place */
+static void DHeapSiftUp(dheap_t *heap, sketch_index_t pos, dheap_node_t node)
+{
+    dheap_node_t *nodes = heap->nodes;
+    double key = fabs(node.value);
+
+    while (pos > 0)
+    {
+        sketch_index_t parent = (pos - 1) / DHEAP_ARITY;
+        if (fabs(nodes[parent].value) >= key)
+            break;
+        nodes[pos] = nodes[parent];
+        heap->position[nodes[pos].index] = pos;
+        pos = parent;
+    }
+    nodes[pos] = node;
+    heap->position[node.index] = pos;
+}
+
+/* Puts node in the hole at pos and moves it down to its place */
+static void DHeapSiftDown(dheap_t *heap, sketch_index_t pos, dheap_node_t node)
+{
+    dheap_node_t *nodes = heap->nodes;
+    double key = fabs(node.value);
+    sketch_index_t size = heap->size;
+
+    for (;;)
+    {
+        sketch_index_t first = DHEAP_ARITY * pos + 1, last, best, c;
+        double best_key;
+
+        if (first >= size)
+            break;
+        last = (first + DHEAP_ARITY < size) ? first + DHEAP_ARITY : size;
+        best = first;
+        best_key = fabs(nodes[first].value);
+        for (c = first + 1; c < last; c++)
+        {
+            double k = fabs(nodes[c].value);
+            if (k > best_key)
+            {
+                best_key = k;
+                best = c;
+            }
+        }
+        if (best_key <= key)
+            break;
+        nodes[pos] = nodes[best];
+        heap->position[nodes[pos].index] = pos;
+        pos = best;
+    }
+    nodes[pos] = node;
+    heap->position[node.index] = pos;
+}
+
+/* Creates a heap of elements 1 to n with given values[1..n] */
+void DHeapBuild(dheap_t *heap, sketch_index_t n, const double *values)
+{
+    sketch_index_t i, p;
+    assert(n <= heap->capacity);
+
+    DHeapClear(heap);
+    heap->size = n;
+    for (i = 1; i <= n; i++)
+    {
+        heap->nodes[i-1].value = values[i];
+        heap->nodes[i-1].index = i;
+        heap->position[i] = i-1;
+    }
+    for (p = (n - 2) / DHEAP_ARITY; p >= 0 && n > 1; p--)
+        DHeapSiftDown(heap, p, heap->nodes[p]);
+}
+
+/* Argument index can be any integer between 0 and heap capacity, as long as
+ * there is no other node with this index already inserted */
+void DHeapAdd(dheap_t *heap, sketch_index_t index, double value)
+{
+    dheap_node_t node;
+    assert(heap->size < heap->capacity);
+    assert(index >= 0 && index <= heap->capacity);
+    assert(heap->position[index] < 0);
+
+    node.value = value;
+    node.index = index;
+    DHeapSiftUp(heap, heap->size++, node);
+}
+
+/* Retrieves the index and value of the top element. Returns 0 if the heap is
+ * empty. */
+int DHeapGetTop(dheap_t *heap, sketch_index_t *index, double *value)
+{
+    if (!heap->size)
+        return 0;
+    *index = heap->nodes[0].index;
+    *value = heap->nodes[0].value;
+    return 1;
+}
+
+/* Removes the top element from the heap */
+void DHeapRemoveTop(dheap_t *heap)
+{
+    assert(heap->size > 0);
+
+    heap->position[heap->nodes[0].index] = -1;
+    heap->size--;
+    if (heap->size > 0)
+        DHeapSiftDown(heap, 0, heap->nodes[heap->size]);
+}
+
+/* Returns 0 if no element with given index exists in the heap */
+int DHeapGetValue(dheap_t *heap, sketch_index_t index, double *value)
+{
+    sketch_index_t pos;
+    assert(index >= 0 && index <= heap->capacity);
+
+    pos = heap->position[index];
+    if (pos < 0)
+        return 0;
+    assert(heap->nodes[pos].index == index);
+
+    *value = heap->nodes[pos].value;
+    return 1;
+}
+
+void DHeapChangeValue(dheap_t *heap, sketch_index_t index, double value)
+{
+    dheap_node_t node;
+    sketch_index_t pos;
+
+    assert(index >= 0 && index <= heap->capacity);
+    pos = heap->position[index];
+    assert(pos >= 0 && pos < heap->size);
+    assert(heap->nodes[pos].index == index);
+
+    node.value = value;
+    node.index = index;
+    if (fabs(value) > fabs(heap->nodes[pos].value))
+        DHeapSiftUp(heap, pos, node);
+    else
+        DHeapSiftDown(heap, pos, node);
+}
+
+/*
+ * Applies count value changes, in order (the result is the same as calling
+ * DHeapChangeValue for each of them). The position of the element
+ * DHEAP_PREFETCH updates ahead is prefetched, and so is its node once its
+ * position is known.
+ */
+void DHeapChangeValues(dheap_t *heap, sketch_index_t count, const dheap_update_t *updates)
+{
+    sketch_index_t t;
+
+    for (t = 0; t < count && t < DHEAP_PREFETCH; t++)
+        DHeapPrefetch(&heap->position[updates[t].index]);
+
+    for (t = 0; t < count; t++)
+    {
+        if (t + DHEAP_PREFETCH < count)
+            DHeapPrefetch(&heap->position[updates[t + DHEAP_PREFETCH].index]);
+        if (t + DHEAP_PREFETCH / 2 < count)
+            DHeapPrefetch(&heap->nodes[heap->position[updates[t + DHEAP_PREFETCH / 2].index]]);
+        DHeapChangeValue(heap, updates[t].index, updates[t].value);
+    }
+}
+
+#endif  /* DHEAP_H */
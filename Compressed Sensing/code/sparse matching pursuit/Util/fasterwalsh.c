@@ -1,82 +1,66 @@
 /**
  * C implementation of Gylson Thomas' fastwalsh. It is actually the inverse walsh transform.
  * Use 
- *     fasterwalsh(x, bitrevorder(1:length(x))) ./ length(x) 
+ *     fasterwalsh(x) ./ length(x) 
  * for the forward transform.
  *
  * Use 
- *     fasterwalsh(x, bitrevorder(1:length(x))) 
+ *     fasterwalsh(x) 
  * for the inverse transform.
  *
+ * fasterwalsh(x) is the same as fasterwalsh(x, bitrevorder(1:length(x))); the
+ * bit reversal is built in. Another input permutation can still be given as
+ * the second argument. The transform itself is in fwht.h.
+ *
  * Written by Radu Berinde, MIT, Jan. 2008
  */
 
 #include <stdio.h>
 #include <string.h>
 #include "mex.h"
+#include "fwht.h"
 
 
 void
 mexFunction(int nlhs, mxArray *plhs[],
             int nrhs, const mxArray *prhs[])
 {
-    int N;
+    int N, i;
     double *data, *idx, *x;
 
-    if (nlhs != 1 || nrhs != 2 || !mxIsDouble (prhs[0]) || !mxIsDouble (prhs[1]))
-        mexErrMsgTxt ("Usage: y = fastwalsh(x, idx)\n"
-                      "  where x is a vector and \n"
-                      "  idx is a permutation, for ordered transform use bitrevorder(1:length(x))");
+    if (nlhs > 1 || nrhs < 1 || nrhs > 2 || !mxIsDouble (prhs[0]) || (nrhs == 2 && !mxIsDouble (prhs[1])))
+        mexErrMsgTxt ("Usage: y = fasterwalsh(x [, idx])\n"
+                      "  where x is a vector whose length is a power of 2 and \n"
+                      "  idx is a permutation (by default bitrevorder(1:length(x)), the ordered transform)");
 
-    if (mxGetClassID(prhs[0]) != mxDOUBLE_CLASS || mxGetClassID(prhs[1]) != mxDOUBLE_CLASS)
+    if (mxIsComplex(prhs[0]) || mxIsSparse(prhs[0]))
         mexErrMsgTxt("Vector data class should be double.");
 
     N = mxGetNumberOfElements(prhs[0]);
-    if (mxGetNumberOfElements(prhs[1]) != N)
+    if (nrhs == 2 && mxGetNumberOfElements(prhs[1]) != N)
         mexErrMsgTxt("The two vectors should have the same size!");
+    if (FWHTLog2(N) < 0)
+        mexErrMsgTxt("The length of x should be a power of 2.");
 
     data = mxGetPr(prhs[0]);
-    idx = mxGetPr(prhs[1]);
             
     plhs[0] = mxCreateDoubleMatrix(N, 1, mxREAL);
     x = mxGetPr(plhs[0]);
 
+    if (nrhs == 1)
     {
-        /* x = data(idx); */
-        int i;
-        for (i = 0; i < N; i++)
-            x[i] = data[((int) idx[i]) - 1];
+        FWHT(data, N, x);
+        return;
     }
+
+    /* x = data(idx); */
+    idx = mxGetPr(prhs[1]);
+    for (i = 0; i < N; i++)
     {
-        int L, L1, k1, k2, k3, i1, i2, i3;
-        L = 1;
-        while ((1 << L) < N) L++;
-        k1 = N, k2 = 1, k3 = N/2;
-        for (i1 = 1; i1 <= L; i1++)
-        {
-            L1 = 1;
-            for (i2 = 1; i2 <= k2; i2++)
-            {
-                for (i3 = 1; i3 <= k3; i3++)
-                {
-                    int i = i3 + L1 - 2;
-                    int j = i + k3;
-                    double temp1 = x[i],  temp2 = x[j];
-                    if (i2 % 2 == 0)
-                    {
-                        x[i] = temp1 - temp2;
-                        x[j] = temp1 + temp2;
-                    } else
-                    {
-                        x[i] = temp1 + temp2;
-                        x[j] = temp1 - temp2;
-                    }
-                }
-                L1 = L1 + k1;
-            }
-            k1 = k1/2;
-            k2 = k2*2;
-            k3 = k3/2;
-        }
+        int k = (int) idx[i];
+        if (k < 1 || k > N)
+            mexErrMsgTxt("idx should have values between 1 and length(x).");
+        x[i] = data[k - 1];
     }
+    FWHTInPlace(x, N);
 }
@@ -0,0 +1,249 @@
+/*
+ * Fast Walsh-Hadamard transform engine used by fasterwalsh.c.
+ *
+ * Computes the same transform as the original fasterwalsh loop (Gylson
+ * Thomas' fastwalsh), bit for bit: log2(N) butterfly stages where the group
+ * size halves at each stage, and the outputs of the odd groups are swapped.
+ *
+ * Two consecutive stages are fused into one radix-4 pass, so the data is
+ * read and written half as many times. The passes with groups larger than
+ * FWHT_BLOCK_SIZE stream over the whole vector; after that, each block of
+ * FWHT_BLOCK_SIZE values goes through all its remaining stages while it is
+ * in cache. The inner loops are contiguous and branch-free, so the compiler
+ * vectorizes them (e.g. with AVX2 when compiling with -mavx2 or
+ * -march=native). With OpenMP, vectors of at least FWHT_PARALLEL_MIN values
+ * are processed by several threads.
+ *
+ * Based on fasterwalsh.c, written by Radu Berinde, MIT, Jan. 2008
+ */
+
+#ifndef FWHT_H
+#define FWHT_H
+
+#include "parallel.h"
+
+/* Values per cache block (128 KB of doubles); must be a power of 4 */
+#define FWHT_BLOCK_SIZE 16384
+
+/* Smallest vector length processed with several threads */
+#define FWHT_PARALLEL_MIN (1 << 20)
+
+/* Columns per work unit in the streaming passes */
+#define FWHT_CHUNK 4096
+
+
+/* Returns L such that N = 2^L, or -1 if N is not a power of 2 */
+int FWHTLog2(int N)
+{
+    int L = 0;
+    if (N <= 0 || (N & (N - 1)))
+        return -1;
+    while ((1 << L) < N)
+        L++;
+    return L;
+}
+
+/* Reverses the lowest L bits of i */
+unsigned int FWHTBitReverse(unsigned int i, int L)
+{
+    unsigned int r = 0;
+    int b;
+    for (b = 0; b < L; b++, i >>= 1)
+        r = (r << 1) | (i & 1);
+    return r;
+}
+
+/* The bit reversal works on tiles of 2^FWHT_TILE_BITS by 2^FWHT_TILE_BITS */
+#define FWHT_TILE_BITS 5
+
+/*
+ * x = data(perm(bitrevorder(1:N))), i.e. x[i] = data[perm[reverse of the L
+ * bits of i] - 1], where perm is a permutation of 1..N (values between 1 and N)
+ * or NULL for the identity.
+ *
+ * Writing i as (a, m, b) (high, middle and low FWHT_TILE_BITS bits), the
+ * reverse is (rev(b), rev(m), rev(a)). For each m, the tile of all (a, b)
+ * is gathered into a small buffer with reads that are contiguous in a, then
+ * written out contiguously in b, so every cache line is used fully.
+ */
+void FWHTPermuteGather(const double *data, int N, const unsigned int *perm, double *x)
+{
+    int L = FWHTLog2(N), H = FWHT_TILE_BITS, T = 1 << FWHT_TILE_BITS;
+    int m, num_middle;
+    unsigned int rev[1 << FWHT_TILE_BITS];
+
+    if (L < 2 * H)
+    {
+        unsigned int i;
+        for (i = 0; i < (unsigned int) N; i++)
+        {
+            unsigned int r = FWHTBitReverse(i, L);
+            x[i] = data[perm ? perm[r] - 1 : r];
+        }
+        return;
+    }
+
+    for (m = 0; m < T; m++)
+        rev[m] = FWHTBitReverse(m, H);
+    num_middle = 1 << (L - 2 * H);
+
+#pragma omp parallel for schedule(static) if (N >= FWHT_PARALLEL_MIN)
+    for (m = 0; m < num_middle; m++)
+    {
+        double tile[1 << (2 * FWHT_TILE_BITS)];
+        size_t middle = (size_t) m << H;
+        size_t rev_middle = (size_t) FWHTBitReverse(m, L - 2 * H) << H;
+        int a, b;
+
+        for (b = 0; b < T; b++)
+        {
+            size_t src = ((size_t) rev[b] << (L - H)) + rev_middle;
+            if (perm)
+                for (a = 0; a < T; a++)
+                    tile[b * T + a] = data[perm[src + rev[a]] - 1];
+            else
+                for (a = 0; a < T; a++)
+                    tile[b * T + a] = data[src + rev[a]];
+        }
+        for (a = 0; a < T; a++)
+        {
+            double *dst = x + ((size_t) a << (L - H)) + middle;
+            for (b = 0; b < T; b++)
+                dst[b] = tile[b * T + a];
+        }
+    }
+}
+
+/* x = data(bitrevorder(1:N)) */
+void FWHTBitReversePermute(const double *data, int N, double *x)
+{
+    FWHTPermuteGather(data, N, NULL, x);
+}
+
+/* One stage on positions [t0, t1) of each half of a group of size 2*h */
+static void FWHTRadix2(double *x, int h, int odd, int t0, int t1)
+{
+    double *x0 = x, *x1 = x + h;
+    int t;
+    if (odd)
+        for (t = t0; t < t1; t++)
+        {
+            double a = x0[t], b = x1[t];
+            x0[t] = a - b;
+            x1[t] = a + b;
+        }
+    else
+        for (t = t0; t < t1; t++)
+        {
+            double a = x0[t], b = x1[t];
+            x0[t] = a + b;
+            x1[t] = a - b;
+        }
+}
+
+/*
+ * Two stages on positions [t0, t1) of each quarter of a group of size 4*q.
+ * The first stage works on the whole group (parity odd); the second one on
+ * its two halves, which are an even and an odd group.
+ */
+static void FWHTRadix4(double *x, int q, int odd, int t0, int t1)
+{
+    double *x0 = x, *x1 = x + q, *x2 = x + 2*q, *x3 = x + 3*q;
+    int t;
+    if (odd)
+        for (t = t0; t < t1; t++)
+        {
+            double a = x0[t], b = x1[t], c = x2[t], d = x3[t];
+            double u0 = a + c, u1 = b + d, v0 = a - c, v1 = b - d;
+            x0[t] = v0 + v1;
+            x1[t] = v0 - v1;
+            x2[t] = u0 - u1;
+            x3[t] = u0 + u1;
+        }
+    else
+        for (t = t0; t < t1; t++)
+        {
+            double a = x0[t], b = x1[t], c = x2[t], d = x3[t];
+            double u0 = a + c, u1 = b + d, v0 = a - c, v1 = b - d;
+            x0[t] = u0 + u1;
+            x1[t] = u0 - u1;
+            x2[t] = v0 - v1;
+            x3[t] = v0 + v1;
+        }
+}
+
+/* All the stages of a group of n values with the given parity, in place */
+static void FWHTBlock(double *x, int n, int odd)
+{
+    int k1 = n, groups = 1, g;
+
+    if (FWHTLog2(n) % 2)
+    {
+        FWHTRadix2(x, n / 2, odd, 0, n / 2);
+        k1 /= 2;
+        groups *= 2;
+    }
+    for (; k1 >= 4; k1 /= 4, groups *= 4)
+        for (g = 0; g < groups; g++)
+            FWHTRadix4(x + g * k1, k1 / 4, (groups == 1) ? odd : (g & 1), 0, k1 / 4);
+}
+
+/*
+ * Stages on groups of size k1 (a radix-2 stage if radix2, a radix-4 pass
+ * otherwise) over the whole vector, split in chunks of positions.
+ */
+static void FWHTStreamPass(double *x, int N, int k1, int radix2)
+{
+    int groups = N / k1, part = radix2 ? k1 / 2 : k1 / 4;
+    int chunks = (part + FWHT_CHUNK - 1) / FWHT_CHUNK, unit;
+
+#pragma omp parallel for schedule(static) if (N >= FWHT_PARALLEL_MIN)
+    for (unit = 0; unit < groups * chunks; unit++)
+    {
+        int g = unit / chunks, t0 = (unit % chunks) * FWHT_CHUNK;
+        int t1 = (t0 + FWHT_CHUNK < part) ? t0 + FWHT_CHUNK : part;
+        if (radix2)
+            FWHTRadix2(x + (size_t) g * k1, part, g & 1, t0, t1);
+        else
+            FWHTRadix4(x + (size_t) g * k1, part, g & 1, t0, t1);
+    }
+}
+
+/* In place transform of x (N must be a power of 2) */
+void FWHTInPlace(double *x, int N)
+{
+    int k1 = N, block, num_blocks;
+
+    if (N <= FWHT_BLOCK_SIZE)
+    {
+        FWHTBlock(x, N, 0);
+        return;
+    }
+
+    /* Streaming passes until the groups fit in a block */
+    if (FWHTLog2(N) % 2)
+    {
+        FWHTStreamPass(x, N, k1, 1);
+        k1 /= 2;
+    }
+    for (; k1 > FWHT_BLOCK_SIZE; k1 /= 4)
+        FWHTStreamPass(x, N, k1, 0);
+
+    /* Block i is group i of the stage with groups of FWHT_BLOCK_SIZE values */
+    num_blocks = N / FWHT_BLOCK_SIZE;
+#pragma omp parallel for schedule(static) if (N >= FWHT_PARALLEL_MIN)
+    for (block = 0; block < num_blocks; block++)
+        FWHTBlock(x + (size_t) block * FWHT_BLOCK_SIZE, FWHT_BLOCK_SIZE, block & 1);
+}
+
+/*
+ * x = fasterwalsh(data, bitrevorder(1:N)) (see fasterwalsh.c); N must be a
+ * power of 2.
+ */
+void FWHT(const double *data, int N, double *x)
+{
+    FWHTBitReversePermute(data, N, x);
+    FWHTInPlace(x, N);
+}
+
+#endif  /* FWHT_H */
@@ -0,0 +1,380 @@
+/*
+ * Graph files: the arrays of a bipartite graph (see bipartite.h) stored on
+ * disk the way GraphBuild lays them out in memory, so that a graph can be
+ * memory-mapped and used right away, even if it does not fit in memory.
+ *
+ * Layout (native byte order):
+ *   graph_file_header_t         64 bytes
+ *   right_start[M+1]            sketch_offset_t   } if has_right
+ *   right[N*D]                  sketch_column_t   }
+ *   left[N*D]                   sketch_bucket_t
+ * The header records the sizes of the index types, so the files of the
+ * large-scale build (see indices.h) are rejected by the default build and
+ * vice versa.
+ *
+ * GraphFileBuild writes a file out of core, from the neighbors matrix stored
+ * in a binary file, within a memory budget; GraphFileWrite writes a graph
+ * built in memory. GraphFileMap maps a file as a read-only graph that all the
+ * kernels of bipartite.h accept.
+ *
+ * The streamed kernels go through a graph in chunks of about GRAPH_FILE_CHUNK
+ * bytes of adjacency. For a mapped graph, the next chunk is prefetched while
+ * the current one is processed and the finished chunks are released, so the
+ * file is read sequentially and the resident set stays bounded.
+ */
+
+#ifndef GRAPHFILE_H
+#define GRAPHFILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bipartite.h"
+
+#define GRAPH_FILE_MAGIC "SMPGRAPH"
+#define GRAPH_FILE_VERSION 1
+
+/* Adjacency bytes per chunk of the streamed kernels */
+#ifndef GRAPH_FILE_CHUNK
+#define GRAPH_FILE_CHUNK (64 << 20)
+#endif
+
+typedef struct graph_file_header_t
+{
+    char magic[8];
+    unsigned int version;
+    /* sizeof(sketch_offset_t), sizeof(sketch_column_t), sizeof(sketch_bucket_t) */
+    unsigned int offset_bytes, column_bytes, bucket_bytes;
+    unsigned long long N;
+    unsigned int M, D;
+    unsigned int has_right;
+    unsigned char reserved[20];
+} graph_file_header_t;
+
+#ifdef _WIN32
+#define GraphFileSeek(f, offset) _fseeki64(f, (long long) (offset), SEEK_SET)
+#else
+#define GraphFileSeek(f, offset) fseeko(f, (off_t) (offset), SEEK_SET)
+#endif
+
+
+static void GraphFileHeader(graph_file_header_t *h, sketch_index_t N, int M, int D,
+                            int has_right)
+{
+    memset(h, 0, sizeof(graph_file_header_t));
+    memcpy(h->magic, GRAPH_FILE_MAGIC, 8);
+    h->version = GRAPH_FILE_VERSION;
+    h->offset_bytes = sizeof(sketch_offset_t);
+    h->column_bytes = sizeof(sketch_column_t);
+    h->bucket_bytes = sizeof(sketch_bucket_t);
+    h->N = N;
+    h->M = M;
+    h->D = D;
+    h->has_right = has_right;
+}
+
+/* Offsets of the arrays in a file */
+#define GraphFileRightOffset(M) \
+    (sizeof(graph_file_header_t) + ((size_t) (M) + 1) * sizeof(sketch_offset_t))
+#define GraphFileLeftOffset(M, ND) \
+    (GraphFileRightOffset(M) + (size_t) (ND) * sizeof(sketch_column_t))
+
+/*
+ * Writes graph g (built in memory) to path. Returns 0 on failure.
+ */
+int GraphFileWrite(const char *path, const bipartite_graph_t *g)
+{
+    graph_file_header_t h;
+    size_t ND = (size_t) g->N * g->D;
+    FILE *f = fopen(path, "wb");
+    int ok;
+
+    if (!f)
+        return 0;
+    GraphFileHeader(&h, g->N, g->M, g->D, g->right_start != NULL);
+    ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    if (g->right_start)
+        ok = ok &&
+             fwrite(g->right_start, sizeof(sketch_offset_t), g->M + 1, f) == (size_t) g->M + 1 &&
+             fwrite(g->right, sizeof(sketch_column_t), ND, f) == ND;
+    ok = ok && fwrite(g->left, sizeof(sketch_bucket_t), ND, f) == ND;
+    return (fclose(f) == 0) && ok;
+}
+
+/*
+ * Builds the graph file (with the right adjacency) of the N by D column-major
+ * matrix of neighbors (uint32 values between 1 and M) stored in the file
+ * neighbors_path, using about memory bytes (besides two arrays of M offsets).
+ * The left adjacency is written in one pass over the neighbors; the right
+ * adjacency is then written in slices of buckets that fit in the budget, each
+ * with one pass over the left adjacency. Returns 0 if a file could not be
+ * read or written, a neighbor is out of range or the memory could not be
+ * allocated.
+ */
+int GraphFileBuild(const char *path, const char *neighbors_path, sketch_index_t N,
+                   int M, int D, size_t memory)
+{
+    graph_file_header_t h;
+    size_t ND = (size_t) N * D, chunk, n, i, slice, count;
+    sketch_index_t start;
+    sketch_offset_t *starts = NULL, *pos = NULL;
+    unsigned int *column = NULL;
+    sketch_bucket_t *left = NULL;
+    sketch_column_t *right = NULL;
+    FILE *in, *out;
+    int j, k0, k1, ok;
+
+    if (N <= 0 || M <= 0 || D <= 0 || ND / D != (size_t) N || ND >= SKETCH_MAX_OFFSET)
+        return 0;
+    if (!(in = fopen(neighbors_path, "rb")))
+        return 0;
+    if (!(out = fopen(path, "w+b")))
+    {
+        fclose(in);
+        return 0;
+    }
+
+    /* A quarter of the budget for the left adjacency, half for the right */
+    chunk = memory / 4 / (D * sizeof(sketch_bucket_t));
+    if (chunk == 0)
+        chunk = 1;
+    slice = memory / 2 / sizeof(sketch_column_t);
+    if (slice == 0)
+        slice = 1;
+    starts = (sketch_offset_t *) calloc((size_t) M + 1, sizeof(sketch_offset_t));
+    pos = (sketch_offset_t *) malloc((size_t) M * sizeof(sketch_offset_t));
+    column = (unsigned int *) malloc(chunk * sizeof(unsigned int));
+    left = (sketch_bucket_t *) malloc(chunk * D * sizeof(sketch_bucket_t));
+    right = (sketch_column_t *) malloc(slice * sizeof(sketch_column_t));
+
+    GraphFileHeader(&h, N, M, D, 1);
+    ok = starts && pos && column && left && right && fwrite(&h, sizeof(h), 1, out) == 1;
+
+    /* Left adjacency (the transpose of chunks of the neighbors) and degrees */
+    for (start = 0; ok && start < N; start += n)
+    {
+        n = ((size_t) (N - start) < chunk) ? (size_t) (N - start) : chunk;
+        for (j = 0; ok && j < D; j++)
+        {
+            ok = !GraphFileSeek(in, ((size_t) N * j + start) * sizeof(unsigned int)) &&
+                 fread(column, sizeof(unsigned int), n, in) == n;
+            for (i = 0; ok && i < n; i++)
+            {
+                unsigned int v = column[i];
+                if (!(ok = v >= 1 && v <= (unsigned int) M))
+                    break;
+                left[i * D + j] = v - 1;
+                starts[v]++;
+            }
+        }
+        ok = ok && !GraphFileSeek(out, GraphFileLeftOffset(M, ND) +
+                                       (size_t) start * D * sizeof(sketch_bucket_t)) &&
+             fwrite(left, sizeof(sketch_bucket_t), n * D, out) == n * D;
+    }
+    if (ok)
+    {
+        /* starts[k+1] holds the degree of bucket k */
+        for (j = 0; j < M; j++)
+            starts[j+1] += starts[j];
+        ok = !GraphFileSeek(out, sizeof(graph_file_header_t)) &&
+             fwrite(starts, sizeof(sketch_offset_t), (size_t) M + 1, out) == (size_t) M + 1;
+    }
+
+    /* Right adjacency, one slice of buckets [k0, k1) at a time */
+    for (k0 = 0; ok && k0 < M; k0 = k1)
+    {
+        for (k1 = k0 + 1; k1 < M && starts[k1+1] - starts[k0] <= slice; k1++);
+        count = starts[k1] - starts[k0];
+        if (count > slice)
+        {
+            /* A single bucket larger than the budget */
+            sketch_column_t *larger =
+                (sketch_column_t *) realloc(right, count * sizeof(sketch_column_t));
+            if (!(ok = larger != NULL))
+                break;
+            right = larger;
+            slice = count;
+        }
+        memcpy(pos + k0, starts + k0, (size_t) (k1 - k0) * sizeof(sketch_offset_t));
+
+        for (start = 0; ok && start < N; start += n)
+        {
+            n = ((size_t) (N - start) < chunk) ? (size_t) (N - start) : chunk;
+            ok = !GraphFileSeek(out, GraphFileLeftOffset(M, ND) +
+                                     (size_t) start * D * sizeof(sketch_bucket_t)) &&
+                 fread(left, sizeof(sketch_bucket_t), n * D, out) == n * D;
+            for (i = 0; ok && i < n * D; i++)
+                if (left[i] >= (sketch_bucket_t) k0 && left[i] < (sketch_bucket_t) k1)
+                    right[pos[left[i]]++ - starts[k0]] = start + i / D;
+        }
+        ok = ok && !GraphFileSeek(out, GraphFileRightOffset(M) +
+                                       (size_t) starts[k0] * sizeof(sketch_column_t)) &&
+             fwrite(right, sizeof(sketch_column_t), count, out) == count;
+    }
+
+    free(starts);
+    free(pos);
+    free(column);
+    free(left);
+    free(right);
+    fclose(in);
+    return (fclose(out) == 0) && ok;
+}
+
+/* Returns 1 if the file at path starts like a graph file */
+int GraphFileIs(const char *path)
+{
+    char magic[8];
+    FILE *f = fopen(path, "rb");
+    int is = f && fread(magic, 8, 1, f) == 1 && !memcmp(magic, GRAPH_FILE_MAGIC, 8);
+    if (f)
+        fclose(f);
+    return is;
+}
+
+/*
+ * Maps the graph file at path as the read-only graph g (GraphDestroy unmaps
+ * it). Returns 0 if the file could not be mapped, is not a graph file of this
+ * version and build, or its size or right offsets are inconsistent. The
+ * neighbors themselves are not checked (they were when the file was written).
+ */
+int GraphFileMap(bipartite_graph_t *g, const char *path)
+{
+    const graph_file_header_t *h;
+    size_t size, ND, expected;
+    char *data;
+
+    memset(g, 0, sizeof(bipartite_graph_t));
+    if (!(data = (char *) MapFileRead(path, &size)))
+        return 0;
+    h = (const graph_file_header_t *) data;
+    if (size < sizeof(graph_file_header_t))
+    {
+        MapFileUnmap(data, size);
+        return 0;
+    }
+
+    ND = (size_t) h->N * h->D;
+    expected = sizeof(graph_file_header_t) + ND * sizeof(sketch_bucket_t);
+    if (h->has_right)
+        expected = GraphFileLeftOffset(h->M, ND) + ND * sizeof(sketch_bucket_t);
+    if (memcmp(h->magic, GRAPH_FILE_MAGIC, 8) ||
+        h->version != GRAPH_FILE_VERSION || h->offset_bytes != sizeof(sketch_offset_t) ||
+        h->column_bytes != sizeof(sketch_column_t) ||
+        h->bucket_bytes != sizeof(sketch_bucket_t) ||
+        h->N == 0 || (unsigned long long) (sketch_index_t) h->N != h->N ||
+        h->M == 0 || h->M > 0x7FFFFFFF || h->D == 0 || h->D > h->M ||
+        ND / h->D != h->N || size != expected)
+    {
+        MapFileUnmap(data, size);
+        return 0;
+    }
+
+    g->N = (sketch_index_t) h->N;
+    g->M = (int) h->M;
+    g->D = (int) h->D;
+    if (h->has_right)
+    {
+        g->right_start = (sketch_offset_t *) (data + sizeof(graph_file_header_t));
+        g->right = (sketch_column_t *) (data + GraphFileRightOffset(g->M));
+        g->left = (sketch_bucket_t *) (data + GraphFileLeftOffset(g->M, ND));
+        if (g->right_start[0] != 0 || g->right_start[g->M] != ND)
+        {
+            MapFileUnmap(data, size);
+            memset(g, 0, sizeof(bipartite_graph_t));
+            return 0;
+        }
+    }
+    else
+        g->left = (sketch_bucket_t *) (data + sizeof(graph_file_header_t));
+    g->arena = data;
+    g->mapped_size = size;
+    return 1;
+}
+
+
+/* Gives a hint for the bytes [begin, end) of the arrays of g, if it is mapped */
+static void GraphAdvise(const bipartite_graph_t *g, const void *begin, const void *end,
+                        int advice)
+{
+    if (g->mapped_size && (const char *) end > (const char *) begin)
+        MapFileAdvise(g->arena, (const char *) begin - (const char *) g->arena,
+                      (const char *) end - (const char *) begin, advice);
+}
+
+/* Last column (exclusive) of the streamed chunk starting at column first */
+static sketch_index_t GraphStreamColumns(const bipartite_graph_t *g, sketch_index_t first)
+{
+    sketch_index_t chunk = GRAPH_FILE_CHUNK / (g->D * sizeof(sketch_bucket_t));
+    if (chunk < 1)
+        chunk = 1;
+    return (g->N - first < chunk) ? g->N : first + chunk;
+}
+
+/* Last row (exclusive) of the streamed chunk starting at row first */
+static int GraphStreamRows(const bipartite_graph_t *g, int first)
+{
+    sketch_offset_t limit = GRAPH_FILE_CHUNK / sizeof(sketch_column_t);
+    int last = first + 1;
+    while (last < g->M && g->right_start[last+1] - g->right_start[first] <= limit)
+        last++;
+    return last;
+}
+
+/*
+ * Streamed versions of GraphMedianRecovery##S and GraphMul##S (for double,
+ * float and int values; see above), with the same results. The median
+ * recovery returns 0 if the workspace could not be allocated.
+ */
+#define DEFINE_GRAPH_STREAM_KERNELS(T, S)                                           \
+int GraphStreamMedianRecovery##S(const bipartite_graph_t *g, const T *y, T *x)      \
+{                                                                                   \
+    sketch_index_t first, last, next;                                               \
+    const sketch_bucket_t *left = g->left;                                          \
+    int D = g->D, ok = 1;                                                           \
+    parallel_progress_t progress;                                                   \
+                                                                                    \
+    ParallelProgressInit(&progress, 1000000);                                       \
+    GraphAdvise(g, left, left + (size_t) g->N * D, MAP_FILE_SEQUENTIAL);            \
+    last = GraphStreamColumns(g, 0);                                                \
+    GraphAdvise(g, left, left + (size_t) last * D, MAP_FILE_WILLNEED);              \
+    for (first = 0; ok && first < g->N; first = last, last = next)                  \
+    {                                                                               \
+        next = (last < g->N) ? GraphStreamColumns(g, last) : last;                  \
+        GraphAdvise(g, left + (size_t) last * D, left + (size_t) next * D,          \
+                    MAP_FILE_WILLNEED);                                             \
+        ok = GraphMedianRecoveryColumns##S(g, y, x + first, first, last,            \
+                                           &progress);                              \
+        GraphAdvise(g, left + (size_t) first * D, left + (size_t) last * D,         \
+                    MAP_FILE_DONTNEED);                                             \
+    }                                                                               \
+    return ok;                                                                      \
+}                                                                                   \
+                                                                                    \
+void GraphStreamMul##S(const bipartite_graph_t *g, const T *x, T *y)                \
+{                                                                                   \
+    int first, last, next;                                                          \
+    const sketch_column_t *right = g->right;                                        \
+    const sketch_offset_t *starts = g->right_start;                                 \
+                                                                                    \
+    GraphAdvise(g, right, right + starts[g->M], MAP_FILE_SEQUENTIAL);               \
+    last = GraphStreamRows(g, 0);                                                   \
+    GraphAdvise(g, right, right + starts[last], MAP_FILE_WILLNEED);                 \
+    for (first = 0; first < g->M; first = last, last = next)                        \
+    {                                                                               \
+        next = (last < g->M) ? GraphStreamRows(g, last) : last;                     \
+        GraphAdvise(g, right + starts[last], right + starts[next],                  \
+                    MAP_FILE_WILLNEED);                                             \
+        GraphMulRows##S(g, x, y + first, first, last);                              \
+        GraphAdvise(g, right + starts[first], right + starts[last],                 \
+                    MAP_FILE_DONTNEED);                                             \
+    }                                                                               \
+}
+
+DEFINE_GRAPH_STREAM_KERNELS(double, )
+DEFINE_GRAPH_STREAM_KERNELS(float, Float)
+DEFINE_GRAPH_STREAM_KERNELS(int, Int32)
+
+#undef DEFINE_GRAPH_STREAM_KERNELS
+
+#endif  /* GRAPHFILE_H */
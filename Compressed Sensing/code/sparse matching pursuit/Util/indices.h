@@ -0,0 +1,50 @@
+/*
+ * Index types of the kernels.
+ *
+ * By default signal (column) indices are ints and the edges of a bipartite
+ * graph are counted in 32 bits, which is what the Matlab code has always
+ * assumed. Defining SKETCH_LARGE (LARGE=1 in compile.sh) selects the
+ * large-scale build:
+ *  - signal indices, N and edge offsets are 64-bit, so N and N*D can exceed
+ *    2^31 and 2^32;
+ *  - the countmin hash terms are 64-bit, so the primes can be up to
+ *    COUNTMIN_MAX_PRIME (2^63) and the hash parameters can be uint64;
+ *  - the SSMP bucket positions are 32-bit, so D is only limited by memory.
+ * Bucket (row) ids stay 32-bit in both builds, which keeps the per-entry
+ * storage of the graphs compact; M must be below 2^31.
+ */
+
+#ifndef INDICES_H
+#define INDICES_H
+
+/* Bucket (row) id stored for each edge */
+typedef unsigned int sketch_bucket_t;
+
+#ifdef SKETCH_LARGE
+
+/* Signal (column) index or count */
+typedef long long sketch_index_t;
+/* Column id stored in the right lists of a graph */
+typedef unsigned long long sketch_column_t;
+/* Offset of an edge of a graph */
+typedef unsigned long long sketch_offset_t;
+/* Term of a countmin hash function and its parameters */
+typedef unsigned long long countmin_term_t;
+/* Position of a bucket in the sorted bucket values of an SSMP column */
+typedef unsigned int ssmp_rank_t;
+
+#define SKETCH_MAX_OFFSET 0xFFFFFFFFFFFFFFFFull
+
+#else
+
+typedef int sketch_index_t;
+typedef unsigned int sketch_column_t;
+typedef unsigned int sketch_offset_t;
+typedef unsigned int countmin_term_t;
+typedef unsigned short ssmp_rank_t;
+
+#define SKETCH_MAX_OFFSET 0xFFFFFFFFull
+
+#endif
+
+#endif  /* INDICES_H */
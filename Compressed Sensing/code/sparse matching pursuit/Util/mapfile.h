@@ -0,0 +1,109 @@
+/*
+ * Read-only memory mappings of whole files, with access-pattern hints.
+ *
+ * MapFileAdvise tells the kernel how a range of a mapping is about to be used:
+ *   MAP_FILE_SEQUENTIAL  read in order (more aggressive readahead)
+ *   MAP_FILE_WILLNEED    read soon (the pages are prefetched asynchronously)
+ *   MAP_FILE_DONTNEED    done with (the pages can leave the resident set; they
+ *                        are read from the file again if touched)
+ * The hints are only performance advice; on platforms without them (Windows)
+ * they do nothing.
+ */
+
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stddef.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define MAP_FILE_SEQUENTIAL 1
+#define MAP_FILE_WILLNEED   2
+#define MAP_FILE_DONTNEED   3
+
+/*
+ * Maps the file at path for reading. Returns its contents (valid until
+ * MapFileUnmap) and sets *size, or returns NULL if the file could not be
+ * opened or mapped (or is empty).
+ */
+void *MapFileRead(const char *path, size_t *size)
+{
+    void *data;
+#ifdef _WIN32
+    HANDLE file, mapping;
+    LARGE_INTEGER file_size;
+
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0 ||
+        (unsigned long long) file_size.QuadPart != (size_t) file_size.QuadPart)
+    {
+        CloseHandle(file);
+        return NULL;
+    }
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping)
+        return NULL;
+    data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    *size = (size_t) file_size.QuadPart;
+    return data;
+#else
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) || st.st_size == 0 ||
+        (unsigned long long) st.st_size != (size_t) st.st_size)
+    {
+        close(fd);
+        return NULL;
+    }
+    data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+    *size = (size_t) st.st_size;
+    return data;
+#endif
+}
+
+void MapFileUnmap(void *data, size_t size)
+{
+#ifdef _WIN32
+    (void) size;
+    UnmapViewOfFile(data);
+#else
+    munmap(data, size);
+#endif
+}
+
+/* Gives a hint (see above) for bytes [offset, offset + len) of a mapping */
+void MapFileAdvise(const void *data, size_t offset, size_t len, int advice)
+{
+#if defined(_WIN32) || !defined(MADV_WILLNEED)
+    (void) data; (void) offset; (void) len; (void) advice;
+#else
+    /* madvise needs a page-aligned start; the mapping itself is aligned */
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t start = offset - offset % page;
+    int flag = (advice == MAP_FILE_SEQUENTIAL) ? MADV_SEQUENTIAL :
+               (advice == MAP_FILE_WILLNEED) ? MADV_WILLNEED : MADV_DONTNEED;
+
+    if (len > 0)
+        madvise((char *) data + start, offset + len - start, flag);
+#endif
+}
+
+#endif  /* MAPFILE_H */
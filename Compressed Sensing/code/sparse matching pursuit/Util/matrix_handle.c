@@ -0,0 +1,562 @@
+/*
+ * Persistent measurement matrices. A matrix is created once, stays resident
+ * (with its derived indexes built) between calls and is referred to by a
+ * numeric handle.
+ *
+ * While any handle is alive the MEX file is locked, so "clear mex" does not
+ * invalidate the handles; destroy them to unlock it.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "mex.h"
+#include "matrix.h"
+#include "chunked.h"
+#include "smp.h"
+#include "stream.h"
+#include "mexutil.h"
+
+char* usage =
+"Usage: h = matrix_handle('create', N, M, D, neighbors)           explicit matrix\n"
+"       h = matrix_handle('create', N, M, D, B, Ps, As, Bs)       implicit countmin_twowise matrix\n"
+"       h = matrix_handle('map', path)                            explicit matrix mapped from a\n"
+"                                                                 graph file (see graphfile.h)\n"
+"       matrix_handle('save', h, path)                            writes the graph of the matrix\n"
+"                                                                 to a graph file\n"
+"       y = matrix_handle('mul', h, x)                            y = A*x (x can be sparse)\n"
+"       y = matrix_handle('mul', h, idx, vals)                    y = A*x, x(idx) = vals (idx uint32)\n"
+"       x = matrix_handle('mul_transpose', h, y)                  x = A'*y\n"
+"       x = matrix_handle('median', h, y)                         median recovery\n"
+"       x = matrix_handle('mul_transpose', h, y, idx)             x = (A'*y)(idx) (idx uint32)\n"
+"       x = matrix_handle('median', h, y, idx [, threshold])      median recovery at idx only; 0 where\n"
+"                                                                 |median| <= threshold is certain\n"
+"       x = matrix_handle('median', h, y, 'topk', K [, chunk])    the K largest medians (sparse)\n"
+"       matrix_handle('median', h, y, 'file', path [, chunk])     writes the medians to a file\n"
+"                                                                 (as doubles), chunk columns at\n"
+"                                                                 a time (see chunked.h)\n"
+"       x = matrix_handle('ssmp', h, y, inner_steps, outer_steps, sparsity [, batch])\n"
+"       x = matrix_handle('smp', h, b, l, T [, convergence_factor [, tolerance]])\n"
+"                                                                 SMP (see smp.m); x is sparse\n"
+"       matrix_handle('stream_update', h, idx, deltas)            x(idx) += deltas on the resident\n"
+"                                                                 streaming sketch (idx uint32)\n"
+"       y = matrix_handle('stream_snapshot', h)                   the streaming sketch A*x\n"
+"       matrix_handle('stream_reset', h)                          sets the streaming sketch to 0\n"
+"       matrix_handle('destroy', h)\n"
+"  For 'mul', 'mul_transpose' and 'median' (without idx), x or y can also be a\n"
+"  block of R columns; the result then has R columns. With batch > 1, SSMP\n"
+"  updates up to batch columns with disjoint buckets at once, in parallel.\n"
+"  A single or int32 vector x or y (without idx) gives a result of the same\n"
+"  class; 'ssmp' and 'smp' also take single or int32 sketches. The streaming\n"
+"  sketch starts at 0 and is updated by all the threads (see stream.h).\n"
+"  'mul' and 'median' stream through the file of a mapped matrix, so it does\n"
+"  not need to fit in memory.\n";
+
+
+/* Handle h refers to matrices[h-1]; free slots are NULL. streams[h-1] is the
+ * streaming sketch of the matrix, or NULL until the first update. */
+sketch_matrix_t **matrices = NULL;
+sketch_stream_t **streams = NULL;
+int num_matrices = 0, live_matrices = 0;
+
+void DestroyStream(int i)
+{
+    if (streams[i])
+    {
+        SketchStreamDestroy(streams[i]);
+        free(streams[i]);
+        streams[i] = NULL;
+    }
+}
+
+void DestroyAll()
+{
+    int i;
+    for (i = 0; i < num_matrices; i++)
+        if (matrices[i])
+        {
+            DestroyStream(i);
+            SketchMatrixDestroy(matrices[i]);
+            free(matrices[i]);
+        }
+    free(matrices);
+    free(streams);
+    matrices = NULL;
+    streams = NULL;
+    num_matrices = live_matrices = 0;
+}
+
+int AddMatrix(sketch_matrix_t *m)
+{
+    sketch_matrix_t **new_matrices;
+    sketch_stream_t **new_streams = NULL;
+    int i;
+    for (i = 0; i < num_matrices && matrices[i]; i++);
+    if (i == num_matrices)
+    {
+        /* On failure the tables keep their num_matrices entries and m is
+         * released */
+        new_matrices = (sketch_matrix_t **) realloc(matrices, (num_matrices + 1) * sizeof(sketch_matrix_t *));
+        if (new_matrices)
+        {
+            matrices = new_matrices;
+            new_streams = (sketch_stream_t **) realloc(streams, (num_matrices + 1) * sizeof(sketch_stream_t *));
+        }
+        if (!new_streams)
+        {
+            SketchMatrixDestroy(m);
+            free(m);
+            mexErrMsgTxt("Could not allocate the matrix handle.");
+        }
+        streams = new_streams;
+        num_matrices++;
+    }
+    matrices[i] = m;
+    streams[i] = NULL;
+    if (live_matrices++ == 0)
+        mexLock();
+    return i + 1;
+}
+
+sketch_matrix_t *GetMatrix(const mxArray *arg)
+{
+    int h;
+    if (!mxIsDouble(arg) || mxGetNumberOfElements(arg) != 1)
+        mexErrMsgTxt("The handle should be a real scalar.");
+    h = (int) (mxGetScalar(arg) + 0.1);
+    if (h < 1 || h > num_matrices || !matrices[h-1])
+        mexErrMsgTxt("Invalid matrix handle.");
+    return matrices[h-1];
+}
+
+/* The scalars fit in an int, except N in the large-scale build */
+sketch_index_t GetScalar(const mxArray *arg)
+{
+    if (!mxIsDouble(arg) || mxIsComplex(arg) || mxGetNumberOfElements(arg) != 1)
+        mexErrMsgTxt("N, M, D, B and the SSMP parameters should be real scalars.");
+    return (sketch_index_t) (mxGetScalar(arg) + 0.1);
+}
+
+const double *GetVector(const mxArray *arg, size_t size, const char *msg)
+{
+    if (!mxIsDouble(arg) || mxIsComplex(arg) || mxGetNumberOfElements(arg) != size)
+        mexErrMsgTxt(msg);
+    return mxGetPr(arg);
+}
+
+void ReportProgress(void *context, int out_step, int outer_steps)
+{
+    mexPrintf("Outer step %d out of %d..\n", out_step, outer_steps);
+    MatlabDrawNow();
+}
+
+void ReportSMPProgress(void *context, int iteration, int T)
+{
+    mexPrintf("SMP iteration %d\n", iteration);
+    MatlabDrawNow();
+}
+
+typedef void (*batch_operation_t)(const sketch_matrix_t *m, int R,
+                                  const double *in, double *out);
+
+/* Applies a batched operation to the in_rows by R block arg */
+void BatchOperation(const sketch_matrix_t *m, const mxArray *arg, size_t in_rows,
+                    size_t out_rows, batch_operation_t operation, mxArray *plhs[])
+{
+    int R = GetBlockColumns(arg, in_rows);
+    double *in = InterleavedCopy(arg, in_rows, R);
+    double *out = (double *) mxMalloc((size_t) out_rows * R * sizeof(double));
+
+    operation(m, R, in, out);
+    plhs[0] = mxCreateDoubleMatrix(out_rows, R, mxREAL);
+    SetFromInterleaved(plhs[0], out);
+    mxFree(in);
+}
+
+typedef void (*float_operation_t)(const sketch_matrix_t *m, const float *in, float *out);
+typedef void (*int32_operation_t)(const sketch_matrix_t *m, const int *in, int *out);
+
+/* The batched, float and int32 median recoveries, raising an error if their
+ * workspace could not be allocated */
+void MedianRecoveryBatch(const sketch_matrix_t *m, int R, const double *y, double *x)
+{
+    if (!SketchMatrixMedianRecoveryBatch(m, R, y, x))
+        mexErrMsgTxt("Out of memory.");
+}
+
+void MedianRecoveryFloat(const sketch_matrix_t *m, const float *y, float *x)
+{
+    if (!SketchMatrixMedianRecoveryFloat(m, y, x))
+        mexErrMsgTxt("Out of memory.");
+}
+
+void MedianRecoveryInt32(const sketch_matrix_t *m, const int *y, int *x)
+{
+    if (!SketchMatrixMedianRecoveryInt32(m, y, x))
+        mexErrMsgTxt("Out of memory.");
+}
+
+/*
+ * Applies the float or int32 version of an operation to arg if it is a single
+ * or int32 vector of in_rows elements (see GetValueClass); the result has the
+ * class of arg. Returns 0 (doing nothing) for other arguments.
+ */
+int TypedOperation(const sketch_matrix_t *m, const mxArray *arg, size_t in_rows, size_t out_rows,
+                   float_operation_t float_operation, int32_operation_t int32_operation,
+                   mxArray *plhs[])
+{
+    int value_class = GetValueClass(arg, in_rows);
+
+    if (value_class != VALUE_SINGLE && value_class != VALUE_INT32)
+        return 0;
+    plhs[0] = CreateValueMatrix(out_rows, 1, value_class);
+    if (value_class == VALUE_SINGLE)
+        float_operation(m, (const float *) mxGetData(arg), (float *) mxGetData(plhs[0]));
+    else
+        int32_operation(m, (const int *) mxGetData(arg), (int *) mxGetData(plhs[0]));
+    return 1;
+}
+
+void Create(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    sketch_index_t N;
+    int M, D, B;
+    countmin_term_t *Ps, *As, *Bs;
+    sketch_matrix_t *m;
+
+    if (nrhs != 5 && nrhs != 8)
+        mexErrMsgTxt(usage);
+
+    N = GetScalar(prhs[1]);
+    M = GetScalar(prhs[2]);
+    D = GetScalar(prhs[3]);
+
+    m = (sketch_matrix_t *) malloc(sizeof(sketch_matrix_t));
+    if (!m)
+        mexErrMsgTxt("Could not allocate the matrix.");
+
+    if (nrhs == 5)
+    {
+        if (!mxIsClass(prhs[4], "uint32") || mxGetNumberOfElements(prhs[4]) != (size_t) N * D)
+        {
+            free(m);
+            mexErrMsgTxt("neighbors must be a uint32 NxD matrix.");
+        }
+        if (!GraphNeighborsValid(N, M, D, (const unsigned int *) mxGetData(prhs[4])))
+        {
+            free(m);
+            mexErrMsgTxt("neighbors must be between 1 and M.");
+        }
+        if (!SketchMatrixCreateExplicit(m, N, M, D, (const unsigned int *) mxGetData(prhs[4])))
+        {
+            free(m);
+            mexErrMsgTxt("Out of memory, or N*D too large for this build.");
+        }
+    }
+    else
+    {
+        B = GetScalar(prhs[4]);
+        Ps = GetHashParameters(prhs[5], D);
+        As = GetHashParameters(prhs[6], D);
+        Bs = GetHashParameters(prhs[7], D);
+        if (!Ps || !As || !Bs)
+        {
+            free(m);
+            mexErrMsgTxt("Ps, As, Bs must be uint32 or uint64 vectors of size D.");
+        }
+        if (!SketchMatrixCreateImplicit(m, N, M, D, B, Ps, As, Bs))
+        {
+            free(m);
+            mexErrMsgTxt("Invalid hash parameters (D*B should be at most M, Ps at most "
+                         COUNTMIN_MAX_PRIME_TEXT ").");
+        }
+        mxFree(Ps);
+        mxFree(As);
+        mxFree(Bs);
+    }
+
+    plhs[0] = mxCreateDoubleScalar(AddMatrix(m));
+}
+
+/* x = matrix_handle('median', h, y, mode, ...), chunked (see usage) */
+void ChunkedMedian(sketch_matrix_t *m, int nrhs, const mxArray *prhs[], mxArray *plhs[])
+{
+    const double *y = GetVector(prhs[2], m->M, "y must be a real vector of size M.");
+    char path[4096];
+    size_t K, chunk;
+    median_topk_t topk;
+    FILE *f;
+    int mode, ok;
+
+    if (!(mode = GetChunkedOutput(nrhs - 3, prhs + 3, &K, path, sizeof(path), &chunk)))
+        mexErrMsgTxt(usage);
+    if (mode == CHUNKED_TOPK)
+    {
+        if (!MedianTopKCreate(&topk, K, chunk ? chunk : MEDIAN_CHUNK))
+            mexErrMsgTxt("Could not allocate the top K accumulator.");
+        ok = SketchMatrixMedianRecoveryChunked(m, y, chunk, MedianTopKAdd, &topk);
+        if (ok)
+            plhs[0] = CreateSparseColumn(m->N, topk.num, topk.idx, topk.vals);
+        MedianTopKDestroy(&topk);
+    }
+    else
+    {
+        ok = (f = fopen(path, "wb")) != NULL &&
+             SketchMatrixMedianRecoveryChunked(m, y, chunk, MedianFileAdd, f);
+        if (f && fclose(f))
+            ok = 0;
+    }
+    if (!ok)
+        mexErrMsgTxt("Out of memory, or could not write the file.");
+}
+
+void Map(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    char path[4096];
+    sketch_matrix_t *m;
+
+    if (nrhs != 2 || !mxIsChar(prhs[1]) || mxGetString(prhs[1], path, sizeof(path)))
+        mexErrMsgTxt(usage);
+
+    m = (sketch_matrix_t *) malloc(sizeof(sketch_matrix_t));
+    if (!m)
+        mexErrMsgTxt("Could not allocate the matrix.");
+    if (!SketchMatrixMapExplicit(m, path) || !m->graph.right_start)
+    {
+        if (m->has_graph)
+            SketchMatrixDestroy(m);
+        free(m);
+        mexErrMsgTxt("Could not map the graph file (missing, of another version or build, "
+                     "or without the right adjacency).");
+    }
+    plhs[0] = mxCreateDoubleScalar(AddMatrix(m));
+}
+
+void
+mexFunction(int nlhs, mxArray *plhs[],
+            int nrhs, const mxArray *prhs[])
+{
+    char command[32];
+    sketch_matrix_t *m;
+
+    if (nrhs < 2 || !mxIsChar(prhs[0]) || mxGetString(prhs[0], command, sizeof(command)))
+        mexErrMsgTxt(usage);
+
+    if (matrices == NULL)
+        mexAtExit(DestroyAll);
+
+    if (!strcmp(command, "create"))
+    {
+        Create(nlhs, plhs, nrhs, prhs);
+        return;
+    }
+    if (!strcmp(command, "map"))
+    {
+        Map(nlhs, plhs, nrhs, prhs);
+        return;
+    }
+
+    m = GetMatrix(prhs[1]);
+
+    if (!strcmp(command, "destroy"))
+    {
+        int h = (int) (mxGetScalar(prhs[1]) + 0.1);
+        DestroyStream(h-1);
+        SketchMatrixDestroy(m);
+        free(m);
+        matrices[h-1] = NULL;
+        if (--live_matrices == 0)
+            mexUnlock();
+    }
+    else if (!strcmp(command, "mul"))
+    {
+        const double *x;
+        if (nrhs != 3 && nrhs != 4)
+            mexErrMsgTxt(usage);
+        if (nrhs == 4 || mxIsSparse(prhs[2]))
+        {
+            size_t K, *idx;
+            if (!GetSparseVector(prhs[2], nrhs == 4 ? prhs[3] : NULL, m->N, &K, &idx, &x))
+                mexErrMsgTxt("x must be a sparse real Nx1 vector, or idx (uint32, between 1 and N) and vals real vectors of the same size.");
+            plhs[0] = mxCreateDoubleMatrix(m->M, 1, mxREAL);
+            SketchMatrixMulSparse(m, K, idx, x, mxGetPr(plhs[0]));
+            mxFree(idx);
+            return;
+        }
+        if (TypedOperation(m, prhs[2], m->N, m->M, SketchMatrixMulFloat,
+                           SketchMatrixMulInt32, plhs))
+            return;
+        if (GetBlockColumns(prhs[2], m->N) > 1)
+        {
+            BatchOperation(m, prhs[2], m->N, m->M, SketchMatrixMulBatch, plhs);
+            return;
+        }
+        x = GetVector(prhs[2], m->N, "x must be a real vector of size N.");
+        plhs[0] = mxCreateDoubleMatrix(m->M, 1, mxREAL);
+        SketchMatrixMul(m, x, mxGetPr(plhs[0]));
+    }
+    else if (!strcmp(command, "mul_transpose") || !strcmp(command, "median"))
+    {
+        const double *y;
+        int is_median = !strcmp(command, "median");
+        if (is_median && nrhs >= 5 && mxIsChar(prhs[3]))
+        {
+            ChunkedMedian(m, nrhs, prhs, plhs);
+            return;
+        }
+        if (nrhs < 3 || nrhs > (is_median ? 5 : 4))
+            mexErrMsgTxt(usage);
+        if (nrhs == 3 &&
+            TypedOperation(m, prhs[2], m->M, m->N,
+                           is_median ? MedianRecoveryFloat : SketchMatrixMulTransposeFloat,
+                           is_median ? MedianRecoveryInt32 : SketchMatrixMulTransposeInt32,
+                           plhs))
+            return;
+        if (nrhs == 3 && GetBlockColumns(prhs[2], m->M) > 1)
+        {
+            BatchOperation(m, prhs[2], m->M, m->N,
+                           is_median ? MedianRecoveryBatch : SketchMatrixMulTransposeBatch,
+                           plhs);
+            return;
+        }
+        y = GetVector(prhs[2], m->M, "y must be a real vector of size M.");
+        if (nrhs >= 4)
+        {
+            size_t K, *idx;
+            double threshold = -1;
+            if (!(idx = GetIndexList(prhs[3], m->N, &K)))
+                mexErrMsgTxt("idx must be a uint32 vector with values between 1 and N.");
+            if (nrhs == 5)
+                threshold = *GetVector(prhs[4], 1, "threshold should be a real scalar.");
+            plhs[0] = mxCreateDoubleMatrix(K, 1, mxREAL);
+            if (is_median)
+            {
+                if (!SketchMatrixMedianRecoveryAt(m, y, K, idx, threshold, mxGetPr(plhs[0])))
+                    mexErrMsgTxt("Out of memory.");
+            }
+            else
+                SketchMatrixMulTransposeAt(m, y, K, idx, mxGetPr(plhs[0]));
+            mxFree(idx);
+            return;
+        }
+        plhs[0] = mxCreateDoubleMatrix(m->N, 1, mxREAL);
+        if (is_median)
+        {
+            if (!SketchMatrixMedianRecovery(m, y, mxGetPr(plhs[0])))
+                mexErrMsgTxt("Out of memory.");
+        }
+        else
+            SketchMatrixMulTranspose(m, y, mxGetPr(plhs[0]));
+    }
+    else if (!strcmp(command, "smp"))
+    {
+        const double *b;
+        int l, T, copied;
+        double convergence_factor = 0, tolerance = 0;
+        size_t K, *idx;
+        double *vals;
+
+        if (nrhs < 5 || nrhs > 7)
+            mexErrMsgTxt(usage);
+        if (!(b = GetDoubleValues(prhs[2], m->M, &copied)))
+            mexErrMsgTxt("b must be a real (double, single or int32) vector of size M.");
+        l = GetScalar(prhs[3]);
+        T = GetScalar(prhs[4]);
+        if (l < 0 || l > m->N)
+            mexErrMsgTxt("l should be between 0 and N.");
+        if (nrhs > 5)
+            convergence_factor = mxGetScalar(prhs[5]);
+        if (nrhs > 6)
+            tolerance = mxGetScalar(prhs[6]);
+
+        idx = (size_t *) mxMalloc((l + 1) * sizeof(size_t));
+        vals = (double *) mxMalloc((l + 1) * sizeof(double));
+        if (!SMPRun(m, b, l, T, convergence_factor, tolerance, &K, idx, vals,
+                    ReportSMPProgress, NULL))
+            mexErrMsgTxt("Could not allocate the SMP workspace.");
+        if (copied)
+            mxFree((void *) b);
+
+        plhs[0] = CreateSparseColumn(m->N, K, idx, vals);
+        mxFree(idx);
+        mxFree(vals);
+    }
+    else if (!strcmp(command, "ssmp"))
+    {
+        const double *y;
+        int inner_steps, outer_steps, sparsity, batch = 1, copied;
+        ssmp_t *decoder;
+
+        if (nrhs != 6 && nrhs != 7)
+            mexErrMsgTxt(usage);
+        if (!(y = GetDoubleValues(prhs[2], m->M, &copied)))
+            mexErrMsgTxt("y must be a real (double, single or int32) vector of size M.");
+        inner_steps = GetScalar(prhs[3]);
+        outer_steps = GetScalar(prhs[4]);
+        sparsity = GetScalar(prhs[5]);
+        if (nrhs == 7)
+            batch = GetScalar(prhs[6]);
+
+        mexPrintf("Performing queued SMP: %d inner steps, %d outer steps, %d sparsity, batch %d\n",
+                  inner_steps, outer_steps, sparsity, batch);
+
+        decoder = SketchMatrixSSMP(m, y, inner_steps, outer_steps, sparsity, batch,
+                                   ReportProgress, NULL);
+        if (copied)
+            mxFree((void *) y);
+        if (!decoder)
+            mexErrMsgTxt("Could not allocate the SSMP decoder.");
+
+        plhs[0] = mxCreateDoubleMatrix(m->N, 1, mxREAL);
+        memcpy(mxGetPr(plhs[0]), decoder->X, (size_t) m->N * sizeof(double));
+    }
+    else if (!strcmp(command, "stream_update"))
+    {
+        int h = (int) (mxGetScalar(prhs[1]) + 0.1);
+        size_t K, *idx;
+        const double *deltas;
+
+        if (nrhs != 4)
+            mexErrMsgTxt(usage);
+        if (!GetSparseVector(prhs[2], prhs[3], m->N, &K, &idx, &deltas))
+            mexErrMsgTxt("idx (uint32, between 1 and N) and deltas must be real vectors of the same size.");
+        if (!streams[h-1])
+        {
+            streams[h-1] = (sketch_stream_t *) malloc(sizeof(sketch_stream_t));
+            if (!streams[h-1] || !SketchStreamCreate(streams[h-1], m, 0))
+            {
+                free(streams[h-1]);
+                streams[h-1] = NULL;
+                mexErrMsgTxt("Could not allocate the streaming sketch.");
+            }
+        }
+        if (K >= PARALLEL_BLOCK_SIZE)
+            SketchStreamUpdateParallel(streams[h-1], K, idx, deltas);
+        else
+            SketchStreamUpdate(streams[h-1], 0, K, idx, deltas);
+        mxFree(idx);
+    }
+    else if (!strcmp(command, "stream_snapshot"))
+    {
+        int h = (int) (mxGetScalar(prhs[1]) + 0.1);
+        plhs[0] = mxCreateDoubleMatrix(m->M, 1, mxREAL);
+        if (streams[h-1])
+            SketchStreamSnapshot(streams[h-1], mxGetPr(plhs[0]));
+    }
+    else if (!strcmp(command, "stream_reset"))
+    {
+        int h = (int) (mxGetScalar(prhs[1]) + 0.1);
+        if (streams[h-1])
+            SketchStreamReset(streams[h-1]);
+    }
+    else if (!strcmp(command, "save"))
+    {
+        char path[4096];
+        if (nrhs != 3 || !mxIsChar(prhs[2]) || mxGetString(prhs[2], path, sizeof(path)))
+            mexErrMsgTxt(usage);
+        if (!SketchMatrixGraph(m))
+            mexErrMsgTxt("Could not build the graph of the matrix.");
+        if (!GraphFileWrite(path, &m->graph))
+            mexErrMsgTxt("Could not write the graph file.");
+    }
+    else
+        mexErrMsgTxt(usage);
+}
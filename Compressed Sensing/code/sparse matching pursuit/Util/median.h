@@ -0,0 +1,191 @@
+/*
+ * Median of D values (the (D+1)/2-th smallest, as selected by
+ * randomized_select(values, D, (D+1)/2)) for the small D of our matrices.
+ *
+ * For D up to MEDIAN_MAX_D the values are sorted with a sorting network
+ * (Batcher's merge exchange, Knuth 5.2.2 Algorithm M), specialized at compile
+ * time for each D. The comparators only depend on the indices, and each one is
+ * a min/max pair, so there are no data-dependent branches. The "lanes"
+ * versions run the network on MEDIAN_LANES columns at once; the values of a
+ * column are interleaved (values[j*MEDIAN_LANES + l] is the j-th value of
+ * column l), so each comparator is a vector min/max across the columns.
+ *
+ * Larger D fall back to SelectKth (select.h).
+ *
+ * The kernels are defined for double, float (suffix Float) and int (suffix
+ * Int32) values.
+ */
+
+#ifndef MEDIAN_H
+#define MEDIAN_H
+
+#include "select.h"
+
+#define MEDIAN_MAX_D 32
+#define MEDIAN_LANES 4
+
+typedef void (*median_kernel_t)(double *values, double *out);
+typedef void (*median_kernel_float_t)(float *values, float *out);
+typedef void (*median_kernel_int32_t)(int *values, int *out);
+
+
+/* Sorts lanes interleaved columns of n values each with a merge exchange
+ * network. When n and lanes are constants the compiler unrolls it. */
+#define DEFINE_MEDIAN_NETWORK(T, S)                                         \
+static inline void MedianNetwork##S(T *v, int n, int lanes)                 \
+{                                                                           \
+    int t, p, q, r, d, i, l;                                                \
+                                                                            \
+    for (t = 0; (1 << t) < n; t++);                                         \
+    if (t == 0)                                                             \
+        return;                                                             \
+                                                                            \
+    for (p = 1 << (t-1); p > 0; p >>= 1)                                    \
+    {                                                                       \
+        q = 1 << (t-1);                                                     \
+        r = 0;                                                              \
+        d = p;                                                              \
+        while (d > 0)                                                       \
+        {                                                                   \
+            for (i = 0; i < n - d; i++)                                     \
+                if ((i & p) == r)                                           \
+                {                                                           \
+                    T *a = v + i * lanes, *b = v + (i + d) * lanes;         \
+                    for (l = 0; l < lanes; l++)                             \
+                    {                                                       \
+                        T lo = a[l] < b[l] ? a[l] : b[l];                   \
+                        T hi = a[l] < b[l] ? b[l] : a[l];                   \
+                        a[l] = lo;                                          \
+                        b[l] = hi;                                          \
+                    }                                                       \
+                }                                                           \
+            d = q - p;                                                      \
+            q >>= 1;                                                        \
+            r = p;                                                          \
+        }                                                                   \
+    }                                                                       \
+}
+
+DEFINE_MEDIAN_NETWORK(double, )
+DEFINE_MEDIAN_NETWORK(float, Float)
+DEFINE_MEDIAN_NETWORK(int, Int32)
+
+#undef DEFINE_MEDIAN_NETWORK
+
+#define DEFINE_MEDIAN_KERNELS_OF(D, T, S)                                   \
+void MedianKernel1##S##_##D(T *v, T *out)                                   \
+{                                                                           \
+    MedianNetwork##S(v, D, 1);                                              \
+    out[0] = v[((D)-1)/2];                                                  \
+}                                                                           \
+void MedianKernelLanes##S##_##D(T *v, T *out)                               \
+{                                                                           \
+    int l;                                                                  \
+    MedianNetwork##S(v, D, MEDIAN_LANES);                                   \
+    for (l = 0; l < MEDIAN_LANES; l++)                                      \
+        out[l] = v[((D)-1)/2 * MEDIAN_LANES + l];                           \
+}
+
+#define DEFINE_MEDIAN_KERNELS(D)                                            \
+    DEFINE_MEDIAN_KERNELS_OF(D, double, )                                   \
+    DEFINE_MEDIAN_KERNELS_OF(D, float, Float)                               \
+    DEFINE_MEDIAN_KERNELS_OF(D, int, Int32)
+
+DEFINE_MEDIAN_KERNELS(1)  DEFINE_MEDIAN_KERNELS(2)  DEFINE_MEDIAN_KERNELS(3)
+DEFINE_MEDIAN_KERNELS(4)  DEFINE_MEDIAN_KERNELS(5)  DEFINE_MEDIAN_KERNELS(6)
+DEFINE_MEDIAN_KERNELS(7)  DEFINE_MEDIAN_KERNELS(8)  DEFINE_MEDIAN_KERNELS(9)
+DEFINE_MEDIAN_KERNELS(10) DEFINE_MEDIAN_KERNELS(11) DEFINE_MEDIAN_KERNELS(12)
+DEFINE_MEDIAN_KERNELS(13) DEFINE_MEDIAN_KERNELS(14) DEFINE_MEDIAN_KERNELS(15)
+DEFINE_MEDIAN_KERNELS(16) DEFINE_MEDIAN_KERNELS(17) DEFINE_MEDIAN_KERNELS(18)
+DEFINE_MEDIAN_KERNELS(19) DEFINE_MEDIAN_KERNELS(20) DEFINE_MEDIAN_KERNELS(21)
+DEFINE_MEDIAN_KERNELS(22) DEFINE_MEDIAN_KERNELS(23) DEFINE_MEDIAN_KERNELS(24)
+DEFINE_MEDIAN_KERNELS(25) DEFINE_MEDIAN_KERNELS(26) DEFINE_MEDIAN_KERNELS(27)
+DEFINE_MEDIAN_KERNELS(28) DEFINE_MEDIAN_KERNELS(29) DEFINE_MEDIAN_KERNELS(30)
+DEFINE_MEDIAN_KERNELS(31) DEFINE_MEDIAN_KERNELS(32)
+
+#undef DEFINE_MEDIAN_KERNELS
+#undef DEFINE_MEDIAN_KERNELS_OF
+
+#define MEDIAN_KERNEL_ROW(D, S) { MedianKernel1##S##_##D, MedianKernelLanes##S##_##D }
+
+#define MEDIAN_KERNEL_TABLE(S)                                                    \
+    { NULL, NULL },                                                               \
+    MEDIAN_KERNEL_ROW(1, S),  MEDIAN_KERNEL_ROW(2, S),  MEDIAN_KERNEL_ROW(3, S),  \
+    MEDIAN_KERNEL_ROW(4, S),  MEDIAN_KERNEL_ROW(5, S),  MEDIAN_KERNEL_ROW(6, S),  \
+    MEDIAN_KERNEL_ROW(7, S),  MEDIAN_KERNEL_ROW(8, S),  MEDIAN_KERNEL_ROW(9, S),  \
+    MEDIAN_KERNEL_ROW(10, S), MEDIAN_KERNEL_ROW(11, S), MEDIAN_KERNEL_ROW(12, S), \
+    MEDIAN_KERNEL_ROW(13, S), MEDIAN_KERNEL_ROW(14, S), MEDIAN_KERNEL_ROW(15, S), \
+    MEDIAN_KERNEL_ROW(16, S), MEDIAN_KERNEL_ROW(17, S), MEDIAN_KERNEL_ROW(18, S), \
+    MEDIAN_KERNEL_ROW(19, S), MEDIAN_KERNEL_ROW(20, S), MEDIAN_KERNEL_ROW(21, S), \
+    MEDIAN_KERNEL_ROW(22, S), MEDIAN_KERNEL_ROW(23, S), MEDIAN_KERNEL_ROW(24, S), \
+    MEDIAN_KERNEL_ROW(25, S), MEDIAN_KERNEL_ROW(26, S), MEDIAN_KERNEL_ROW(27, S), \
+    MEDIAN_KERNEL_ROW(28, S), MEDIAN_KERNEL_ROW(29, S), MEDIAN_KERNEL_ROW(30, S), \
+    MEDIAN_KERNEL_ROW(31, S), MEDIAN_KERNEL_ROW(32, S)
+
+/* median_kernels[D][0] handles one column, median_kernels[D][1] MEDIAN_LANES */
+const median_kernel_t median_kernels[MEDIAN_MAX_D + 1][2] = {
+    MEDIAN_KERNEL_TABLE()
+};
+const median_kernel_float_t median_kernels_float[MEDIAN_MAX_D + 1][2] = {
+    MEDIAN_KERNEL_TABLE(Float)
+};
+const median_kernel_int32_t median_kernels_int32[MEDIAN_MAX_D + 1][2] = {
+    MEDIAN_KERNEL_TABLE(Int32)
+};
+
+#undef MEDIAN_KERNEL_TABLE
+#undef MEDIAN_KERNEL_ROW
+
+
+/*
+ * Early exit test for medians compared to a threshold t >= 0: if below of the
+ * values seen so far are <= t and above of them are >= -t, returns 1 when the
+ * median of all D values is in [-t, t] whatever the remaining values are.
+ */
+static inline int MedianWithin(int below, int above, int D)
+{
+    return below > (D-1)/2 && above > D - 1 - (D-1)/2;
+}
+
+/*
+ * Median (Median##S) of the D values, and medians (MedianLanes##S) of
+ * MEDIAN_LANES columns of D interleaved values each (see above; out[l] is the
+ * median of column l). Both scramble the values. seed is passed to
+ * SelectKth##S for the D > MEDIAN_MAX_D fallback, for which MedianLanes##S
+ * needs scratch to hold D values.
+ */
+#define DEFINE_MEDIAN(T, S, TABLE)                                          \
+T Median##S(T *values, int D, unsigned int *seed)                           \
+{                                                                           \
+    T out;                                                                  \
+    if (D <= MEDIAN_MAX_D)                                                  \
+    {                                                                       \
+        TABLE[D][0](values, &out);                                          \
+        return out;                                                         \
+    }                                                                       \
+    return SelectKth##S(values, D, (D+1)/2, seed);                          \
+}                                                                           \
+                                                                            \
+void MedianLanes##S(T *values, int D, T *out, T *scratch, unsigned int *seed) \
+{                                                                           \
+    int j, l;                                                               \
+    if (D <= MEDIAN_MAX_D)                                                  \
+    {                                                                       \
+        TABLE[D][1](values, out);                                           \
+        return;                                                             \
+    }                                                                       \
+    for (l = 0; l < MEDIAN_LANES; l++)                                      \
+    {                                                                       \
+        for (j = 0; j < D; j++)                                             \
+            scratch[j] = values[j * MEDIAN_LANES + l];                      \
+        out[l] = SelectKth##S(scratch, D, (D+1)/2, seed);                   \
+    }                                                                       \
+}
+
+DEFINE_MEDIAN(double, , median_kernels)
+DEFINE_MEDIAN(float, Float, median_kernels_float)
+DEFINE_MEDIAN(int, Int32, median_kernels_int32)
+
+#undef DEFINE_MEDIAN
+
+#endif  /* MEDIAN_H */
@@ -1,6 +1,7 @@
 /*
  * Routine that implements a fast median (Count-Min) recovery; the neighbours of
- * each element are given explicitly.
+ * each element are given explicitly, or by a graph file (see graphfile.h)
+ * that is mapped and streamed through instead of loaded.
  *
  * Written by Radu Berinde, MIT, Jan. 2008
  */
@@ -8,27 +9,153 @@
 #include <string.h>
 #include "mex.h"
 #include "matrix.h"
-#include "randomized_select.h"
+#include "chunked.h"
+#include "mexutil.h"
 
 char* usage =
-"Usage: x = median_recovery_explicit(N, M, D, neighbors, y)\n"
+"Usage: x = median_recovery_explicit(N, M, D, neighbors, y [, idx [, threshold]])\n"
+"   or: x = median_recovery_explicit(path, y [, idx [, threshold]])\n"
+"   or: x = median_recovery_explicit(path, y, 'topk', K [, chunk])\n"
+"       median_recovery_explicit(path, y, 'file', out_path [, chunk])\n"
+"  path is a graph file with the neighbors (see graphfile.h).\n"
+"  'topk' and 'file' recover chunk columns at a time (default 2^20) without the\n"
+"  N-length x: 'topk' returns the K largest medians (in absolute value) as a\n"
+"  sparse vector, 'file' writes x to out_path as doubles. y must be double.\n"
 "  N is the signal size, M is the sketch size.\n"
 "  D is the degreee (number of neighbors of each element)\n"
 "  neighbors is an N by D uint32 matrix with the D neighbors of each element (numbers between 1 and M)\n"
-"  y is the sketch (of length M).\n"
-"\nReturns a vector x of size N so that x(i) is the median of y(neighbors(i))\n";
+"  y is the sketch (of length M), or an M by R matrix of R sketches (without idx).\n"
+"  A single or int32 sketch y (without idx) gives medians of the same class.\n"
+"  idx (optional) is a uint32 vector of candidate indices (between 1 and N)\n"
+"  threshold (optional) sets x(k) to 0 as soon as |median| <= threshold is certain\n"
+"\nReturns a vector x of size N so that x(i) is the median of y(neighbors(i))\n"
+"(with idx, a vector of the size of idx with the medians of the candidates)\n";
+
+/* x = median_recovery_explicit(path, y, mode, ...), chunked (see usage) */
+void
+ChunkedFileMedianRecovery(int nlhs, mxArray *plhs[],
+                          int nrhs, const mxArray *prhs[])
+{
+    char path[4096], out_path[4096];
+    sketch_matrix_t m;
+    median_topk_t topk;
+    size_t K, chunk;
+    FILE *f;
+    int mode, ok;
+
+    if (!(mode = GetChunkedOutput(nrhs - 2, prhs + 2, &K, out_path, sizeof(out_path), &chunk)))
+        mexErrMsgTxt(usage);
+    if (mxGetString(prhs[0], path, sizeof(path)) || !SketchMatrixMapExplicit(&m, path))
+        mexErrMsgTxt("Could not map the graph file (missing, or of another version or build).");
+    if (GetValueClass(prhs[1], m.M) != VALUE_DOUBLE)
+    {
+        SketchMatrixDestroy(&m);
+        mexErrMsgTxt("y must be a real double vector of size M.");
+    }
+
+    if (mode == CHUNKED_TOPK)
+    {
+        ok = MedianTopKCreate(&topk, K, chunk ? chunk : MEDIAN_CHUNK) &&
+             SketchMatrixMedianRecoveryChunked(&m, mxGetPr(prhs[1]), chunk, MedianTopKAdd, &topk);
+        if (ok)
+            plhs[0] = CreateSparseColumn(m.N, topk.num, topk.idx, topk.vals);
+        MedianTopKDestroy(&topk);
+    }
+    else
+    {
+        ok = (f = fopen(out_path, "wb")) != NULL &&
+             SketchMatrixMedianRecoveryChunked(&m, mxGetPr(prhs[1]), chunk, MedianFileAdd, f);
+        if (f && fclose(f))
+            ok = 0;
+    }
+    SketchMatrixDestroy(&m);
+    if (!ok)
+        mexErrMsgTxt("Out of memory, or could not write the file.");
+}
+
+/* x = median_recovery_explicit(path, y [, idx [, threshold]]) */
+void
+FileMedianRecovery(int nlhs, mxArray *plhs[],
+                   int nrhs, const mxArray *prhs[])
+{
+    char path[4096];
+    bipartite_graph_t graph;
+    int value_class, ok = 1;
+    size_t K, *idx;
+    double threshold = -1;
+
+    if (mxGetString(prhs[0], path, sizeof(path)) || !GraphFileMap(&graph, path))
+        mexErrMsgTxt("Could not map the graph file (missing, or of another version or build).");
+
+    value_class = GetValueClass(prhs[1], graph.M);
+    if (!value_class || (nrhs > 2 && value_class != VALUE_DOUBLE))
+    {
+        GraphDestroy(&graph);
+        mexErrMsgTxt("y must be a real vector of size M (double with idx).");
+    }
+
+    if (nrhs > 2)
+    {
+        if (nrhs == 4)
+        {
+            if (!mxIsDouble(prhs[3]) || mxIsComplex(prhs[3]) || mxGetNumberOfElements(prhs[3]) != 1)
+            {
+                GraphDestroy(&graph);
+                mexErrMsgTxt("threshold should be a real scalar.");
+            }
+            threshold = mxGetScalar(prhs[3]);
+        }
+        if (!(idx = GetIndexList(prhs[2], graph.N, &K)))
+        {
+            GraphDestroy(&graph);
+            mexErrMsgTxt("idx must be a uint32 vector with values between 1 and N.");
+        }
+        plhs[0] = mxCreateDoubleMatrix(K, 1, mxREAL);
+        ok = GraphMedianRecoveryAt(&graph, mxGetPr(prhs[1]), K, idx, threshold, mxGetPr(plhs[0]));
+        mxFree(idx);
+    }
+    else
+    {
+        plhs[0] = CreateValueMatrix(graph.N, 1, value_class);
+        if (value_class == VALUE_SINGLE)
+            ok = GraphStreamMedianRecoveryFloat(&graph, (const float *) mxGetData(prhs[1]),
+                                                (float *) mxGetData(plhs[0]));
+        else if (value_class == VALUE_INT32)
+            ok = GraphStreamMedianRecoveryInt32(&graph, (const int *) mxGetData(prhs[1]),
+                                                (int *) mxGetData(plhs[0]));
+        else
+            ok = GraphStreamMedianRecovery(&graph, mxGetPr(prhs[1]), mxGetPr(plhs[0]));
+    }
+    GraphDestroy(&graph);
+    if (!ok)
+        mexErrMsgTxt("Out of memory.");
+}
 
 void
 mexFunction(int nlhs, mxArray *plhs[],
             int nrhs, const mxArray *prhs[])
 {
-    int N, M, D, B, i, j;
+    sketch_index_t N;
+    int M, D, i, R, value_class;
     const unsigned int *neighbors;
     const double *y;
-    double *x;
-    double bucket_values[128];
+    bipartite_graph_t graph;
+    size_t K = 0, k, *idx = NULL;
+    double threshold = -1;
+    int ok = 1;
+
+    if (nrhs >= 4 && nrhs <= 5 && mxIsChar(prhs[0]) && mxIsChar(prhs[2]))
+    {
+        ChunkedFileMedianRecovery(nlhs, plhs, nrhs, prhs);
+        return;
+    }
+    if (nrhs >= 2 && nrhs <= 4 && mxIsChar(prhs[0]))
+    {
+        FileMedianRecovery(nlhs, plhs, nrhs, prhs);
+        return;
+    }
 
-    if (nrhs != 5 && nlhs != 1)
+    if (nrhs < 5 || nrhs > 7)
         mexErrMsgTxt(usage);
 
     for (i = 0; i < 3; i++)
@@ -36,35 +163,96 @@ mexFunction(int nlhs, mxArray *plhs[],
             mxGetNumberOfElements(prhs[i]) != 1)
             mexErrMsgTxt("First three arguments should be real scalars.");
 
-    N = (int) (mxGetScalar(prhs[0]) + 0.1);
+    N = (sketch_index_t) (mxGetScalar(prhs[0]) + 0.1);
     M = (int) (mxGetScalar(prhs[1]) + 0.1);
     D = (int) (mxGetScalar(prhs[2]) + 0.1);
 
-    if (D >= 128)
-        mexErrMsgTxt("D should be less than 128");
-
-    if (!mxIsClass(prhs[3], "uint32") || mxGetNumberOfElements(prhs[3]) != N*D)
+    if (!mxIsClass(prhs[3], "uint32") || mxGetNumberOfElements(prhs[3]) != (size_t) N * D)
         mexErrMsgTxt("neighbors must be a uint32 NxD matrix.");
 
     neighbors = (const unsigned int *) mxGetPr(prhs[3]);
 
-    if (!mxIsDouble(prhs[4]) || mxIsComplex(prhs[4]) || mxGetNumberOfElements(prhs[4]) != M)
-        mexErrMsgTxt("y must be a real vector of size M.");
+    value_class = GetValueClass(prhs[4], M);
+    if (value_class == VALUE_SINGLE || value_class == VALUE_INT32)
+    {
+        /* The medians of a single or int32 sketch have its class */
+        if (nrhs > 5)
+            mexErrMsgTxt("idx and threshold need a double y.");
+        if (!GraphBuild(&graph, N, M, D, neighbors, 0))
+            mexErrMsgTxt("neighbors must be between 1 and M.");
+        plhs[0] = CreateValueMatrix(N, 1, value_class);
+        if (value_class == VALUE_SINGLE)
+            ok = GraphMedianRecoveryFloat(&graph, (const float *) mxGetData(prhs[4]),
+                                          (float *) mxGetData(plhs[0]));
+        else
+            ok = GraphMedianRecoveryInt32(&graph, (const int *) mxGetData(prhs[4]),
+                                          (int *) mxGetData(plhs[0]));
+        GraphDestroy(&graph);
+        if (!ok)
+            mexErrMsgTxt("Out of memory.");
+        return;
+    }
+
+    if (!(R = GetBlockColumns(prhs[4], M)) || (nrhs >= 6 && R != 1))
+        mexErrMsgTxt("y must be a real vector of size M (or an M by R matrix without idx).");
 
     y = mxGetPr(prhs[4]);
 
-    plhs[0] = mxCreateDoubleMatrix(N, 1, mxREAL);
-    x = mxGetPr(plhs[0]);
+    if (nrhs == 7)
+    {
+        if (!mxIsDouble(prhs[6]) || mxIsComplex(prhs[6]) || mxGetNumberOfElements(prhs[6]) != 1)
+            mexErrMsgTxt("threshold should be a real scalar.");
+        threshold = mxGetScalar(prhs[6]);
+    }
 
-    for (i = 0; i < N; i++)
+    if (nrhs >= 6)
     {
-        for (j = 0; j < D; j++)
-        {
-            int pos = neighbors[i + N * j] - 1;
-            bucket_values[j] = y[pos];
-        }
-        x[i] = randomized_select(bucket_values, D, (D+1)/2);  /* select median */
-        if ((i+1) % 1000000 == 0)
-            printf("%d columns complete.\n", i+1);
+        /* Only build the graph of the candidates (K left nodes) */
+        unsigned int *candidate_neighbors;
+        int j;
+
+        if (!(idx = GetIndexList(prhs[5], N, &K)))
+            mexErrMsgTxt("idx must be a uint32 vector with values between 1 and N.");
+
+        plhs[0] = mxCreateDoubleMatrix(K, 1, mxREAL);
+        if (K == 0)
+            return;
+
+        candidate_neighbors = (unsigned int *) mxMalloc((K * D + 1) * sizeof(unsigned int));
+        for (k = 0; k < K; k++)
+            for (j = 0; j < D; j++)
+                candidate_neighbors[k + K * j] = neighbors[idx[k] + (size_t) N * j];
+        mxFree(idx);
+
+        if (!GraphBuild(&graph, (sketch_index_t) K, M, D, candidate_neighbors, 0))
+            mexErrMsgTxt("neighbors must be between 1 and M.");
+        mxFree(candidate_neighbors);
+
+        ok = GraphMedianRecoveryAt(&graph, y, K, NULL, threshold, mxGetPr(plhs[0]));
+
+        GraphDestroy(&graph);
+        if (!ok)
+            mexErrMsgTxt("Out of memory.");
+        return;
+    }
+
+    /* Only the left adjacency is needed */
+    if (!GraphBuild(&graph, N, M, D, neighbors, 0))
+        mexErrMsgTxt("neighbors must be between 1 and M.");
+
+    plhs[0] = mxCreateDoubleMatrix(N, R, mxREAL);
+    if (R == 1)
+        ok = GraphMedianRecovery(&graph, y, mxGetPr(plhs[0]));
+    else
+    {
+        double *yt = InterleavedCopy(prhs[4], M, R);
+        double *x = (double *) mxMalloc((size_t) N * R * sizeof(double));
+        ok = GraphMedianRecoveryBatch(&graph, R, yt, x);
+        SetFromInterleaved(plhs[0], x);
+        mxFree(yt);
     }
+
+    GraphDestroy(&graph);
+    if (!ok)
+        mexErrMsgTxt("Out of memory.");
 }
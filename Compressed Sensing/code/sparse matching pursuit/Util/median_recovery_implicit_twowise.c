@@ -8,35 +8,103 @@
 #include <string.h>
 #include "mex.h"
 #include "matrix.h"
-#include "randomized_select.h"
+#include "chunked.h"
+#include "mexutil.h"
 
 char* usage =
-"Usage: x = median_recovery_implcit_twowise(N, M, D, B, Ps, As, Bs, y)\n"
+"Usage: x = median_recovery_implcit_twowise(N, M, D, B, Ps, As, Bs, y [, idx [, threshold]])\n"
 "  N is the signal size, M is the sketch size.\n"
 "  D is the degreee (number of neighbors of each element)\n"
 "  B is the number of hashes (should be floor(M/D))\n"
 "  Ps, As, Bs are the parameters of the hash functions\n"
-"  y is the sketch of length M\n"
-"\nReturns a vector x of size N so that x(i) is the median of y(neighbors(i))\n";
+"  y is the sketch of length M (or an M by R matrix of R sketches, without idx)\n"
+"  A single or int32 sketch y (without idx) gives medians of the same class.\n"
+"  idx (optional) is a uint32 vector of candidate indices (between 1 and N)\n"
+"  threshold (optional) sets x(k) to 0 as soon as |median| <= threshold is certain\n"
+"\nReturns a vector x of size N so that x(i) is the median of y(neighbors(i))\n"
+"(with idx, a vector of the size of idx with the medians of the candidates)\n"
+"\n   or: x = median_recovery_implicit_twowise(N, M, D, B, Ps, As, Bs, y, 'topk', K [, chunk])\n"
+"       median_recovery_implicit_twowise(N, M, D, B, Ps, As, Bs, y, 'file', path [, chunk])\n"
+"  recover chunk columns at a time (default 2^20) without the N-length x: 'topk'\n"
+"  returns the K largest medians (in absolute value) as a sparse vector, 'file'\n"
+"  writes x to the file as doubles. y must be a double vector.\n";
 
 
 /*
- * Arguments: N, M, D, B, Ps, As, Bs, y 
+ * Chunked recovery of x = median_recovery_implicit_twowise(..., y, mode, ...)
+ * (see usage) with the hash parameters at prhs[0..6]
+ */
+void
+Chunked(int nlhs, mxArray *plhs[],
+        int nrhs, const mxArray *prhs[], int mode, size_t K, const char *path, size_t chunk)
+{
+    sketch_index_t N;
+    int M, D, B, ok;
+    countmin_term_t *Ps, *As, *Bs;
+    sketch_matrix_t m;
+    median_topk_t topk;
+    FILE *f;
+
+    N = (sketch_index_t) (mxGetScalar(prhs[0]) + 0.1);
+    M = (int) (mxGetScalar(prhs[1]) + 0.1);
+    D = (int) (mxGetScalar(prhs[2]) + 0.1);
+    B = (int) (mxGetScalar(prhs[3]) + 0.1);
+
+    Ps = GetHashParameters(prhs[4], D);
+    As = GetHashParameters(prhs[5], D);
+    Bs = GetHashParameters(prhs[6], D);
+    if (!Ps || !As || !Bs)
+        mexErrMsgTxt("Ps, As, Bs must be uint32 or uint64 vectors of size D.");
+    if (!mxIsDouble(prhs[7]) || mxIsComplex(prhs[7]) || mxGetNumberOfElements(prhs[7]) != (size_t) M)
+        mexErrMsgTxt("y must be a real double vector of size M.");
+    if (!SketchMatrixCreateImplicit(&m, N, M, D, B, Ps, As, Bs))
+        mexErrMsgTxt("Invalid hash parameters (D*B should be at most M, Ps at most "
+                     COUNTMIN_MAX_PRIME_TEXT ").");
+    mxFree(Ps);
+    mxFree(As);
+    mxFree(Bs);
+
+    if (mode == CHUNKED_TOPK)
+    {
+        if (!MedianTopKCreate(&topk, K, chunk ? chunk : MEDIAN_CHUNK))
+            mexErrMsgTxt("Could not allocate the top K accumulator.");
+        ok = SketchMatrixMedianRecoveryChunked(&m, mxGetPr(prhs[7]), chunk, MedianTopKAdd, &topk);
+        if (ok)
+            plhs[0] = CreateSparseColumn(N, topk.num, topk.idx, topk.vals);
+        MedianTopKDestroy(&topk);
+    }
+    else
+    {
+        ok = (f = fopen(path, "wb")) != NULL &&
+             SketchMatrixMedianRecoveryChunked(&m, mxGetPr(prhs[7]), chunk, MedianFileAdd, f);
+        if (f && fclose(f))
+            ok = 0;
+    }
+    SketchMatrixDestroy(&m);
+    if (!ok)
+        mexErrMsgTxt("Out of memory, or could not write the file.");
+}
+
+/*
+ * Arguments: N, M, D, B, Ps, As, Bs, y [, idx [, threshold]]
+ *            N, M, D, B, Ps, As, Bs, y, 'topk', K [, chunk]
+ *            N, M, D, B, Ps, As, Bs, y, 'file', path [, chunk]
  * Returns: x (recovered vector)
  */ 
 void
 mexFunction(int nlhs, mxArray *plhs[],
             int nrhs, const mxArray *prhs[])
 {
-    int N, M, D, B, i;
-    const unsigned int *Ps, *As, *Bs;
-    const double *y;
-    double *x;
-    int col;
-    unsigned int vals[128];
-    double bucket_values[128];
-
-    if (nrhs != 8 && nlhs != 1)
+    sketch_index_t N;
+    int M, D, B, i, R, value_class;
+    countmin_term_t *Ps, *As, *Bs;
+    countmin_hash_t hash;
+    size_t K = 0, *idx = NULL, chunk;
+    double threshold = -1;
+    char path[4096];
+    int mode, ok = 1;
+
+    if (nrhs < 8 || nrhs > 11)
         mexErrMsgTxt(usage);
 
     for (i = 0; i < 4; i++)
@@ -44,7 +112,7 @@ mexFunction(int nlhs, mxArray *plhs[],
             mxGetNumberOfElements(prhs[i]) != 1)
             mexErrMsgTxt("First four arguments should be real scalars.");
 
-    N = (int) (mxGetScalar(prhs[0]) + 0.1);
+    N = (sketch_index_t) (mxGetScalar(prhs[0]) + 0.1);
     M = (int) (mxGetScalar(prhs[1]) + 0.1);
     D = (int) (mxGetScalar(prhs[2]) + 0.1);
     B = (int) (mxGetScalar(prhs[3]) + 0.1);
@@ -52,51 +120,80 @@ mexFunction(int nlhs, mxArray *plhs[],
     if (B*D > M)
         mexErrMsgTxt("D*B should be at most M");
 
-    if (D >= 128)
-        mexErrMsgTxt("D should be less than 128");
-
-    for (i = 4; i <= 6; i++)
-        if (!mxIsClass(prhs[i], "uint32") || mxGetNumberOfElements(prhs[i]) != D)
-            mexErrMsgTxt("Ps, As, Bs must be uint32 vectors of size D.");
-
-    Ps = (const unsigned int *) mxGetData(prhs[4]);
-    As = (const unsigned int *) mxGetData(prhs[5]);
-    Bs = (const unsigned int *) mxGetData(prhs[6]);
-
-    if (!mxIsDouble(prhs[7]) || mxIsComplex(prhs[7]) || mxGetNumberOfElements(prhs[7]) != M)
-        mexErrMsgTxt("y must be a real vector of size M.");
+    if (nrhs > 8 && mxIsChar(prhs[8]))
+    {
+        if (!(mode = GetChunkedOutput(nrhs - 8, prhs + 8, &K, path, sizeof(path), &chunk)))
+            mexErrMsgTxt(usage);
+        Chunked(nlhs, plhs, nrhs, prhs, mode, K, path, chunk);
+        return;
+    }
+    if (nrhs == 11)
+        mexErrMsgTxt(usage);
 
-    y = mxGetPr(prhs[7]);
+    Ps = GetHashParameters(prhs[4], D);
+    As = GetHashParameters(prhs[5], D);
+    Bs = GetHashParameters(prhs[6], D);
+    if (!Ps || !As || !Bs)
+        mexErrMsgTxt("Ps, As, Bs must be uint32 or uint64 vectors of size D.");
+
+    value_class = GetValueClass(prhs[7], M);
+    if ((value_class == VALUE_SINGLE || value_class == VALUE_INT32) && nrhs > 8)
+        mexErrMsgTxt("idx and threshold need a double y.");
+    if (value_class == VALUE_SINGLE || value_class == VALUE_INT32)
+        R = 1;
+    else if (!(R = GetBlockColumns(prhs[7], M)) || (nrhs >= 9 && R != 1))
+        mexErrMsgTxt("y must be a real vector of size M (or an M by R matrix without idx).");
+
+    for (i = 0; i < D; i++)
+        if (Ps[i] > COUNTMIN_MAX_PRIME)
+            mexErrMsgTxt("Ps should be at most " COUNTMIN_MAX_PRIME_TEXT ".");
+
+    if (nrhs == 10)
+    {
+        if (!mxIsDouble(prhs[9]) || mxIsComplex(prhs[9]) || mxGetNumberOfElements(prhs[9]) != 1)
+            mexErrMsgTxt("threshold should be a real scalar.");
+        threshold = mxGetScalar(prhs[9]);
+    }
 
-    plhs[0] = mxCreateDoubleMatrix(N, 1, mxREAL);
-    x = mxGetPr(plhs[0]);
+    if (nrhs >= 9 && !(idx = GetIndexList(prhs[8], N, &K)))
+        mexErrMsgTxt("idx must be a uint32 vector with values between 1 and N.");
 
-    /* At each column we want to compute
-         pos = (int) (((long long) As[i] * (col+1) + Bs[i]) % Ps[i] % B);
+    if (!CountMinCreate(&hash, N, M, D, B, Ps, As, Bs))
+        mexErrMsgTxt("Invalid hash parameters.");
+    mxFree(Ps);
+    mxFree(As);
+    mxFree(Bs);
 
-       To speed this up, we mainain the (((long long) As[i] * (col+1) + Bs[i]) %
-       Ps[i] terms, and just add As[i] at each step.
-     */
-    for (i = 0; i < D; i++) 
+    if (idx)
     {
-        vals[i] = Bs[i];
-        /* Impose a 2 billion limit on the P primes, so we won't overflow. */
-        if (Ps[i] > 2000000000)
-            mexErrMsgTxt("Ps should be less than 2 billion.");
+        plhs[0] = mxCreateDoubleMatrix(K, 1, mxREAL);
+        ok = CountMinMedianRecoveryAt(&hash, mxGetPr(prhs[7]), K, idx, threshold, mxGetPr(plhs[0]));
+        mxFree(idx);
     }
-
-    for (col = 0; col < N; col++)
+    else if (R == 1)
     {
-        for (i = 0; i < D; i++)
-        {
-            int pos;
-            vals[i] = (vals[i] + As[i]) % Ps[i];
-            /* pos = (int) (((long long) As[i] * (col+1) + Bs[i]) % Ps[i] % B); */
-            pos = vals[i] % B;
-            bucket_values[i] = y[i*B + pos];
-        }
-        x[col] = randomized_select(bucket_values, D, (D+1)/2);  /* select median */
-        if ((col+1) % 1000000 == 0)
-            printf("%d columns complete.\n", col+1);
+        /* The medians of a single or int32 sketch have its class */
+        plhs[0] = CreateValueMatrix(N, 1, value_class);
+        if (value_class == VALUE_SINGLE)
+            ok = CountMinMedianRecoveryFloat(&hash, (const float *) mxGetData(prhs[7]),
+                                             (float *) mxGetData(plhs[0]));
+        else if (value_class == VALUE_INT32)
+            ok = CountMinMedianRecoveryInt32(&hash, (const int *) mxGetData(prhs[7]),
+                                             (int *) mxGetData(plhs[0]));
+        else
+            ok = CountMinMedianRecovery(&hash, mxGetPr(prhs[7]), mxGetPr(plhs[0]));
     }
+    else
+    {
+        double *y = InterleavedCopy(prhs[7], M, R);
+        double *x = (double *) mxMalloc((size_t) N * R * sizeof(double));
+        plhs[0] = mxCreateDoubleMatrix(N, R, mxREAL);
+        ok = CountMinMedianRecoveryBatch(&hash, R, y, x);
+        SetFromInterleaved(plhs[0], x);
+        mxFree(y);
+    }
+
+    CountMinDestroy(&hash);
+    if (!ok)
+        mexErrMsgTxt("Out of memory.");
 }
@@ -1,7 +1,9 @@
 #ifndef MEXUTIL_H
 #define MEXUTIL_H
 
+#include <string.h>
 #include "mex.h"
+#include "indices.h"
 
 /* Pauses for a small time allowing matlab to refresh the display */
 void MatlabDrawNow()
@@ -9,4 +11,266 @@ void MatlabDrawNow()
     mexEvalString("drawnow;");
 }
 
+/*
+ * Reads a list of indices between 1 and n given as a uint32 vector. Returns
+ * their number in *K and the 0-based indices (allocated with mxMalloc), or
+ * NULL if the argument is not of this form.
+ */
+size_t *GetIndexList(const mxArray *arg, size_t n, size_t *K)
+{
+    const unsigned int *indices;
+    size_t k, *idx;
+
+    if (!mxIsClass(arg, "uint32"))
+        return NULL;
+    indices = (const unsigned int *) mxGetData(arg);
+    *K = mxGetNumberOfElements(arg);
+    for (k = 0; k < *K; k++)
+        if (indices[k] < 1 || indices[k] > n)
+            return NULL;
+    idx = (size_t *) mxMalloc((*K + 1) * sizeof(size_t));
+    for (k = 0; k < *K; k++)
+        idx[k] = indices[k] - 1;
+    return idx;
+}
+
+/*
+ * Reads a sparse vector of length n, given either as a Matlab sparse column
+ * vector (x, with vals == NULL) or as (index, value) pairs: x is a uint32
+ * vector of 1-based indices and vals a real vector of the same size.
+ * Returns the number of entries K in *K, their 0-based indices in *idx
+ * (allocated with mxMalloc) and their values in *v. Returns 0 if the input is
+ * not of this form.
+ */
+int GetSparseVector(const mxArray *x, const mxArray *vals, size_t n,
+                    size_t *K, size_t **idx, const double **v)
+{
+    size_t k;
+
+    if (vals == NULL)
+    {
+        const mwIndex *ir, *jc;
+        if (!mxIsSparse(x) || !mxIsDouble(x) || mxIsComplex(x) ||
+            mxGetN(x) != 1 || mxGetM(x) != n)
+            return 0;
+        ir = mxGetIr(x);
+        jc = mxGetJc(x);
+        *K = jc[1];
+        *idx = (size_t *) mxMalloc((*K + 1) * sizeof(size_t));
+        for (k = 0; k < *K; k++)
+            (*idx)[k] = ir[k];
+        *v = mxGetPr(x);
+        return 1;
+    }
+    else
+    {
+        if (!mxIsDouble(vals) || mxIsComplex(vals) ||
+            mxGetNumberOfElements(x) != mxGetNumberOfElements(vals))
+            return 0;
+        *idx = GetIndexList(x, n, K);
+        *v = mxGetPr(vals);
+        return *idx != NULL;
+    }
+}
+
+/*
+ * Number of columns R of a real (full) n by R block of signals; a vector of
+ * n elements counts as R = 1. Returns 0 if arg is not of this form.
+ */
+int GetBlockColumns(const mxArray *arg, size_t n)
+{
+    if (!mxIsDouble(arg) || mxIsComplex(arg) || mxIsSparse(arg))
+        return 0;
+    if (mxGetNumberOfElements(arg) == n)
+        return 1;
+    if (mxGetNumberOfDimensions(arg) != 2 || mxGetM(arg) != n)
+        return 0;
+    return (int) mxGetN(arg);
+}
+
+/*
+ * The batched kernels store the R values of a row contiguously (entry (i, r)
+ * at i*R + r). InterleavedCopy returns such a copy of the n by R block arg
+ * (allocated with mxMalloc); SetFromInterleaved writes an interleaved block
+ * into the n by R matrix out and frees it.
+ */
+double *InterleavedCopy(const mxArray *arg, size_t n, int R)
+{
+    const double *src = mxGetPr(arg);
+    double *dst = (double *) mxMalloc((n * R + 1) * sizeof(double));
+    size_t i;
+    int r;
+
+    for (r = 0; r < R; r++)
+        for (i = 0; i < n; i++)
+            dst[i * R + r] = src[i + n * r];
+    return dst;
+}
+
+void SetFromInterleaved(mxArray *out, double *src)
+{
+    double *dst = mxGetPr(out);
+    size_t i, n = mxGetM(out);
+    int r, R = (int) mxGetN(out);
+
+    for (r = 0; r < R; r++)
+        for (i = 0; i < n; i++)
+            dst[i + n * r] = src[i * R + r];
+    mxFree(src);
+}
+
+/*
+ * Classes of the values of the kernels that have float and int32 versions
+ * (see DEFINE_GRAPH_KERNELS and DEFINE_COUNTMIN_KERNELS).
+ */
+#define VALUE_DOUBLE 1
+#define VALUE_SINGLE 2
+#define VALUE_INT32  3
+
+/*
+ * Class (VALUE_DOUBLE, VALUE_SINGLE or VALUE_INT32) of a real full vector of
+ * n elements, or 0 if arg is not such a vector.
+ */
+int GetValueClass(const mxArray *arg, size_t n)
+{
+    if (mxIsComplex(arg) || mxIsSparse(arg) || mxGetNumberOfElements(arg) != n)
+        return 0;
+    if (mxIsDouble(arg))
+        return VALUE_DOUBLE;
+    if (mxIsSingle(arg))
+        return VALUE_SINGLE;
+    if (mxIsClass(arg, "int32"))
+        return VALUE_INT32;
+    return 0;
+}
+
+/* Creates a real m by n matrix of the given value class */
+mxArray *CreateValueMatrix(size_t m, size_t n, int value_class)
+{
+    mxClassID id = mxDOUBLE_CLASS;
+    if (value_class == VALUE_SINGLE)
+        id = mxSINGLE_CLASS;
+    else if (value_class == VALUE_INT32)
+        id = mxINT32_CLASS;
+    return mxCreateNumericMatrix(m, n, id, mxREAL);
+}
+
+/*
+ * Returns the values of a real vector of n elements of any value class as
+ * doubles (exact for single and int32), for the kernels that only work in
+ * double. The result is the data of arg if it is already double, or else a
+ * copy allocated with mxMalloc; *copied tells which. Returns NULL if arg is
+ * not such a vector.
+ */
+const double *GetDoubleValues(const mxArray *arg, size_t n, int *copied)
+{
+    int value_class = GetValueClass(arg, n);
+    double *copy;
+    size_t i;
+
+    *copied = 0;
+    if (value_class == VALUE_DOUBLE)
+        return mxGetPr(arg);
+    if (!value_class)
+        return NULL;
+
+    copy = (double *) mxMalloc((n + 1) * sizeof(double));
+    if (value_class == VALUE_SINGLE)
+        for (i = 0; i < n; i++)
+            copy[i] = ((const float *) mxGetData(arg))[i];
+    else
+        for (i = 0; i < n; i++)
+            copy[i] = ((const int *) mxGetData(arg))[i];
+    *copied = 1;
+    return copy;
+}
+
+/*
+ * Returns a copy (allocated with mxMalloc) of the n countmin hash parameters
+ * in arg, a uint32 or uint64 vector, or NULL if arg is not of this form or a
+ * value does not fit in a countmin_term_t (32 bits, or 64 bits in the
+ * large-scale build).
+ */
+countmin_term_t *GetHashParameters(const mxArray *arg, size_t n)
+{
+    int wide = mxIsClass(arg, "uint64");
+    countmin_term_t *params;
+    size_t i;
+
+    if ((!wide && !mxIsClass(arg, "uint32")) || mxGetNumberOfElements(arg) != n)
+        return NULL;
+    params = (countmin_term_t *) mxMalloc((n + 1) * sizeof(countmin_term_t));
+    for (i = 0; i < n; i++)
+    {
+        unsigned long long v = wide ? ((const unsigned long long *) mxGetData(arg))[i]
+                                    : ((const unsigned int *) mxGetData(arg))[i];
+        params[i] = (countmin_term_t) v;
+        if (params[i] != v)
+        {
+            mxFree(params);
+            return NULL;
+        }
+    }
+    return params;
+}
+
+/*
+ * Creates an n by 1 sparse vector with the K entries x(idx[k]+1) = vals[k]
+ * (idx 0-based and increasing).
+ */
+mxArray *CreateSparseColumn(size_t n, size_t K, const size_t *idx, const double *vals)
+{
+    mxArray *x = mxCreateSparse(n, 1, K, mxREAL);
+    mwIndex *ir = mxGetIr(x), *jc = mxGetJc(x);
+    size_t k;
+
+    jc[0] = 0;
+    jc[1] = K;
+    for (k = 0; k < K; k++)
+    {
+        ir[k] = idx[k];
+        mxGetPr(x)[k] = vals[k];
+    }
+    return x;
+}
+
+/* Outputs of the chunked median recoveries (see chunked.h) */
+#define CHUNKED_TOPK 1
+#define CHUNKED_FILE 2
+
+/*
+ * Reads the trailing arguments ('topk', K [, chunk]) or ('file', path
+ * [, chunk]) of a chunked median recovery from the nrhs arguments prhs.
+ * Returns CHUNKED_TOPK (setting *K) or CHUNKED_FILE (setting path), and sets
+ * *chunk (0 for the default), or returns 0 if the arguments are not of this
+ * form.
+ */
+int GetChunkedOutput(int nrhs, const mxArray *prhs[], size_t *K, char *path,
+                     size_t path_size, size_t *chunk)
+{
+    char mode[8];
+
+    if (nrhs < 2 || nrhs > 3 || !mxIsChar(prhs[0]) || mxGetString(prhs[0], mode, sizeof(mode)))
+        return 0;
+    *chunk = 0;
+    if (nrhs == 3)
+    {
+        if (!mxIsDouble(prhs[2]) || mxGetNumberOfElements(prhs[2]) != 1 ||
+            mxGetScalar(prhs[2]) < 1)
+            return 0;
+        *chunk = (size_t) (mxGetScalar(prhs[2]) + 0.1);
+    }
+    if (!strcmp(mode, "topk"))
+    {
+        if (!mxIsDouble(prhs[1]) || mxGetNumberOfElements(prhs[1]) != 1 ||
+            mxGetScalar(prhs[1]) < 0)
+            return 0;
+        *K = (size_t) (mxGetScalar(prhs[1]) + 0.1);
+        return CHUNKED_TOPK;
+    }
+    if (!strcmp(mode, "file") && mxIsChar(prhs[1]) && !mxGetString(prhs[1], path, path_size))
+        return CHUNKED_FILE;
+    return 0;
+}
+
 #endif  /* MEXUTIL_H */
@@ -0,0 +1,76 @@
+/*
+ * Thin wrappers around OpenMP so that the code also compiles (and runs on a
+ * single thread) when OpenMP is not enabled, e.g. with a plain "mex file.c".
+ * Compile with -fopenmp (or the equivalent flag) to enable threading.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#ifdef _OPENMP
+#include <omp.h>
+#define ParallelMaxThreads()    omp_get_max_threads()
+#define ParallelNumThreads()    omp_get_num_threads()
+#define ParallelThreadNum()     omp_get_thread_num()
+typedef omp_lock_t parallel_lock_t;
+#define ParallelLockInit(l)     omp_init_lock(l)
+#define ParallelLockDestroy(l)  omp_destroy_lock(l)
+#define ParallelLock(l)         omp_set_lock(l)
+#define ParallelUnlock(l)       omp_unset_lock(l)
+#else
+#define ParallelMaxThreads()    1
+#define ParallelNumThreads()    1
+#define ParallelThreadNum()     0
+typedef int parallel_lock_t;
+#define ParallelLockInit(l)     ((void) (l))
+#define ParallelLockDestroy(l)  ((void) (l))
+#define ParallelLock(l)         ((void) (l))
+#define ParallelUnlock(l)       ((void) (l))
+#endif
+
+#include <stdio.h>
+
+/* Number of columns per work unit in loops with dynamic scheduling */
+#define PARALLEL_BLOCK_SIZE 16384
+
+/* Start of the t-th of nt contiguous chunks of [0, n) */
+#define ParallelChunkStart(n, t, nt) (((long long) (n) * (t)) / (nt))
+
+
+/*
+ * Progress counter shared by the threads of a parallel loop. Workers add the
+ * number of items they completed; only the master thread prints, once every
+ * report_every items (matching the "%d columns complete." messages of the
+ * serial kernels).
+ */
+typedef struct parallel_progress_t
+{
+    long long done;
+    long long next_report;
+    long long report_every;
+} parallel_progress_t;
+
+void ParallelProgressInit(parallel_progress_t *p, long long report_every)
+{
+    p->done = 0;
+    p->report_every = report_every;
+    p->next_report = report_every;
+}
+
+void ParallelProgressAdd(parallel_progress_t *p, long long count)
+{
+    long long done;
+
+#pragma omp atomic capture
+    done = p->done += count;
+
+    if (ParallelThreadNum() != 0)
+        return;
+    if (done >= p->next_report)
+    {
+        printf("%lld columns complete.\n", done - done % p->report_every);
+        p->next_report = done - done % p->report_every + p->report_every;
+    }
+}
+
+#endif  /* PARALLEL_H */
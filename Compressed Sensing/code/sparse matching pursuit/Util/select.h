@@ -0,0 +1,278 @@
+/*
+ * Selection of the k-th smallest element, with bounded worst case.
+ *
+ * SelectKth is an iterative introselect: each round partitions the current
+ * range around a pivot into (< pivot, == pivot, > pivot) and continues in the
+ * part holding the k-th element, so there is no recursion on the partitions
+ * and values equal to the pivot (heavy ties) are finished in one round. The
+ * pivots are medians of three random elements; if the selection has not
+ * finished after 2*log2(n) + 4 rounds (the 4 spare rounds keep small ranges
+ * on random pivots), the remaining rounds use the deterministic median of
+ * medians, which bounds the running time to O(n) (its recursion is on n/5
+ * elements, so its depth is O(log n)).
+ *
+ * The random numbers come from a counter-based generator whose state is
+ * owned by the caller (or is local to the call), so concurrent selections do
+ * not share state. The partitions are branch-free (the comparison result only
+ * moves the output position), so they do not suffer from branch mispredictions
+ * on random data.
+ *
+ * For n >= SELECT_PARALLEL_MIN and several threads, a sample of the values
+ * gives two bounds that bracket the k-th element with high probability; the
+ * threads count the values below the bounds and gather the ones between them,
+ * and the selection finishes on that small set. If the bounds miss, the
+ * serial selection is used.
+ *
+ * The functions are defined for double (SelectKth), float (SelectKthFloat)
+ * and int (SelectKthInt32) by DEFINE_SELECT.
+ */
+
+#ifndef SELECT_H
+#define SELECT_H
+
+#include <stdlib.h>
+#include <math.h>
+#include "parallel.h"
+
+/* Ranges of at most this many values are finished with an insertion sort */
+#define SELECT_SMALL 16
+
+/* Smallest n for the multithreaded sample-then-filter selection */
+#define SELECT_PARALLEL_MIN (1 << 22)
+
+/* Sample size of the multithreaded selection */
+#define SELECT_SAMPLE 65536
+
+/* Half width (in sample ranks) of the bracket around the expected rank */
+#define SELECT_MARGIN 1024
+
+/* Number of chunks the threads of the multithreaded selection share */
+#define SELECT_CHUNKS 64
+
+/* Counter-based generator: a hash of the incremented state */
+static inline unsigned int SelectNext(unsigned int *state)
+{
+    unsigned int z = (*state += 0x9E3779B9u);
+    z = (z ^ (z >> 16)) * 0x85EBCA6Bu;
+    z = (z ^ (z >> 13)) * 0xC2B2AE35u;
+    return z ^ (z >> 16);
+}
+
+/* Random index in [0, n) */
+static inline size_t SelectIndex(unsigned int *state, size_t n)
+{
+    unsigned long long r = ((unsigned long long) SelectNext(state) << 32) | SelectNext(state);
+    return (size_t) (r % n);
+}
+
+static inline size_t SelectLog2(size_t n)
+{
+    size_t l = 0;
+    while (n >>= 1)
+        l++;
+    return l;
+}
+
+/* Start of the t-th of nt contiguous chunks of [0, n) */
+#define SelectChunkStart(n, t, nt) \
+    ((size_t) (((unsigned long long) (n) * (t)) / (nt)))
+
+
+#define DEFINE_SELECT(T, S)                                                   \
+                                                                              \
+static void SelectInsertionSort##S(T *A, size_t n)                            \
+{                                                                             \
+    size_t i, j;                                                              \
+    for (i = 1; i < n; i++)                                                   \
+    {                                                                         \
+        T v = A[i];                                                           \
+        for (j = i; j > 0 && A[j-1] > v; j--)                                 \
+            A[j] = A[j-1];                                                    \
+        A[j] = v;                                                             \
+    }                                                                         \
+}                                                                             \
+                                                                              \
+/* Moves the values < pivot to the front; returns how many there are */      \
+static size_t SelectPartitionLess##S(T *A, size_t n, T pivot)                 \
+{                                                                             \
+    size_t i, store = 0;                                                      \
+    for (i = 0; i < n; i++)                                                   \
+    {                                                                         \
+        T v = A[i];                                                           \
+        size_t less = v < pivot;                                              \
+        A[i] = A[store];                                                      \
+        A[store] = v;                                                         \
+        store += less;                                                        \
+    }                                                                         \
+    return store;                                                             \
+}                                                                             \
+                                                                              \
+/* Moves the values == pivot to the front; returns how many there are */     \
+static size_t SelectPartitionEqual##S(T *A, size_t n, T pivot)                \
+{                                                                             \
+    size_t i, store = 0;                                                      \
+    for (i = 0; i < n; i++)                                                   \
+    {                                                                         \
+        T v = A[i];                                                           \
+        size_t equal = v == pivot;                                            \
+        A[i] = A[store];                                                      \
+        A[store] = v;                                                         \
+        store += equal;                                                       \
+    }                                                                         \
+    return store;                                                             \
+}                                                                             \
+                                                                              \
+static T SelectRounds##S(T *A, size_t n, size_t k, unsigned int *rng,         \
+                         size_t random_rounds);                               \
+                                                                              \
+/* Median of medians of groups of 5 (moved to the front of A) */              \
+static T SelectMedianOfMedians##S(T *A, size_t n)                             \
+{                                                                             \
+    size_t g, m = 0;                                                          \
+    for (g = 0; g + 5 <= n; g += 5)                                           \
+    {                                                                         \
+        T v;                                                                  \
+        SelectInsertionSort##S(A + g, 5);                                     \
+        v = A[g+2];                                                           \
+        A[g+2] = A[m];                                                        \
+        A[m++] = v;                                                           \
+    }                                                                         \
+    return SelectRounds##S(A, m, (m + 1) / 2, NULL, 0);                       \
+}                                                                             \
+                                                                              \
+/* Selection rounds; the first random_rounds ones use random pivots */        \
+static T SelectRounds##S(T *A, size_t n, size_t k, unsigned int *rng,         \
+                         size_t random_rounds)                                \
+{                                                                             \
+    size_t lo = 0, hi = n, lt, eq;                                            \
+    T pivot;                                                                  \
+                                                                              \
+    k--;                                                                      \
+    for (;;)                                                                  \
+    {                                                                         \
+        size_t len = hi - lo;                                                 \
+        if (len <= SELECT_SMALL)                                              \
+        {                                                                     \
+            SelectInsertionSort##S(A + lo, len);                              \
+            return A[k];                                                      \
+        }                                                                     \
+        if (random_rounds > 0)                                                \
+        {                                                                     \
+            T a = A[lo + SelectIndex(rng, len)];                              \
+            T b = A[lo + SelectIndex(rng, len)];                              \
+            T c = A[lo + SelectIndex(rng, len)];                              \
+            pivot = (a < b) ? ((b < c) ? b : (a < c) ? c : a)                 \
+                            : ((a < c) ? a : (b < c) ? c : b);                \
+            random_rounds--;                                                  \
+        }                                                                     \
+        else                                                                  \
+            pivot = SelectMedianOfMedians##S(A + lo, len);                    \
+                                                                              \
+        lt = lo + SelectPartitionLess##S(A + lo, len, pivot);                 \
+        eq = lt + SelectPartitionEqual##S(A + lt, hi - lt, pivot);            \
+        if (k < lt)                                                           \
+            hi = lt;                                                          \
+        else if (k < eq || eq == lt)                                          \
+            return pivot;  /* (eq == lt only for a NaN pivot) */              \
+        else                                                                  \
+            lo = eq;                                                          \
+    }                                                                         \
+}                                                                             \
+                                                                              \
+/*                                                                            \
+ * Sample-then-filter selection with several threads (see above). Returns 0   \
+ * (and leaves *result alone) if the bracket missed the k-th element or the   \
+ * memory could not be allocated. Does not modify A.                          \
+ */                                                                           \
+static int SelectFilter##S(const T *A, size_t n, size_t k, unsigned int *rng, \
+                           T *result)                                         \
+{                                                                             \
+    T *sample, low, high, *within;                                            \
+    size_t i, rank, low_rank, high_rank, below = 0, num_within;               \
+    size_t counts[SELECT_CHUNKS], offsets[SELECT_CHUNKS + 1];                 \
+    int t;                                                                    \
+                                                                              \
+    sample = (T *) malloc(SELECT_SAMPLE * sizeof(T));                         \
+    if (!sample)                                                              \
+        return 0;                                                             \
+    for (i = 0; i < SELECT_SAMPLE; i++)                                       \
+        sample[i] = A[SelectIndex(rng, n)];                                   \
+    rank = (size_t) ((double) k / n * SELECT_SAMPLE);                         \
+    low_rank = (rank > SELECT_MARGIN) ? rank - SELECT_MARGIN : 1;             \
+    high_rank = (rank + SELECT_MARGIN < SELECT_SAMPLE) ?                      \
+        rank + SELECT_MARGIN : SELECT_SAMPLE;                                 \
+    low = SelectRounds##S(sample, SELECT_SAMPLE, low_rank, rng,               \
+                          2 * SelectLog2(SELECT_SAMPLE));                     \
+    high = SelectRounds##S(sample, SELECT_SAMPLE, high_rank, rng,             \
+                           2 * SelectLog2(SELECT_SAMPLE));                    \
+    free(sample);                                                             \
+    if (!(low <= high))                                                       \
+        return 0;                                                             \
+                                                                              \
+    /* Count, per chunk, the values below and within [low, high] */          \
+_Pragma("omp parallel for private(i) reduction(+:below) schedule(dynamic)") \
+    for (t = 0; t < SELECT_CHUNKS; t++)                                       \
+    {                                                                         \
+        size_t end = SelectChunkStart(n, t + 1, SELECT_CHUNKS), w = 0;        \
+        for (i = SelectChunkStart(n, t, SELECT_CHUNKS); i < end; i++)         \
+        {                                                                     \
+            below += A[i] < low;                                              \
+            w += (A[i] >= low) & (A[i] <= high);                              \
+        }                                                                     \
+        counts[t] = w;                                                        \
+    }                                                                         \
+    offsets[0] = 0;                                                           \
+    for (t = 0; t < SELECT_CHUNKS; t++)                                       \
+        offsets[t+1] = offsets[t] + counts[t];                                \
+    num_within = offsets[SELECT_CHUNKS];                                      \
+                                                                              \
+    if (k <= below || k > below + num_within)                                 \
+        return 0;                                                             \
+    if (low == high)                                                          \
+    {                                                                         \
+        *result = low;                                                        \
+        return 1;                                                             \
+    }                                                                         \
+    within = (T *) malloc(num_within * sizeof(T));                            \
+    if (!within)                                                              \
+        return 0;                                                             \
+                                                                              \
+_Pragma("omp parallel for private(i) schedule(dynamic)")                 \
+    for (t = 0; t < SELECT_CHUNKS; t++)                                       \
+    {                                                                         \
+        size_t end = SelectChunkStart(n, t + 1, SELECT_CHUNKS);               \
+        size_t w = offsets[t];                                                \
+        for (i = SelectChunkStart(n, t, SELECT_CHUNKS); i < end; i++)         \
+            if (A[i] >= low && A[i] <= high)                                  \
+                within[w++] = A[i];                                           \
+    }                                                                         \
+    *result = SelectRounds##S(within, num_within, k - below, rng,             \
+                              2 * SelectLog2(num_within) + 4);                \
+    free(within);                                                             \
+    return 1;                                                                 \
+}                                                                             \
+                                                                              \
+/*                                                                            \
+ * Returns the k-th smallest (1 <= k <= n) of the n values of A, which may be \
+ * scrambled. rng is the state of the pivot generator (see SelectNext), or    \
+ * NULL to use a fixed starting state.                                        \
+ */                                                                           \
+T SelectKth##S(T *A, size_t n, size_t k, unsigned int *rng)                   \
+{                                                                             \
+    unsigned int state = 0x2545F491u;                                         \
+    T result;                                                                 \
+    if (!rng)                                                                 \
+        rng = &state;                                                         \
+    if (n >= SELECT_PARALLEL_MIN && ParallelMaxThreads() > 1 &&               \
+        SelectFilter##S(A, n, k, rng, &result))                               \
+        return result;                                                        \
+    return SelectRounds##S(A, n, k, rng, 2 * SelectLog2(n) + 4);              \
+}
+
+DEFINE_SELECT(double, )
+DEFINE_SELECT(float, Float)
+DEFINE_SELECT(int, Int32)
+
+#undef DEFINE_SELECT
+
+#endif  /* SELECT_H */
@@ -0,0 +1,215 @@
+/*
+ * Sketch shards: a versioned binary file holding a matrix descriptor (the
+ * hash parameters of an implicit countmin_twowise matrix, or the neighbors of
+ * an explicit one) and a sketch y of length M. Shards with the same
+ * descriptor merge by adding their sketches, so independent processes can
+ * sketch disjoint parts of a signal and one process can decode the sum.
+ *
+ * Layout (version 1, little-endian, no padding):
+ *   char     magic[8]          "SMPSHARD"
+ *   uint32   version           SHARD_VERSION
+ *   uint32   type              SKETCH_MATRIX_EXPLICIT or SKETCH_MATRIX_IMPLICIT
+ *   uint64   N
+ *   uint32   M, D, B           (B is 0 for explicit matrices)
+ *   uint32   reserved          0
+ *   implicit: uint64 Ps[D], As[D], Bs[D]
+ *   explicit: uint32 neighbors[N*D]   (N by D column-major, values 1..M)
+ *   double   y[M]
+ * The hash parameters are stored in 64 bits whatever the build, so a shard
+ * written by the large-scale build can be read by the default one as long as
+ * its values fit (see indices.h).
+ *
+ * The files are written and read with the native byte order, so the functions
+ * fail on big-endian hosts.
+ */
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sketch_matrix.h"
+
+#define SHARD_MAGIC "SMPSHARD"
+#define SHARD_VERSION 1
+
+typedef struct sketch_descriptor_t
+{
+    int type;
+    sketch_index_t N;
+    int M, D, B;
+    /* Implicit matrices: D parameters each */
+    countmin_term_t *Ps, *As, *Bs;
+    /* Explicit matrices: the N by D column-major neighbors matrix */
+    unsigned int *neighbors;
+} sketch_descriptor_t;
+
+
+static int ShardLittleEndian(void)
+{
+    unsigned int one = 1;
+    return *(unsigned char *) &one == 1;
+}
+
+static int ShardWriteWord(FILE *f, unsigned long long v, size_t bytes)
+{
+    unsigned int v32 = (unsigned int) v;
+    return fwrite(bytes == 4 ? (void *) &v32 : (void *) &v, bytes, 1, f) == 1;
+}
+
+static int ShardReadWord(FILE *f, unsigned long long *v, size_t bytes)
+{
+    unsigned int v32;
+    if (bytes == 4)
+    {
+        if (fread(&v32, 4, 1, f) != 1)
+            return 0;
+        *v = v32;
+        return 1;
+    }
+    return fread(v, 8, 1, f) == 1;
+}
+
+/*
+ * Writes descriptor d and sketch y (length d->M) to path. Returns 0 on
+ * failure.
+ */
+int ShardWrite(const char *path, const sketch_descriptor_t *d, const double *y)
+{
+    size_t ND = (size_t) d->N * d->D;
+    int ok, i;
+    FILE *f;
+
+    if (!ShardLittleEndian() || !(f = fopen(path, "wb")))
+        return 0;
+
+    ok = fwrite(SHARD_MAGIC, 8, 1, f) == 1 &&
+         ShardWriteWord(f, SHARD_VERSION, 4) &&
+         ShardWriteWord(f, d->type, 4) &&
+         ShardWriteWord(f, d->N, 8) &&
+         ShardWriteWord(f, d->M, 4) &&
+         ShardWriteWord(f, d->D, 4) &&
+         ShardWriteWord(f, d->type == SKETCH_MATRIX_IMPLICIT ? d->B : 0, 4) &&
+         ShardWriteWord(f, 0, 4);
+    if (d->type == SKETCH_MATRIX_IMPLICIT)
+    {
+        for (i = 0; ok && i < d->D; i++)
+            ok = ShardWriteWord(f, d->Ps[i], 8);
+        for (i = 0; ok && i < d->D; i++)
+            ok = ShardWriteWord(f, d->As[i], 8);
+        for (i = 0; ok && i < d->D; i++)
+            ok = ShardWriteWord(f, d->Bs[i], 8);
+    }
+    else
+        ok = ok && fwrite(d->neighbors, sizeof(unsigned int), ND, f) == ND;
+    ok = ok && fwrite(y, sizeof(double), d->M, f) == (size_t) d->M;
+
+    return (fclose(f) == 0) && ok;
+}
+
+/* Frees the arrays of a descriptor filled by ShardRead */
+void ShardFree(sketch_descriptor_t *d)
+{
+    free(d->Ps);
+    free(d->neighbors);
+    memset(d, 0, sizeof(sketch_descriptor_t));
+}
+
+/*
+ * Reads a shard into d (whose arrays are allocated, see ShardFree) and *y
+ * (allocated, length d->M). Returns 0 if the file could not be read, is not a
+ * shard of this version, or holds values that do not fit this build.
+ */
+int ShardRead(const char *path, sketch_descriptor_t *d, double **y)
+{
+    char magic[8];
+    unsigned long long version, type, N, M, D, B, reserved, v;
+    countmin_term_t *params;
+    size_t ND;
+    int ok, i;
+    FILE *f;
+
+    memset(d, 0, sizeof(sketch_descriptor_t));
+    *y = NULL;
+    if (!ShardLittleEndian() || !(f = fopen(path, "rb")))
+        return 0;
+
+    ok = fread(magic, 8, 1, f) == 1 && !memcmp(magic, SHARD_MAGIC, 8) &&
+         ShardReadWord(f, &version, 4) && version == SHARD_VERSION &&
+         ShardReadWord(f, &type, 4) &&
+         ShardReadWord(f, &N, 8) && ShardReadWord(f, &M, 4) &&
+         ShardReadWord(f, &D, 4) && ShardReadWord(f, &B, 4) &&
+         ShardReadWord(f, &reserved, 4);
+    ok = ok && (type == SKETCH_MATRIX_EXPLICIT || type == SKETCH_MATRIX_IMPLICIT) &&
+         N > 0 && (unsigned long long) (sketch_index_t) N == N &&
+         M > 0 && M <= 0x7FFFFFFF && D > 0 && D <= M &&
+         (type == SKETCH_MATRIX_EXPLICIT || (B > 0 && B * D <= M));
+    if (!ok)
+    {
+        fclose(f);
+        return 0;
+    }
+
+    d->type = (int) type;
+    d->N = (sketch_index_t) N;
+    d->M = (int) M;
+    d->D = (int) D;
+    d->B = (int) B;
+    ND = (size_t) d->N * d->D;
+
+    if (d->type == SKETCH_MATRIX_IMPLICIT)
+    {
+        params = (countmin_term_t *) malloc(3 * d->D * sizeof(countmin_term_t));
+        ok = params != NULL;
+        for (i = 0; ok && i < 3 * d->D; i++)
+        {
+            ok = ShardReadWord(f, &v, 8) && (unsigned long long) (countmin_term_t) v == v;
+            params[i] = (countmin_term_t) v;
+        }
+        d->Ps = params;
+        d->As = params ? params + d->D : NULL;
+        d->Bs = params ? params + 2 * d->D : NULL;
+    }
+    else
+    {
+        d->neighbors = (unsigned int *) malloc(ND * sizeof(unsigned int));
+        ok = d->neighbors && fread(d->neighbors, sizeof(unsigned int), ND, f) == ND;
+    }
+
+    *y = (double *) malloc(d->M * sizeof(double));
+    ok = ok && *y && fread(*y, sizeof(double), d->M, f) == (size_t) d->M;
+    fclose(f);
+
+    if (!ok)
+    {
+        ShardFree(d);
+        free(*y);
+        *y = NULL;
+    }
+    return ok;
+}
+
+/* Returns 1 if the two descriptors describe the same matrix */
+int ShardSameDescriptor(const sketch_descriptor_t *a, const sketch_descriptor_t *b)
+{
+    if (a->type != b->type || a->N != b->N || a->M != b->M || a->D != b->D)
+        return 0;
+    if (a->type == SKETCH_MATRIX_IMPLICIT)
+        return a->B == b->B &&
+               !memcmp(a->Ps, b->Ps, a->D * sizeof(countmin_term_t)) &&
+               !memcmp(a->As, b->As, a->D * sizeof(countmin_term_t)) &&
+               !memcmp(a->Bs, b->Bs, a->D * sizeof(countmin_term_t));
+    return !memcmp(a->neighbors, b->neighbors, (size_t) a->N * a->D * sizeof(unsigned int));
+}
+
+/* Creates the matrix of a descriptor. Returns 0 on failure (see
+ * SketchMatrixCreateExplicit and SketchMatrixCreateImplicit). */
+int ShardCreateMatrix(sketch_matrix_t *m, const sketch_descriptor_t *d)
+{
+    if (d->type == SKETCH_MATRIX_IMPLICIT)
+        return SketchMatrixCreateImplicit(m, d->N, d->M, d->D, d->B, d->Ps, d->As, d->Bs);
+    return SketchMatrixCreateExplicit(m, d->N, d->M, d->D, d->neighbors);
+}
+
+#endif  /* SHARD_H */
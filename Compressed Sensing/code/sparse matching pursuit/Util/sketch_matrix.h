@@ -0,0 +1,256 @@
+/*
+ * A measurement matrix object that keeps its derived indexes (the bipartite
+ * graph, the SSMP decoder) around between operations. It is either explicit
+ * (given by its neighbors matrix) or an implicit countmin_twowise matrix
+ * (given by its hash parameters).
+ *
+ * An explicit matrix can also be a mapped graph file (see graphfile.h); its
+ * multiply and median recovery then stream through the file.
+ *
+ * Used by matrix_handle.c to keep matrices resident between MEX calls.
+ */
+
+#ifndef SKETCH_MATRIX_H
+#define SKETCH_MATRIX_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "bipartite.h"
+#include "graphfile.h"
+#include "countmin.h"
+#include "ssmp.h"
+
+#define SKETCH_MATRIX_EXPLICIT 1
+#define SKETCH_MATRIX_IMPLICIT 2
+
+typedef struct sketch_matrix_t
+{
+    int type;
+    sketch_index_t N;
+    int M, D;
+
+    /* Implicit matrices only */
+    countmin_hash_t hash;
+
+    /* Always present for explicit matrices; built on demand (for SSMP) for
+     * implicit ones */
+    bipartite_graph_t graph;
+    int has_graph;
+
+    /* Built on the first SSMP call */
+    ssmp_t decoder;
+    int has_decoder;
+} sketch_matrix_t;
+
+
+/* neighbors is an N by D column-major matrix with values between 1 and M.
+ * Returns 0 on failure (see GraphBuild). */
+int SketchMatrixCreateExplicit(sketch_matrix_t *m, sketch_index_t N, int M, int D,
+                               const unsigned int *neighbors)
+{
+    memset(m, 0, sizeof(sketch_matrix_t));
+    if (!GraphBuild(&m->graph, N, M, D, neighbors, 1))
+        return 0;
+    m->type = SKETCH_MATRIX_EXPLICIT;
+    m->N = N;
+    m->M = M;
+    m->D = D;
+    m->has_graph = 1;
+    return 1;
+}
+
+/* Maps the graph file at path. Without the right adjacency in the file only
+ * the median recoveries can be used. Returns 0 on failure (see GraphFileMap). */
+int SketchMatrixMapExplicit(sketch_matrix_t *m, const char *path)
+{
+    memset(m, 0, sizeof(sketch_matrix_t));
+    if (!GraphFileMap(&m->graph, path))
+        return 0;
+    m->type = SKETCH_MATRIX_EXPLICIT;
+    m->N = m->graph.N;
+    m->M = m->graph.M;
+    m->D = m->graph.D;
+    m->has_graph = 1;
+    return 1;
+}
+
+/* Returns 0 on failure (see CountMinCreate) */
+int SketchMatrixCreateImplicit(sketch_matrix_t *m, sketch_index_t N, int M, int D, int B,
+                               const countmin_term_t *Ps, const countmin_term_t *As,
+                               const countmin_term_t *Bs)
+{
+    memset(m, 0, sizeof(sketch_matrix_t));
+    if (!CountMinCreate(&m->hash, N, M, D, B, Ps, As, Bs))
+        return 0;
+    m->type = SKETCH_MATRIX_IMPLICIT;
+    m->N = N;
+    m->M = M;
+    m->D = D;
+    return 1;
+}
+
+void SketchMatrixDestroy(sketch_matrix_t *m)
+{
+    if (m->has_decoder)
+        SSMPDestroy(&m->decoder);
+    if (m->has_graph)
+        GraphDestroy(&m->graph);
+    if (m->type == SKETCH_MATRIX_IMPLICIT)
+        CountMinDestroy(&m->hash);
+    memset(m, 0, sizeof(sketch_matrix_t));
+}
+
+/* Makes sure the bipartite graph is built. Returns 0 on failure. */
+int SketchMatrixGraph(sketch_matrix_t *m)
+{
+    unsigned int *neighbors;
+    int ok;
+
+    if (m->has_graph)
+        return 1;
+
+    neighbors = (unsigned int *) malloc((size_t) m->N * m->D * sizeof(unsigned int));
+    if (!neighbors)
+        return 0;
+    CountMinNeighbors(&m->hash, neighbors);
+    ok = GraphBuild(&m->graph, m->N, m->M, m->D, neighbors, 1);
+    free(neighbors);
+
+    m->has_graph = ok;
+    return ok;
+}
+
+/*
+ * Single-signal operations for double, float (suffix Float) and int (suffix
+ * Int32) values:
+ *   SketchMatrixMul##S:            y = A*x (y has length M, x length N)
+ *   SketchMatrixMulTranspose##S:   x = A'*y
+ *   SketchMatrixMedianRecovery##S: x(i) = median of y(neighbors(i)); returns
+ *                                  0 if the workspace could not be allocated
+ */
+#define DEFINE_SKETCH_MATRIX_OPS(T, S)                                          \
+void SketchMatrixMul##S(const sketch_matrix_t *m, const T *x, T *y)             \
+{                                                                               \
+    if (m->graph.mapped_size)                                                   \
+        GraphStreamMul##S(&m->graph, x, y);                                     \
+    else if (m->type == SKETCH_MATRIX_EXPLICIT)                                 \
+        GraphMul##S(&m->graph, x, y);                                           \
+    else                                                                        \
+        CountMinMul##S(&m->hash, x, y);                                         \
+}                                                                               \
+                                                                                \
+void SketchMatrixMulTranspose##S(const sketch_matrix_t *m, const T *y, T *x)    \
+{                                                                               \
+    if (m->type == SKETCH_MATRIX_EXPLICIT)                                      \
+        GraphMulTranspose##S(&m->graph, y, x);                                  \
+    else                                                                        \
+        CountMinMulTranspose##S(&m->hash, y, x);                                \
+}                                                                               \
+                                                                                \
+int SketchMatrixMedianRecovery##S(const sketch_matrix_t *m, const T *y, T *x)   \
+{                                                                               \
+    if (m->graph.mapped_size)                                                   \
+        return GraphStreamMedianRecovery##S(&m->graph, y, x);                   \
+    else if (m->type == SKETCH_MATRIX_EXPLICIT)                                 \
+        return GraphMedianRecovery##S(&m->graph, y, x);                         \
+    else                                                                        \
+        return CountMinMedianRecovery##S(&m->hash, y, x);                       \
+}
+
+DEFINE_SKETCH_MATRIX_OPS(double, )
+DEFINE_SKETCH_MATRIX_OPS(float, Float)
+DEFINE_SKETCH_MATRIX_OPS(int, Int32)
+
+#undef DEFINE_SKETCH_MATRIX_OPS
+
+/* y = A*x for a sparse x with K nonzeros, x(idx[k]) = vals[k] (0-based) */
+void SketchMatrixMulSparse(const sketch_matrix_t *m, size_t K, const size_t *idx,
+                           const double *vals, double *y)
+{
+    if (m->type == SKETCH_MATRIX_EXPLICIT)
+        GraphMulSparse(&m->graph, K, idx, vals, y);
+    else
+        CountMinMulSparse(&m->hash, K, idx, vals, y);
+}
+
+/* y += A*x for a sparse x with K nonzeros, x(idx[k]) = vals[k] (0-based) */
+void SketchMatrixMulSparseAdd(const sketch_matrix_t *m, size_t K, const size_t *idx,
+                              const double *vals, double *y)
+{
+    if (m->type == SKETCH_MATRIX_EXPLICIT)
+        GraphMulSparseAdd(&m->graph, K, idx, vals, y);
+    else
+        CountMinMulSparseAdd(&m->hash, K, idx, vals, y);
+}
+
+/* x(k) = (A'*y)(idx[k]) for the K candidate columns idx (0-based) */
+void SketchMatrixMulTransposeAt(const sketch_matrix_t *m, const double *y, size_t K,
+                                const size_t *idx, double *x)
+{
+    if (m->type == SKETCH_MATRIX_EXPLICIT)
+        GraphMulTransposeAt(&m->graph, y, K, idx, x);
+    else
+        CountMinMulTransposeAt(&m->hash, y, K, idx, x);
+}
+
+/* Median recovery at the K candidate columns idx; see CountMinMedianRecoveryAt */
+int SketchMatrixMedianRecoveryAt(const sketch_matrix_t *m, const double *y, size_t K,
+                                 const size_t *idx, double threshold, double *x)
+{
+    if (m->type == SKETCH_MATRIX_EXPLICIT)
+        return GraphMedianRecoveryAt(&m->graph, y, K, idx, threshold, x);
+    else
+        return CountMinMedianRecoveryAt(&m->hash, y, K, idx, threshold, x);
+}
+
+/*
+ * Batched versions for R signals stored interleaved: entry (i, r) of an N by R
+ * (or M by R) block is at index i*R + r.
+ */
+void SketchMatrixMulBatch(const sketch_matrix_t *m, int R, const double *x, double *y)
+{
+    if (m->type == SKETCH_MATRIX_EXPLICIT)
+        GraphMulBatch(&m->graph, R, x, y);
+    else
+        CountMinMulBatch(&m->hash, R, x, y);
+}
+
+void SketchMatrixMulTransposeBatch(const sketch_matrix_t *m, int R, const double *y, double *x)
+{
+    if (m->type == SKETCH_MATRIX_EXPLICIT)
+        GraphMulTransposeBatch(&m->graph, R, y, x);
+    else
+        CountMinMulTransposeBatch(&m->hash, R, y, x);
+}
+
+/* Returns 0 if the workspace could not be allocated */
+int SketchMatrixMedianRecoveryBatch(const sketch_matrix_t *m, int R, const double *y, double *x)
+{
+    if (m->type == SKETCH_MATRIX_EXPLICIT)
+        return GraphMedianRecoveryBatch(&m->graph, R, y, x);
+    else
+        return CountMinMedianRecoveryBatch(&m->hash, R, y, x);
+}
+
+/*
+ * Runs SSMP on sketch y (see SSMPRunBatched) and returns the decoder holding
+ * the result in its X field, or NULL on failure. The decoder is kept for the
+ * next call.
+ */
+ssmp_t *SketchMatrixSSMP(sketch_matrix_t *m, const double *y, int inner_steps,
+                         int outer_steps, int sparsity, int batch,
+                         ssmp_progress_fn progress, void *context)
+{
+    if (!m->has_decoder)
+    {
+        if (!SketchMatrixGraph(m) || !SSMPCreate(&m->decoder, &m->graph))
+            return NULL;
+        m->has_decoder = 1;
+    }
+    if (!SSMPRunBatched(&m->decoder, y, inner_steps, outer_steps, sparsity, batch,
+                        progress, context))
+        return NULL;
+    return &m->decoder;
+}
+
+#endif  /* SKETCH_MATRIX_H */
@@ -0,0 +1,180 @@
+/*
+ * Writes and reads sketch shards (see shard.h), so that sketches can be
+ * produced or decoded outside Matlab (see Tools/shard_sketch, shard_merge and
+ * ssmp_decode).
+ */
+#include <stdio.h>
+#include <string.h>
+#include "mex.h"
+#include "matrix.h"
+#include "shard.h"
+#include "mexutil.h"
+
+char* usage =
+"Usage: sketch_shard('write', path, N, M, D, neighbors, y)           explicit matrix\n"
+"       sketch_shard('write', path, N, M, D, B, Ps, As, Bs, y)       implicit countmin_twowise matrix\n"
+"       [y, desc] = sketch_shard('read', path)\n"
+"  desc is a struct with fields type ('explicit' or 'implicit'), N, M, D and\n"
+"  either neighbors or B, Ps, As and Bs (uint32, or uint64 if a value does\n"
+"  not fit).\n";
+
+
+sketch_index_t GetScalar(const mxArray *arg)
+{
+    if (!mxIsDouble(arg) || mxIsComplex(arg) || mxGetNumberOfElements(arg) != 1)
+        mexErrMsgTxt("N, M, D and B should be real scalars.");
+    return (sketch_index_t) (mxGetScalar(arg) + 0.1);
+}
+
+void GetPath(const mxArray *arg, char *path, size_t size)
+{
+    if (!mxIsChar(arg) || mxGetString(arg, path, size))
+        mexErrMsgTxt("path should be a string.");
+}
+
+const double *GetVector(const mxArray *arg, size_t size)
+{
+    if (!mxIsDouble(arg) || mxIsComplex(arg) || mxGetNumberOfElements(arg) != size)
+        mexErrMsgTxt("y must be a real vector of size M.");
+    return mxGetPr(arg);
+}
+
+/* uint32 vector of the parameters, or uint64 if a value does not fit */
+mxArray *CreateHashParameters(const countmin_term_t *params, int D)
+{
+    mxArray *arg;
+    int i, wide = 0;
+
+    for (i = 0; i < D; i++)
+        wide |= (unsigned long long) params[i] > 0xFFFFFFFFull;
+    arg = mxCreateNumericMatrix(D, 1, wide ? mxUINT64_CLASS : mxUINT32_CLASS, mxREAL);
+    for (i = 0; i < D; i++)
+        if (wide)
+            ((unsigned long long *) mxGetData(arg))[i] = params[i];
+        else
+            ((unsigned int *) mxGetData(arg))[i] = (unsigned int) params[i];
+    return arg;
+}
+
+void Write(int nrhs, const mxArray *prhs[])
+{
+    sketch_descriptor_t d;
+    sketch_matrix_t m;
+    char path[4096];
+    const double *y;
+    int ok;
+
+    if (nrhs != 7 && nrhs != 10)
+        mexErrMsgTxt(usage);
+
+    GetPath(prhs[1], path, sizeof(path));
+    memset(&d, 0, sizeof(d));
+    d.N = GetScalar(prhs[2]);
+    d.M = GetScalar(prhs[3]);
+    d.D = GetScalar(prhs[4]);
+    if (d.N <= 0 || d.M <= 0 || d.D <= 0)
+        mexErrMsgTxt("N, M and D should be positive.");
+    y = GetVector(prhs[nrhs-1], d.M);
+
+    if (nrhs == 7)
+    {
+        d.type = SKETCH_MATRIX_EXPLICIT;
+        if (!mxIsClass(prhs[5], "uint32") || mxGetNumberOfElements(prhs[5]) != (size_t) d.N * d.D)
+            mexErrMsgTxt("neighbors must be a uint32 NxD matrix.");
+        d.neighbors = (unsigned int *) mxGetData(prhs[5]);
+    }
+    else
+    {
+        d.type = SKETCH_MATRIX_IMPLICIT;
+        d.B = GetScalar(prhs[5]);
+        d.Ps = GetHashParameters(prhs[6], d.D);
+        d.As = GetHashParameters(prhs[7], d.D);
+        d.Bs = GetHashParameters(prhs[8], d.D);
+        if (!d.Ps || !d.As || !d.Bs)
+            mexErrMsgTxt("Ps, As, Bs must be uint32 or uint64 vectors of size D.");
+    }
+
+    /* Only valid descriptors are written */
+    if (!ShardCreateMatrix(&m, &d))
+        mexErrMsgTxt(d.type == SKETCH_MATRIX_EXPLICIT ?
+                     "neighbors must be between 1 and M." :
+                     "Invalid hash parameters (D*B should be at most M, Ps at most "
+                     COUNTMIN_MAX_PRIME_TEXT ").");
+    SketchMatrixDestroy(&m);
+
+    ok = ShardWrite(path, &d, y);
+    if (d.type == SKETCH_MATRIX_IMPLICIT)
+    {
+        mxFree(d.Ps);
+        mxFree(d.As);
+        mxFree(d.Bs);
+    }
+    if (!ok)
+        mexErrMsgTxt("Could not write the shard.");
+}
+
+void Read(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    const char *explicit_fields[] = {"type", "N", "M", "D", "neighbors"};
+    const char *implicit_fields[] = {"type", "N", "M", "D", "B", "Ps", "As", "Bs"};
+    sketch_descriptor_t d;
+    char path[4096];
+    double *y;
+    mxArray *desc, *neighbors;
+
+    if (nrhs != 2)
+        mexErrMsgTxt(usage);
+
+    GetPath(prhs[1], path, sizeof(path));
+    if (!ShardRead(path, &d, &y))
+        mexErrMsgTxt("Could not read the shard (missing, truncated, of another version, or too "
+                     "large for this build).");
+
+    plhs[0] = mxCreateDoubleMatrix(d.M, 1, mxREAL);
+    memcpy(mxGetPr(plhs[0]), y, d.M * sizeof(double));
+    free(y);
+
+    if (d.type == SKETCH_MATRIX_EXPLICIT)
+    {
+        desc = mxCreateStructMatrix(1, 1, 5, explicit_fields);
+        mxSetField(desc, 0, "type", mxCreateString("explicit"));
+        neighbors = mxCreateNumericMatrix(d.N, d.D, mxUINT32_CLASS, mxREAL);
+        memcpy(mxGetData(neighbors), d.neighbors, (size_t) d.N * d.D * sizeof(unsigned int));
+        mxSetField(desc, 0, "neighbors", neighbors);
+    }
+    else
+    {
+        desc = mxCreateStructMatrix(1, 1, 8, implicit_fields);
+        mxSetField(desc, 0, "type", mxCreateString("implicit"));
+        mxSetField(desc, 0, "B", mxCreateDoubleScalar(d.B));
+        mxSetField(desc, 0, "Ps", CreateHashParameters(d.Ps, d.D));
+        mxSetField(desc, 0, "As", CreateHashParameters(d.As, d.D));
+        mxSetField(desc, 0, "Bs", CreateHashParameters(d.Bs, d.D));
+    }
+    mxSetField(desc, 0, "N", mxCreateDoubleScalar((double) d.N));
+    mxSetField(desc, 0, "M", mxCreateDoubleScalar(d.M));
+    mxSetField(desc, 0, "D", mxCreateDoubleScalar(d.D));
+    ShardFree(&d);
+
+    if (nlhs > 1)
+        plhs[1] = desc;
+    else
+        mxDestroyArray(desc);
+}
+
+void
+mexFunction(int nlhs, mxArray *plhs[],
+            int nrhs, const mxArray *prhs[])
+{
+    char command[32];
+
+    if (nrhs < 2 || !mxIsChar(prhs[0]) || mxGetString(prhs[0], command, sizeof(command)))
+        mexErrMsgTxt(usage);
+
+    if (!strcmp(command, "write"))
+        Write(nrhs, prhs);
+    else if (!strcmp(command, "read"))
+        Read(nlhs, plhs, nrhs, prhs);
+    else
+        mexErrMsgTxt(usage);
+}
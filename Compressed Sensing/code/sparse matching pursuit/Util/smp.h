@@ -0,0 +1,164 @@
+/*
+ * Native implementation of the SMP (Sparse Matching Pursuit) loop of smp.m,
+ * for explicit and implicit matrices (see sketch_matrix.h).
+ *
+ * The iterate x is kept as a list of at most l (index, value) pairs, sorted by
+ * index, and the residual c = b - A*x is updated with A*(x_old - x_new), which
+ * takes O(l*D) time, instead of being recomputed. The only N-length vectors
+ * are the median recovery of the residual and the scratch space for selecting
+ * its largest entries.
+ *
+ * Based on smp.m, written by Radu Berinde, 2008
+ */
+
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sketch_matrix.h"
+#include "sparsify.h"
+
+/* Called at the start of each iteration of SMPRun */
+typedef void (*smp_progress_fn)(void *context, int iteration, int T);
+
+/*
+ * Runs T iterations of SMP with sparsity l on sketch b (length M), as smp.m:
+ *     c = b - A*x;  u = sparsify(median_recovery(c), 2*l);
+ *     (limit |u|_1 to convergence_factor*|x|_1, if convergence_factor > 0)
+ *     x = sparsify(x + u, l);
+ * If tolerance > 0, stops early once |x_new - x|_1 <= tolerance * |x_new|_1.
+ *
+ * The result is written to idx (0-based, increasing) and vals, which must have
+ * room for l entries; *K is set to the number of entries. progress may be
+ * NULL. Returns 0 if the memory could not be allocated.
+ */
+int SMPRun(const sketch_matrix_t *m, const double *b, int l, int T,
+           double convergence_factor, double tolerance, size_t *K,
+           size_t *idx, double *vals, smp_progress_fn progress, void *context)
+{
+    sketch_index_t N = m->N;
+    int M = m->M, j;
+    size_t i, k, kx = 0, ku, kz, knew, kd;
+    double *c, *ustar, *work, *uvals, *zvals, *dvals, *newvals;
+    size_t *uidx, *zidx, *didx, *pos;
+    int ok;
+
+    c = (double *) malloc(M * sizeof(double));
+    ustar = (double *) malloc(N * sizeof(double));
+    work = (double *) malloc(N * sizeof(double));
+    /* u has up to 2l entries; x + u and x_old - x_new up to 3l */
+    uidx = (size_t *) malloc((2 * (size_t) l + 1) * sizeof(size_t));
+    uvals = (double *) malloc((2 * (size_t) l + 1) * sizeof(double));
+    zidx = (size_t *) malloc((3 * (size_t) l + 1) * sizeof(size_t));
+    zvals = (double *) malloc((3 * (size_t) l + 1) * sizeof(double));
+    didx = (size_t *) malloc((3 * (size_t) l + 1) * sizeof(size_t));
+    dvals = (double *) malloc((3 * (size_t) l + 1) * sizeof(double));
+    pos = (size_t *) malloc((3 * (size_t) l + 1) * sizeof(size_t));
+    newvals = (double *) malloc((3 * (size_t) l + 1) * sizeof(double));
+
+    ok = c && ustar && work && uidx && uvals && zidx && zvals && didx && dvals &&
+         pos && newvals;
+    if (ok)
+    {
+        memcpy(c, b, M * sizeof(double));
+
+        for (j = 1; j <= T; j++)
+        {
+            double nx = 0, nu = 0, nd = 0, nnew = 0;
+
+            if (progress)
+                progress(context, j, T);
+
+            if (!SketchMatrixMedianRecovery(m, c, ustar))
+            {
+                ok = 0;
+                break;
+            }
+            ku = SparsifyTopK(ustar, N, 2 * (size_t) l, work, uidx, uvals);
+
+            /* Convergence control */
+            if (j > 1 && convergence_factor > 0)
+            {
+                for (k = 0; k < kx; k++)
+                    nx += fabs(vals[k]);
+                for (k = 0; k < ku; k++)
+                    nu += fabs(uvals[k]);
+                if (nu > nx * convergence_factor)
+                    for (k = 0; k < ku; k++)
+                        uvals[k] *= convergence_factor * nx / nu;
+            }
+
+            /* z = x + u */
+            for (i = k = kz = 0; i < kx || k < ku; kz++)
+                if (k == ku || (i < kx && idx[i] < uidx[k]))
+                {
+                    zidx[kz] = idx[i];
+                    zvals[kz] = vals[i++];
+                }
+                else if (i == kx || uidx[k] < idx[i])
+                {
+                    zidx[kz] = uidx[k];
+                    zvals[kz] = uvals[k++];
+                }
+                else
+                {
+                    zidx[kz] = idx[i];
+                    zvals[kz] = vals[i++] + uvals[k++];
+                }
+
+            /* x_new = sparsify(z, l); its entries are a subsequence of z */
+            knew = SparsifyTopK(zvals, kz, l, work, pos, newvals);
+
+            /* d = x_old - x_new, to update c = b - A*x */
+            for (i = k = kd = 0; i < kx || k < knew; kd++)
+                if (k == knew || (i < kx && idx[i] < zidx[pos[k]]))
+                {
+                    didx[kd] = idx[i];
+                    dvals[kd] = vals[i++];
+                }
+                else if (i == kx || zidx[pos[k]] < idx[i])
+                {
+                    didx[kd] = zidx[pos[k]];
+                    dvals[kd] = -newvals[k++];
+                }
+                else
+                {
+                    didx[kd] = idx[i];
+                    dvals[kd] = vals[i++] - newvals[k++];
+                }
+            SketchMatrixMulSparseAdd(m, kd, didx, dvals, c);
+
+            for (k = 0; k < knew; k++)
+            {
+                idx[k] = zidx[pos[k]];
+                vals[k] = newvals[k];
+                nnew += fabs(vals[k]);
+            }
+            kx = knew;
+
+            for (k = 0; k < kd; k++)
+                nd += fabs(dvals[k]);
+            if (tolerance > 0 && nd <= tolerance * nnew)
+                break;
+        }
+        if (ok)
+            *K = kx;
+    }
+
+    free(c);
+    free(ustar);
+    free(work);
+    free(uidx);
+    free(uvals);
+    free(zidx);
+    free(zvals);
+    free(didx);
+    free(dvals);
+    free(pos);
+    free(newvals);
+    return ok;
+}
+
+#endif  /* SMP_H */
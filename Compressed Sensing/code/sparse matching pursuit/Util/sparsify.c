@@ -2,7 +2,13 @@
  * "Sparsifies" a vector - retains the largest (in absolute value) k elements
  * and zeroes out everything else.
  *
- * Usage: res = sparsify(vector, k)
+ * Usage: res = sparsify(vector, k [, 'sparse'])
+ *
+ *   With 'sparse', or if vector is itself a sparse column vector, res is a
+ *   sparse column vector built directly from the k (index, value) pairs; a
+ *   sparse input is processed through its nonzeros only.
+ *
+ *   A single or int32 vector (without 'sparse') gives res of the same class.
  *
  * Written by Radu Berinde, MIT
  */
@@ -11,40 +17,118 @@
 #include "mex.h"
 #include "matrix.h"
 #include "sparsify.h"
+#include "mexutil.h"
+
+char* usage = "Usage: res = sparsify(vector, k [, 'sparse'])";
 
-/* Arguments: vector, k */
+/* Arguments: vector, k [, 'sparse'] */
 /* Returns: resulting vector */
 void
 mexFunction(int nlhs, mxArray *plhs[],
             int nrhs, const mxArray *prhs[])
 {
-    int N, K;
+    int N, K, sparse_output = 0, value_class;
     const double *A;
-    double *result;
+    double *result, *work, *vals;
+    size_t n, count, k, *idx;
+    const mwIndex *ir = NULL;
+    mwIndex *out_ir, *out_jc;
+    char option[8];
 
-    if (nrhs != 2 && nlhs != 1)
-        mexErrMsgTxt("Usage: res = sparsify(vector, k)");
+    if ((nrhs != 2 && nrhs != 3) || nlhs > 1)
+        mexErrMsgTxt(usage);
 
-    if (!mxIsDouble(prhs[0]) || mxIsComplex(prhs[0]))
+    value_class = GetValueClass(prhs[0], mxGetNumberOfElements(prhs[0]));
+    if (!value_class && (!mxIsDouble(prhs[0]) || mxIsComplex(prhs[0])))
         mexErrMsgTxt("First argument must be a real vector.");
 
-    A = (const double *) mxGetData(prhs[0]);
-    N = mxGetNumberOfElements(prhs[0]);
-
-
     if (!mxIsDouble(prhs[1]) || mxIsComplex(prhs[1]) ||
         mxGetNumberOfElements(prhs[1]) != 1)
         mexErrMsgTxt("Second arguments should be real scalar.");
 
+    if (nrhs == 3)
+    {
+        if (!mxIsChar(prhs[2]) || mxGetString(prhs[2], option, sizeof(option)) ||
+            strcmp(option, "sparse"))
+            mexErrMsgTxt(usage);
+        sparse_output = 1;
+    }
+
+    A = (const double *) mxGetData(prhs[0]);
+    N = mxGetNumberOfElements(prhs[0]);
+    n = N;
+    if (mxIsSparse(prhs[0]))
+    {
+        if (mxGetN(prhs[0]) != 1)
+            mexErrMsgTxt("A sparse vector must be a column vector.");
+        N = mxGetM(prhs[0]);
+        ir = mxGetIr(prhs[0]);
+        n = mxGetJc(prhs[0])[1];
+        sparse_output = 1;
+    }
+
     K = (int) (mxGetScalar(prhs[1]) + 0.1);
 
     if (K < 0 || K > N)
         mexErrMsgTxt("k should be between 0 and the length of the vector.\n");
 
-    plhs[0] = mxCreateDoubleMatrix(N, 1, mxREAL);
-    result = mxGetPr(plhs[0]);
+    if (value_class == VALUE_SINGLE || value_class == VALUE_INT32)
+    {
+        if (sparse_output)
+            mexErrMsgTxt("'sparse' needs a double vector.");
+        plhs[0] = CreateValueMatrix(N, 1, value_class);
+        if (value_class == VALUE_SINGLE)
+        {
+            float *values = (float *) mxGetData(plhs[0]);
+            float *fwork = (float *) mxMalloc((N + 1) * sizeof(float));
+            memcpy(values, mxGetData(prhs[0]), N * sizeof(float));
+            SparsifyInPlaceFloat(values, N, K, fwork);
+            mxFree(fwork);
+        }
+        else
+        {
+            int *values = (int *) mxGetData(plhs[0]);
+            work = (double *) mxMalloc((N + 1) * sizeof(double));
+            memcpy(values, mxGetData(prhs[0]), N * sizeof(int));
+            SparsifyInPlaceInt32(values, N, K, work);
+            mxFree(work);
+        }
+        return;
+    }
+
+    if (!sparse_output)
+    {
+        plhs[0] = mxCreateDoubleMatrix(N, 1, mxREAL);
+        result = mxGetPr(plhs[0]);
 
-    memcpy(result, A, N * sizeof(double));
+        memcpy(result, A, N * sizeof(double));
+
+        work = (double *) mxMalloc((N + 1) * sizeof(double));
+        SparsifyInPlace(result, N, K, work);
+        mxFree(work);
+        return;
+    }
+
+    if ((size_t) K > n)
+        K = n;
+    work = (double *) mxMalloc((n + 1) * sizeof(double));
+    idx = (size_t *) mxMalloc((K + 1) * sizeof(size_t));
+    vals = (double *) mxMalloc((K + 1) * sizeof(double));
+    count = SparsifyTopK(A, n, K, work, idx, vals);
+
+    plhs[0] = mxCreateSparse(N, 1, count, mxREAL);
+    out_ir = mxGetIr(plhs[0]);
+    out_jc = mxGetJc(plhs[0]);
+    result = mxGetPr(plhs[0]);
+    out_jc[0] = 0;
+    out_jc[1] = count;
+    for (k = 0; k < count; k++)
+    {
+        out_ir[k] = ir ? ir[idx[k]] : idx[k];
+        result[k] = vals[k];
+    }
 
-    sparsify(result, N, K);
+    mxFree(work);
+    mxFree(idx);
+    mxFree(vals);
 }
@@ -1,54 +1,215 @@
 /*
  * Routine that "sparsifies" a vector (keeps the highest elements).
  *
+ * The routines below take caller-owned scratch space (work, with room for n
+ * values) so that repeated calls do not allocate. Each makes one pass to
+ * compute the absolute values, the selection of the threshold, and one pass
+ * that keeps the entries above the threshold while recording the positions
+ * of the entries equal to it; the ties are then resolved in time proportional
+ * to their number. SparsifyTopK emits the result as (index, value) pairs
+ * without writing a dense vector.
+ *
  * Written by: Radu Berinde
  */
 
 #ifndef SPARSIFY_H
-#define SPARISFY_H
+#define SPARSIFY_H
 
 #include <math.h>
 #include <stdio.h>
-#include "randomized_select.h"
+#include <stdlib.h>
+#include <string.h>
+#include "select.h"
 
 /*
- * Zero out all but the largest (in absolute value) K elements of the given vector.
- * If there are ties, relevant elements are zeroed out left-to-right.
+ * Returns the K-th largest absolute value of z (0 < K < n); work must have
+ * room for n values and is scrambled.
  */
-void sparsify(double *z, int N, int K)
+double SparsifyThreshold(const double *z, size_t n, size_t K, double *work)
+{
+    size_t i;
+    for (i = 0; i < n; i++)
+        work[i] = fabs(z[i]);
+    return SelectKth(work, n, n - K + 1, NULL);
+}
+
+/*
+ * Zero out all but the largest (in absolute value) K elements of z (length n),
+ * using work (room for n values) as scratch space. If there are ties, relevant
+ * elements are zeroed out left-to-right.
+ */
+void SparsifyInPlace(double *z, size_t n, size_t K, double *work)
 {
-    int i, num;
+    size_t i, num = 0, num_ties = 0, t;
     double val;
-    double *temp;
 
-    if (K == N)
+    if (K >= n)
         return;
-    
     if (K == 0)
     {
-        memset(z, 0, N * sizeof(double));
+        memset(z, 0, n * sizeof(double));
         return;
     }
 
-    temp = (double *) malloc(N * sizeof(double));
+    val = SparsifyThreshold(z, n, K, work);
+    if (val == 0)
+        return;  /* fewer than K nonzeros */
 
-    for (i = 0; i < N; i++)
-        temp[i] = fabs(z[i]);
-    val = randomized_select(temp, N, N-K+1);
-    for (i = num = 0; i < N; i++)
-        if (fabs(z[i]) < val)
+    /* The positions of the ties are recorded in work (exact as doubles) */
+    for (i = 0; i < n; i++)
+    {
+        double a = fabs(z[i]);
+        if (a < val)
             z[i] = 0;
+        else if (a == val)
+            work[num_ties++] = (double) i;
         else
             num++;
+    }
+
+    /* There may be more elements equal to val than we can keep; remove the
+     * leftmost ones */
+    for (t = 0; num + num_ties - t > K; t++)
+        z[(size_t) work[t]] = 0;
+}
+
+/*
+ * SparsifyInPlace for float (SparsifyInPlaceFloat) and int
+ * (SparsifyInPlaceInt32) vectors. The absolute values are selected as W
+ * values (double for the ints, so that |INT_MIN| is exact) in work, which must
+ * have room for n of them. The ties do not fit in work, so the leftmost ones
+ * are zeroed out by a second scan.
+ */
+#define DEFINE_SPARSIFY_IN_PLACE(T, S, W, WS)                               \
+void SparsifyInPlace##S(T *z, size_t n, size_t K, W *work)                  \
+{                                                                           \
+    size_t i, num = 0, num_ties = 0, drop;                                  \
+    W val;                                                                  \
+                                                                            \
+    if (K >= n)                                                             \
+        return;                                                             \
+    if (K == 0)                                                             \
+    {                                                                       \
+        memset(z, 0, n * sizeof(T));                                        \
+        return;                                                             \
+    }                                                                       \
+                                                                            \
+    for (i = 0; i < n; i++)                                                 \
+        work[i] = (z[i] < 0) ? -(W) z[i] : (W) z[i];                        \
+    val = SelectKth##WS(work, n, n - K + 1, NULL);                          \
+    if (val == 0)                                                           \
+        return;  /* fewer than K nonzeros */                                \
+                                                                            \
+    for (i = 0; i < n; i++)                                                 \
+    {                                                                       \
+        W a = (z[i] < 0) ? -(W) z[i] : (W) z[i];                            \
+        if (a < val)                                                        \
+            z[i] = 0;                                                       \
+        else if (a == val)                                                  \
+            num_ties++;                                                     \
+        else                                                                \
+            num++;                                                          \
+    }                                                                       \
+                                                                            \
+    for (i = 0, drop = num + num_ties - K; drop > 0; i++)                   \
+        if (((z[i] < 0) ? -(W) z[i] : (W) z[i]) == val)                     \
+        {                                                                   \
+            z[i] = 0;                                                       \
+            drop--;                                                         \
+        }                                                                   \
+}
+
+DEFINE_SPARSIFY_IN_PLACE(float, Float, float, Float)
+DEFINE_SPARSIFY_IN_PLACE(int, Int32, double, )
+
+#undef DEFINE_SPARSIFY_IN_PLACE
+
+/*
+ * Finds the K largest (in absolute value) nonzero elements of z (length n)
+ * and writes their indices (0-based, increasing) to idx and their values to
+ * vals, which need room for K entries. Ties are broken as in sparsify(): the
+ * rightmost elements are kept. work needs room for n values. Returns the
+ * number of entries (less than K if z has fewer than K nonzeros).
+ */
+size_t SparsifyTopK(const double *z, size_t n, size_t K, double *work,
+                    size_t *idx, double *vals)
+{
+    size_t i, num = 0, num_ties = 0, keep_ties, t, out;
+    double val = 0;
+
+    if (K == 0)
+        return 0;
+    if (K < n)
+        val = SparsifyThreshold(z, n, K, work);
 
-    /* There may be more elements equal to val, so num might be > K. Remove some of those elements */
-    for (i = 0; num > K && i < N; i++)
-        if (fabs(z[i]) == val)
-            z[i] = 0, num--;
+    if (val == 0)
+    {
+        /* At most K nonzeros; keep them all */
+        for (i = 0; i < n; i++)
+            if (z[i] != 0)
+            {
+                idx[num] = i;
+                vals[num++] = z[i];
+            }
+        return num;
+    }
 
-    if (num > K)
-        printf("WARNING: sparsify failed (bug?)\n");
+    for (i = 0; i < n; i++)
+    {
+        double a = fabs(z[i]);
+        if (a > val)
+        {
+            idx[num] = i;
+            vals[num++] = z[i];
+        }
+        else if (a == val)
+            work[num_ties++] = (double) i;
+    }
+
+    /* Merge the rightmost keep_ties ties into the result, from the back */
+    keep_ties = K - num;
+    out = K;
+    t = num_ties;
+    while (keep_ties > 0)
+    {
+        size_t tie = (size_t) work[t-1];
+        out--;
+        if (num > 0 && idx[num-1] > tie)
+        {
+            num--;
+            idx[out] = idx[num];
+            vals[out] = vals[num];
+        }
+        else
+        {
+            idx[out] = tie;
+            vals[out] = z[tie];
+            t--;
+            keep_ties--;
+        }
+    }
+    return K;
+}
 
+/*
+ * Zero out all but the largest (in absolute value) K elements of the given vector.
+ * If there are ties, relevant elements are zeroed out left-to-right.
+ */
+void sparsify(double *z, int N, int K)
+{
+    double *temp;
+
+    if (K >= N)
+        return;
+
+    if (K == 0)
+    {
+        memset(z, 0, N * sizeof(double));
+        return;
+    }
+
+    temp = (double *) malloc(N * sizeof(double));
+    SparsifyInPlace(z, N, K, temp);
     free(temp);
 }
 
@@ -0,0 +1,590 @@
+/*
+ * Reentrant implementation of SSMP (Sequential Sparse Matching Pursuit).
+ *
+ * All the decoder state lives in an ssmp_t object, so several decodes can run
+ * at the same time in one process (e.g. one per thread). The code does not
+ * depend on Matlab; smp_queue.c is a thin MEX wrapper around it and
+ * Tools/ssmp_decode.c is a standalone command line decoder.
+ *
+ * The matrix is given as a bipartite_graph_t (see bipartite.h) which is only
+ * read by the decoder, so concurrent decoders can share one graph.
+ *
+ * For each column the decoder keeps its D bucket values C[nb[j]] in sorted
+ * order, with the position of each bucket in that order. A step changes D
+ * entries of C; each change moves one value of every column touching that
+ * bucket to its new position (a binary search and a short shift), instead of
+ * recomputing the median of the column from scratch. The heap is only updated
+ * when the median of a column actually changes, in the same order as before,
+ * so the decoder makes the same choices as with full median recomputation.
+ *
+ * SSMPBatchStep is the parallel version of a step: it takes up to batch
+ * columns from the top of the heap whose buckets are pairwise disjoint, so
+ * their updates of X and C do not interact and each of their medians is the
+ * same as it would be when its turn came in serial SSMP. The updates of X and
+ * C and the sorted bucket values of the affected columns are then processed
+ * by several threads (one thread per column); only the heap is updated
+ * serially.
+ *
+ * Based on smp_queue.c, written by Radu Berinde, MIT, 2009
+ */
+
+#ifndef SSMP_H
+#define SSMP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "median.h"
+#include "bipartite.h"
+#include "dheap.h"
+#include "parallel.h"
+#include "sparsify.h"
+
+typedef struct ssmp_t
+{
+    sketch_index_t N;
+    int M, D;
+
+    /* The matrix; needs the right adjacency. Not owned by the decoder; must
+     * stay valid for the lifetime of the object. */
+    const bipartite_graph_t *graph;
+
+    /* The sketch being decoded (length M, not owned) */
+    const double *y;
+
+    /* Current recovery (length N, 0-based) */
+    double *X;
+
+    /* C is the difference between Y and the sketch of the current recovery,
+     * C = Y - A*X (length M) */
+    double *C;
+
+    /* We maintain the current count-median recovery of (A*X-b) as a max
+     * abs-val heap */
+    dheap_t uheap;
+
+    /* The heap updates of the current step, applied together */
+    dheap_update_t *updates;
+    sketch_index_t num_updates, max_updates;
+
+    /* The bucket values of column i in increasing order are
+     * sorted[(i-1)*D .. i*D); bucket j of column i is at position
+     * rank[(i-1)*D + j] and slot is the inverse permutation. */
+    double *sorted;
+    ssmp_rank_t *rank, *slot;
+
+    /* The median of each column as currently stored in the heap (1-based) */
+    double *medians;
+
+    /* Scratch space for the D bucket values of a column */
+    double *bucket_values;
+
+    /* Pivot RNG state for the median of large D */
+    unsigned int seed;
+
+    /* Batched steps (allocated by the first SSMPBatchStep): the selected
+     * columns and their values, the columns taken from the heap, and the
+     * columns affected by a batch. A bucket (column) belongs to the current
+     * batch if its mark equals round. */
+    int batch_capacity;
+    sketch_index_t *selected, *popped, *affected;
+    double *selected_values;
+    unsigned int *bucket_mark, *column_mark;
+    unsigned int round;
+} ssmp_t;
+
+/* Called at the start of each outer step of SSMPRun */
+typedef void (*ssmp_progress_fn)(void *context, int out_step, int outer_steps);
+
+/* Neighbors of left node i (between 1 and N; the heap is 1-based) */
+#define SSMPLeftNeighbors(s, i) ((s)->graph->left + (size_t) ((i) - 1) * (s)->D)
+
+/* Largest D supported (the positions are stored as ssmp_rank_t) */
+#ifdef SKETCH_LARGE
+#define SSMP_MAX_D 0x7FFFFFFF
+#else
+#define SSMP_MAX_D 65535
+#endif
+
+/* A batched step looks at most SSMP_BATCH_SCAN*batch columns from the top of
+ * the heap */
+#define SSMP_BATCH_SCAN 4
+
+/* Smallest number of columns processed with several threads in a batch */
+#define SSMP_PARALLEL_MIN 256
+
+
+/*
+ * Initializes a decoder for the matrix given by graph (which must have been
+ * built with the right adjacency). Returns 0 if the graph has no right
+ * adjacency, if D is larger than SSMP_MAX_D or if the memory could not be
+ * allocated.
+ */
+int SSMPCreate(ssmp_t *s, const bipartite_graph_t *graph)
+{
+    sketch_index_t N = graph->N;
+    int M = graph->M, D = graph->D, k;
+    size_t ND = (size_t) N * D, max_updates = 0;
+
+    memset(s, 0, sizeof(ssmp_t));
+    if (!graph->right || D > SSMP_MAX_D)
+        return 0;
+
+    s->N = N;
+    s->M = M;
+    s->D = D;
+    s->graph = graph;
+    s->seed = 1;
+
+    s->X = (double *) calloc(N, sizeof(double));
+    s->C = (double *) calloc(M, sizeof(double));
+    s->bucket_values = (double *) calloc(D, sizeof(double));
+    s->sorted = (double *) malloc(ND * sizeof(double));
+    s->rank = (ssmp_rank_t *) malloc(ND * sizeof(ssmp_rank_t));
+    s->slot = (ssmp_rank_t *) malloc(ND * sizeof(ssmp_rank_t));
+    s->medians = (double *) calloc(N+1, sizeof(double));
+
+    /* A step updates each column at most once, and only the neighbors of the
+     * D buckets of one column */
+    for (k = 0; k < M; k++)
+        if (GraphRightEnd(graph, k) - GraphRightBegin(graph, k) > max_updates)
+            max_updates = GraphRightEnd(graph, k) - GraphRightBegin(graph, k);
+    max_updates *= D;
+    if (max_updates > (size_t) N)
+        max_updates = N;
+    s->updates = (dheap_update_t *) malloc((max_updates + 1) * sizeof(dheap_update_t));
+    s->max_updates = (sketch_index_t) max_updates + 1;
+
+    if (!s->X || !s->C || !s->bucket_values || !s->sorted || !s->rank || !s->slot ||
+        !s->medians || !s->updates || !DHeapCreate(&s->uheap, N))
+    {
+        free(s->X);
+        free(s->C);
+        free(s->bucket_values);
+        free(s->sorted);
+        free(s->rank);
+        free(s->slot);
+        free(s->medians);
+        free(s->updates);
+        return 0;
+    }
+    return 1;
+}
+
+void SSMPDestroy(ssmp_t *s)
+{
+    DHeapDestroy(&s->uheap);
+    free(s->selected);
+    free(s->selected_values);
+    free(s->popped);
+    free(s->affected);
+    free(s->bucket_mark);
+    free(s->column_mark);
+    free(s->updates);
+    free(s->medians);
+    free(s->slot);
+    free(s->rank);
+    free(s->sorted);
+    free(s->bucket_values);
+    free(s->C);
+    free(s->X);
+    memset(s, 0, sizeof(ssmp_t));
+}
+
+/* Median of the bucket values of column i, computed from C */
+double SSMPComputeMedian(ssmp_t *s, sketch_index_t i)
+{
+    int j, D = s->D;
+    const sketch_bucket_t *nb = SSMPLeftNeighbors(s, i);
+    for (j = 0; j < D; j++)
+        s->bucket_values[j] = s->C[nb[j]];
+    return Median(s->bucket_values, D, &s->seed);
+}
+
+/* Median of column i from its sorted bucket values (the (D+1)/2-th smallest,
+ * the same value as SSMPComputeMedian) */
+#define SSMPColumnMedian(s, i) ((s)->sorted[(size_t) ((i) - 1) * (s)->D + ((s)->D - 1) / 2])
+
+/* Sorts the bucket values of column i and sets their positions */
+void SSMPSortColumn(ssmp_t *s, sketch_index_t i)
+{
+    int j, r, D = s->D;
+    const sketch_bucket_t *nb = SSMPLeftNeighbors(s, i);
+    double *sorted = s->sorted + (size_t) (i-1) * D;
+    ssmp_rank_t *rank = s->rank + (size_t) (i-1) * D;
+    ssmp_rank_t *slot = s->slot + (size_t) (i-1) * D;
+
+    for (j = 0; j < D; j++)
+    {
+        double v = s->C[nb[j]];
+        for (r = j; r > 0 && sorted[r-1] > v; r--)
+        {
+            sorted[r] = sorted[r-1];
+            slot[r] = slot[r-1];
+        }
+        sorted[r] = v;
+        slot[r] = (ssmp_rank_t) j;
+    }
+    for (r = 0; r < D; r++)
+        rank[slot[r]] = (ssmp_rank_t) r;
+}
+
+/* Changes the value of bucket j of column i to v, keeping the values sorted */
+void SSMPMoveBucket(ssmp_t *s, sketch_index_t i, int j, double v)
+{
+    int D = s->D, lo, hi, p;
+    double *sorted = s->sorted + (size_t) (i-1) * D;
+    ssmp_rank_t *rank = s->rank + (size_t) (i-1) * D;
+    ssmp_rank_t *slot = s->slot + (size_t) (i-1) * D;
+
+    p = rank[j];
+    if (v > sorted[p])
+    {
+        /* lo = first position after p with a value >= v */
+        lo = p + 1;
+        hi = D;
+        while (lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            if (sorted[mid] < v)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        for (; p < lo - 1; p++)
+        {
+            sorted[p] = sorted[p+1];
+            slot[p] = slot[p+1];
+            rank[slot[p]] = (ssmp_rank_t) p;
+        }
+    }
+    else
+    {
+        /* lo = first position before p with a value > v */
+        lo = 0;
+        hi = p;
+        while (lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            if (sorted[mid] > v)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        for (; p > lo; p--)
+        {
+            sorted[p] = sorted[p-1];
+            slot[p] = slot[p-1];
+            rank[slot[p]] = (ssmp_rank_t) p;
+        }
+    }
+    sorted[p] = v;
+    slot[p] = (ssmp_rank_t) j;
+    rank[j] = (ssmp_rank_t) p;
+}
+
+/* Rebuilds the sorted bucket values and the heap from C */
+void SSMPComputeHeap(ssmp_t *s)
+{
+    sketch_index_t i;
+
+    for (i = 1; i <= s->N; i++)
+    {
+        SSMPSortColumn(s, i);
+        s->medians[i] = SSMPColumnMedian(s, i);
+    }
+
+    DHeapBuild(&s->uheap, s->N, s->medians);
+}
+
+/* Recomputes C = Y - A*X */
+void SSMPComputeResidual(ssmp_t *s)
+{
+    sketch_index_t i;
+    int j;
+
+    memcpy(s->C, s->y, s->M * sizeof(double));
+
+    for (i = 1; i <= s->N; i++)
+        if (s->X[i-1] != 0)
+        {
+            const sketch_bucket_t *nb = SSMPLeftNeighbors(s, i);
+            for (j = 0; j < s->D; j++)
+                s->C[nb[j]] -= s->X[i-1];
+        }
+}
+
+/* Starts decoding sketch y (length M) from X = 0. The sketch is not copied
+ * and must stay valid while the decoder uses it. */
+void SSMPSetSketch(ssmp_t *s, const double *y)
+{
+    s->y = y;
+    memset(s->X, 0, s->N * sizeof(double));
+    SSMPComputeResidual(s);
+    SSMPComputeHeap(s);
+}
+
+/* Moves bucket k to its new value C[k] in the sorted values of each of its
+ * neighbors */
+void SSMPMoveBuckets(ssmp_t *s, int k)
+{
+    const bipartite_graph_t *g = s->graph;
+    sketch_offset_t p, begin = GraphRightBegin(g, k), end = GraphRightEnd(g, k);
+    int j, D = s->D;
+    for (p = begin; p < end; p++)
+    {
+        sketch_index_t i = g->right[p] + 1;
+        const sketch_bucket_t *nb = SSMPLeftNeighbors(s, i);
+
+        /* The right lists are sorted, so a column with bucket k repeated
+         * appears consecutively; all its copies are moved the first time */
+        if (p > begin && g->right[p-1] == g->right[p])
+            continue;
+
+        for (j = 0; j < D; j++)
+            if (nb[j] == (sketch_bucket_t) k)
+                SSMPMoveBucket(s, i, j, s->C[k]);
+    }
+}
+
+/* Queues heap updates for the neighbors of right node k whose median
+ * changed; they are applied by SSMPStep */
+void SSMPUpdateUHeap(ssmp_t *s, int k)
+{
+    const bipartite_graph_t *g = s->graph;
+    sketch_offset_t p, end = GraphRightEnd(g, k);
+    for (p = GraphRightBegin(g, k); p < end; p++)
+    {
+        sketch_index_t i = g->right[p] + 1;
+        double median = SSMPColumnMedian(s, i);
+        if (median != s->medians[i])
+        {
+            s->medians[i] = median;
+            s->updates[s->num_updates].index = i;
+            s->updates[s->num_updates].value = median;
+            s->num_updates++;
+        }
+    }
+}
+
+/* Main code: do a step of the algorithm */
+void SSMPStep(ssmp_t *s)
+{
+    sketch_index_t i;
+    int j, ret;
+    double value;
+    const sketch_bucket_t *nb;
+
+    /* Get the element with the largest median estimation (in absolute value) */
+    ret = DHeapGetTop(&s->uheap, &i, &value);
+    assert(ret);
+
+    s->X[i-1] += value;
+
+    nb = SSMPLeftNeighbors(s, i);
+    for (j = 0; j < s->D; j++)
+        s->C[nb[j]] -= value;
+
+    for (j = 0; j < s->D; j++)
+        SSMPMoveBuckets(s, nb[j]);
+
+    s->num_updates = 0;
+    for (j = 0; j < s->D; j++)
+        SSMPUpdateUHeap(s, nb[j]);
+    DHeapChangeValues(&s->uheap, s->num_updates, s->updates);
+}
+
+/* Allocates the state of batched steps of up to batch columns. Returns 0 if
+ * the memory could not be allocated. */
+int SSMPReserveBatch(ssmp_t *s, int batch)
+{
+    if (batch <= s->batch_capacity)
+        return 1;
+
+    free(s->selected);
+    free(s->selected_values);
+    free(s->popped);
+    s->selected = (sketch_index_t *) malloc(batch * sizeof(sketch_index_t));
+    s->selected_values = (double *) malloc(batch * sizeof(double));
+    s->popped = (sketch_index_t *) malloc((size_t) SSMP_BATCH_SCAN * batch * sizeof(sketch_index_t));
+    if (!s->affected)
+    {
+        s->affected = (sketch_index_t *) malloc(s->N * sizeof(sketch_index_t));
+        s->bucket_mark = (unsigned int *) calloc(s->M, sizeof(unsigned int));
+        s->column_mark = (unsigned int *) calloc((size_t) s->N + 1, sizeof(unsigned int));
+        s->round = 0;
+    }
+    if (!s->selected || !s->selected_values || !s->popped || !s->affected ||
+        !s->bucket_mark || !s->column_mark)
+    {
+        s->batch_capacity = 0;
+        return 0;
+    }
+    s->batch_capacity = batch;
+    return 1;
+}
+
+/*
+ * Does up to batch steps of the algorithm at once, on columns with disjoint
+ * buckets. Returns the number of columns updated (at least 1), or 0 if the
+ * memory for the batch could not be allocated.
+ */
+int SSMPBatchStep(ssmp_t *s, int batch)
+{
+    const bipartite_graph_t *g = s->graph;
+    int D = s->D, num_popped = 0, num_selected = 0;
+    sketch_index_t num_affected = 0, num_changed = 0, i, t, a;
+    int j;
+    double value;
+
+    if (!SSMPReserveBatch(s, batch))
+        return 0;
+
+    if (++s->round == 0)
+    {
+        memset(s->bucket_mark, 0, s->M * sizeof(unsigned int));
+        memset(s->column_mark, 0, ((size_t) s->N + 1) * sizeof(unsigned int));
+        s->round = 1;
+    }
+
+    /* Take the top columns, keeping those whose buckets are not used yet */
+    while (num_selected < batch && num_popped < SSMP_BATCH_SCAN * batch &&
+           DHeapGetTop(&s->uheap, &i, &value))
+    {
+        const sketch_bucket_t *nb = SSMPLeftNeighbors(s, i);
+
+        DHeapRemoveTop(&s->uheap);
+        s->popped[num_popped++] = i;
+
+        for (j = 0; j < D && s->bucket_mark[nb[j]] != s->round; j++);
+        if (j < D)
+            continue;
+        for (j = 0; j < D; j++)
+            s->bucket_mark[nb[j]] = s->round;
+        s->selected[num_selected] = i;
+        s->selected_values[num_selected] = value;
+        num_selected++;
+    }
+    for (t = 0; t < num_popped; t++)
+        DHeapAdd(&s->uheap, s->popped[t], s->medians[s->popped[t]]);
+
+    /* The buckets of the selected columns are disjoint */
+#pragma omp parallel for private(j) schedule(static) if (num_selected >= SSMP_PARALLEL_MIN)
+    for (t = 0; t < num_selected; t++)
+    {
+        const sketch_bucket_t *nb = SSMPLeftNeighbors(s, s->selected[t]);
+        s->X[s->selected[t] - 1] += s->selected_values[t];
+        for (j = 0; j < D; j++)
+            s->C[nb[j]] -= s->selected_values[t];
+    }
+
+    /* Columns with a changed bucket */
+    for (t = 0; t < num_selected; t++)
+    {
+        const sketch_bucket_t *nb = SSMPLeftNeighbors(s, s->selected[t]);
+        for (j = 0; j < D; j++)
+        {
+            sketch_offset_t p, end = GraphRightEnd(g, nb[j]);
+            for (p = GraphRightBegin(g, nb[j]); p < end; p++)
+            {
+                i = g->right[p] + 1;
+                if (s->column_mark[i] != s->round)
+                {
+                    s->column_mark[i] = s->round;
+                    s->affected[num_affected++] = i;
+                }
+            }
+        }
+    }
+
+    /* Move their changed buckets; affected[a] is negated if the median
+     * changed */
+#pragma omp parallel for private(i, j) schedule(dynamic, 64) if (num_affected >= SSMP_PARALLEL_MIN)
+    for (a = 0; a < num_affected; a++)
+    {
+        const sketch_bucket_t *nb;
+        double median;
+
+        i = s->affected[a];
+        nb = SSMPLeftNeighbors(s, i);
+        for (j = 0; j < D; j++)
+            if (s->bucket_mark[nb[j]] == s->round)
+                SSMPMoveBucket(s, i, j, s->C[nb[j]]);
+        median = SSMPColumnMedian(s, i);
+        if (median != s->medians[i])
+        {
+            s->medians[i] = median;
+            s->affected[a] = -i;
+        }
+    }
+
+    /* Update the heap, in chunks of the size of the updates buffer */
+    for (a = 0; a < num_affected; a++)
+        if (s->affected[a] < 0)
+            s->affected[num_changed++] = -s->affected[a];
+    for (t = 0; t < num_changed; t += s->num_updates)
+    {
+        s->num_updates = 0;
+        for (a = t; a < num_changed && s->num_updates < s->max_updates; a++)
+        {
+            s->updates[s->num_updates].index = s->affected[a];
+            s->updates[s->num_updates].value = s->medians[s->affected[a]];
+            s->num_updates++;
+        }
+        DHeapChangeValues(&s->uheap, s->num_updates, s->updates);
+    }
+
+    return num_selected;
+}
+
+/*
+ * Runs SSMP on sketch y: outer_steps times, perform inner_steps steps and then
+ * (if sparsity > 0) keep only the largest sparsity entries of X. The result is
+ * left in s->X. progress may be NULL.
+ *
+ * If batch > 1, the steps are done in batches of up to batch columns (see
+ * SSMPBatchStep); inner_steps still counts the columns updated. Returns 0 if
+ * the memory for the batches could not be allocated.
+ */
+int SSMPRunBatched(ssmp_t *s, const double *y, int inner_steps, int outer_steps,
+                   int sparsity, int batch, ssmp_progress_fn progress, void *context)
+{
+    int in_step, out_step, done;
+
+    if (batch > 1 && !SSMPReserveBatch(s, batch))
+        return 0;
+
+    SSMPSetSketch(s, y);
+
+    for (out_step = 1; out_step <= outer_steps; out_step++)
+    {
+        if (progress)
+            progress(context, out_step, outer_steps);
+
+        if (batch > 1)
+            for (in_step = 0; in_step < inner_steps; in_step += done)
+                done = SSMPBatchStep(s, (inner_steps - in_step < batch) ? inner_steps - in_step : batch);
+        else
+            for (in_step = 1; in_step <= inner_steps; in_step++)
+                SSMPStep(s);
+
+        if (sparsity > 0)
+        {
+            /* The medians are recomputed below, so they serve as scratch */
+            SparsifyInPlace(s->X, s->N, sparsity, s->medians);
+            SSMPComputeResidual(s);
+            SSMPComputeHeap(s);
+        }
+    }
+    return 1;
+}
+
+/* SSMPRunBatched with single steps */
+void SSMPRun(ssmp_t *s, const double *y, int inner_steps, int outer_steps,
+             int sparsity, ssmp_progress_fn progress, void *context)
+{
+    SSMPRunBatched(s, y, inner_steps, outer_steps, sparsity, 1, progress, context);
+}
+
+#endif  /* SSMP_H */
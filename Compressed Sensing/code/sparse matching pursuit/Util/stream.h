@@ -0,0 +1,142 @@
+/*
+ * Streaming (turnstile) sketching: the sketch y = A*x of a signal x given as
+ * a stream of (index, delta) updates, x(index) += delta, without ever
+ * materializing x.
+ *
+ * The sketch is kept in num_shards copies, each guarded by a lock. A batch of
+ * updates is added to one shard while holding its lock, so writers on
+ * different shards (by default, one per thread) do not contend. A snapshot
+ * holds all the locks at once and sums the shards, so it contains every batch
+ * either entirely or not at all.
+ *
+ * The rows of each updated column are those of SketchMatrixMulSparseAdd
+ * (computed directly from the hash functions for implicit matrices), so the
+ * snapshot equals SketchMatrixMul of the accumulated x up to the order of the
+ * floating point additions; with integer deltas (and sums below 2^53) it is
+ * identical.
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "sketch_matrix.h"
+#include "parallel.h"
+
+typedef struct sketch_stream_t
+{
+    /* The matrix (not owned; must outlive the stream) */
+    const sketch_matrix_t *matrix;
+    int M, num_shards;
+    /* Shard s is shards[s*M .. s*M+M) */
+    double *shards;
+    parallel_lock_t *locks;
+} sketch_stream_t;
+
+
+/*
+ * Creates a zero sketch for matrix m with num_shards shards (or one per
+ * thread if num_shards <= 0). Returns 0 if the memory could not be allocated.
+ */
+int SketchStreamCreate(sketch_stream_t *s, const sketch_matrix_t *m, int num_shards)
+{
+    int t;
+
+    memset(s, 0, sizeof(sketch_stream_t));
+    if (num_shards <= 0)
+        num_shards = ParallelMaxThreads();
+    s->shards = (double *) calloc((size_t) num_shards * m->M, sizeof(double));
+    s->locks = (parallel_lock_t *) malloc(num_shards * sizeof(parallel_lock_t));
+    if (!s->shards || !s->locks)
+    {
+        free(s->shards);
+        free(s->locks);
+        memset(s, 0, sizeof(sketch_stream_t));
+        return 0;
+    }
+    s->matrix = m;
+    s->M = m->M;
+    s->num_shards = num_shards;
+    for (t = 0; t < num_shards; t++)
+        ParallelLockInit(&s->locks[t]);
+    return 1;
+}
+
+void SketchStreamDestroy(sketch_stream_t *s)
+{
+    int t;
+    for (t = 0; t < s->num_shards; t++)
+        ParallelLockDestroy(&s->locks[t]);
+    free(s->locks);
+    free(s->shards);
+    memset(s, 0, sizeof(sketch_stream_t));
+}
+
+/* Shard used by the calling thread */
+#define SketchStreamShard(s) (ParallelThreadNum() % (s)->num_shards)
+
+/*
+ * Applies x(idx[k]) += deltas[k] for k < K (0-based indices, less than N) to
+ * the given shard. Safe to call from several threads, on any shards.
+ */
+void SketchStreamUpdate(sketch_stream_t *s, int shard, size_t K, const size_t *idx,
+                        const double *deltas)
+{
+    ParallelLock(&s->locks[shard]);
+    SketchMatrixMulSparseAdd(s->matrix, K, idx, deltas, s->shards + (size_t) shard * s->M);
+    ParallelUnlock(&s->locks[shard]);
+}
+
+/*
+ * Applies a large batch of updates with all the threads, each adding a
+ * contiguous part of it to its own shard. The batch is not atomic with
+ * respect to snapshots (each part is).
+ */
+void SketchStreamUpdateParallel(sketch_stream_t *s, size_t K, const size_t *idx,
+                                const double *deltas)
+{
+#pragma omp parallel
+    {
+        int t = ParallelThreadNum(), nt = ParallelNumThreads();
+        size_t start = ParallelChunkStart(K, t, nt), end = ParallelChunkStart(K, t + 1, nt);
+        if (end > start)
+            SketchStreamUpdate(s, t % s->num_shards, end - start, idx + start, deltas + start);
+    }
+}
+
+/* Writes the current sketch (length M) to y; see above for its consistency */
+void SketchStreamSnapshot(sketch_stream_t *s, double *y)
+{
+    long long k;
+    int t;
+
+    for (t = 0; t < s->num_shards; t++)
+        ParallelLock(&s->locks[t]);
+
+#pragma omp parallel for private(t) schedule(static) if (s->M >= PARALLEL_BLOCK_SIZE)
+    for (k = 0; k < s->M; k++)
+    {
+        double sum = 0;
+        for (t = 0; t < s->num_shards; t++)
+            sum += s->shards[(size_t) t * s->M + k];
+        y[k] = sum;
+    }
+
+    for (t = s->num_shards - 1; t >= 0; t--)
+        ParallelUnlock(&s->locks[t]);
+}
+
+/* Sets the sketch back to zero */
+void SketchStreamReset(sketch_stream_t *s)
+{
+    int t;
+    for (t = 0; t < s->num_shards; t++)
+    {
+        ParallelLock(&s->locks[t]);
+        memset(s->shards + (size_t) t * s->M, 0, s->M * sizeof(double));
+        ParallelUnlock(&s->locks[t]);
+    }
+}
+
+#endif  /* STREAM_H */
@@ -0,0 +1,84 @@
+/*
+ * Scrambled Walsh measurements (the 'hadamard' matrix, see
+ * Matrices/gen_matrix_hadamard.m), fused into single native operators:
+ *
+ *     WalshMul:          b = A_fw(x, OMEGA, bitrevorder(1:N), P)
+ *     WalshMulTranspose: x = At_fw(b, OMEGA, bitrevorder(1:N), P)
+ *
+ * P (a permutation of 1..N) and OMEGA (K distinct values between 1 and N) are
+ * uint32 arrays. The input permutation and the bit reversal are applied in
+ * one gather, the transform runs in place in a single N-length workspace and
+ * the OMEGA subsampling reads (or writes) only K of its entries.
+ */
+
+#ifndef WALSH_H
+#define WALSH_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "fwht.h"
+
+/* b = fx(OMEGA), fx = fasterwalsh(x(P), bitrevorder(1:N)); work holds N values */
+void WalshMul(int N, const unsigned int *P, int K, const unsigned int *omega,
+              const double *x, double *b, double *work)
+{
+    int k;
+
+    FWHTPermuteGather(x, N, P, work);
+    FWHTInPlace(work, N);
+    for (k = 0; k < K; k++)
+        b[k] = work[omega[k] - 1];
+}
+
+/* fx = zeros(N,1); fx(OMEGA) = b; x(P) = fasterwalsh(fx, bitrevorder(1:N)) */
+void WalshMulTranspose(int N, const unsigned int *P, int K, const unsigned int *omega,
+                       const double *b, double *x, double *work)
+{
+    int i, k, L = FWHTLog2(N);
+
+    /* The bit reversal is an involution: fx(rev(i)) goes to position i */
+    memset(work, 0, N * sizeof(double));
+    for (k = 0; k < K; k++)
+        work[FWHTBitReverse(omega[k] - 1, L)] = b[k];
+    FWHTInPlace(work, N);
+    for (i = 0; i < N; i++)
+        x[P[i] - 1] = work[i];
+}
+
+/*
+ * The same for R signals, stored as the columns of an N by R (K by R)
+ * column-major block. Small transforms are spread over threads by column;
+ * large ones (FWHT_PARALLEL_MIN values or more) use threads internally.
+ * Returns 0 if the workspace could not be allocated.
+ */
+int WalshMulBlock(int N, const unsigned int *P, int K, const unsigned int *omega,
+                  int R, const double *in, double *out, int transpose)
+{
+    int r, ok = 1;
+
+#pragma omp parallel if (R > 1 && N < FWHT_PARALLEL_MIN) reduction(&&:ok)
+    {
+        double *work = (double *) malloc(N * sizeof(double));
+
+        if (!work)
+            ok = 0;
+
+#pragma omp for schedule(dynamic)
+        for (r = 0; r < R; r++)
+        {
+            if (!work)
+                continue;
+            if (transpose)
+                WalshMulTranspose(N, P, K, omega, in + (size_t) K * r,
+                                  out + (size_t) N * r, work);
+            else
+                WalshMul(N, P, K, omega, in + (size_t) N * r,
+                         out + (size_t) K * r, work);
+        }
+
+        free(work);
+    }
+    return ok;
+}
+
+#endif  /* WALSH_H */
@@ -0,0 +1,63 @@
+/*
+ * Scrambled Walsh measurement operator (see walsh.h), a native replacement for
+ * Matrices/A_fw.m and Matrices/At_fw.m that does not create N-length Matlab
+ * temporaries.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "mex.h"
+#include "matrix.h"
+#include "walsh.h"
+
+char* usage =
+"Usage: b = walsh_mul(x, P, OMEGA)       same as A_fw(x, OMEGA, bitrevorder(1:N), P)\n"
+"       x = walsh_mul(b, P, OMEGA, 1)    same as At_fw(b, OMEGA, bitrevorder(1:N), P)\n"
+"  P is a uint32 permutation of 1..N (N a power of 2)\n"
+"  OMEGA is a uint32 vector of K distinct values between 1 and N\n"
+"  x (N by R) and b (K by R) can hold R signals as columns\n";
+
+void
+mexFunction(int nlhs, mxArray *plhs[],
+            int nrhs, const mxArray *prhs[])
+{
+    int N, K, R, i, transpose = 0;
+    const unsigned int *P, *omega;
+    const mxArray *in;
+
+    if (nlhs > 1 || nrhs < 3 || nrhs > 4)
+        mexErrMsgTxt(usage);
+
+    in = prhs[0];
+    if (!mxIsClass(prhs[1], "uint32") || !mxIsClass(prhs[2], "uint32"))
+        mexErrMsgTxt("P and OMEGA must be uint32 vectors.");
+    if (nrhs == 4)
+        transpose = (mxGetScalar(prhs[3]) != 0);
+
+    N = mxGetNumberOfElements(prhs[1]);
+    K = mxGetNumberOfElements(prhs[2]);
+    P = (const unsigned int *) mxGetData(prhs[1]);
+    omega = (const unsigned int *) mxGetData(prhs[2]);
+
+    if (FWHTLog2(N) < 0)
+        mexErrMsgTxt("The length of P should be a power of 2.");
+    for (i = 0; i < N; i++)
+        if (P[i] < 1 || P[i] > (unsigned int) N)
+            mexErrMsgTxt("P should have values between 1 and N.");
+    for (i = 0; i < K; i++)
+        if (omega[i] < 1 || omega[i] > (unsigned int) N)
+            mexErrMsgTxt("OMEGA should have values between 1 and N.");
+
+    if (!mxIsDouble(in) || mxIsComplex(in) || mxIsSparse(in) ||
+        mxGetNumberOfDimensions(in) != 2)
+        mexErrMsgTxt("The input should be a real (full) vector or matrix.");
+    if (mxGetNumberOfElements(in) == (transpose ? K : N))
+        R = 1;
+    else if (mxGetM(in) == (transpose ? K : N))
+        R = mxGetN(in);
+    else
+        mexErrMsgTxt("The input should have N rows (K rows for the adjoint).");
+
+    plhs[0] = mxCreateDoubleMatrix(transpose ? N : K, R, mxREAL);
+    if (!WalshMulBlock(N, P, K, omega, R, mxGetPr(in), mxGetPr(plhs[0]), transpose))
+        mexErrMsgTxt("Out of memory.");
+}
@@ -116,6 +116,8 @@ switch lower(type)
         %   it       is the number of iterations (default is 10)
         %   lfactor  determines l; smp parameter l is equal to recovery_sparsity * lfactor.
         %            (lfactor is optional and defaults to 1)
+        %   The third and fourth parameters are the convergence factor and the
+        %   stopping tolerance (see smp.m).
         if (length(parameters) > 0)
             num_iterations = parameters(1);
         else
@@ -133,9 +135,17 @@ switch lower(type)
         else
             convergence_factor = 0;
         end
-        x1 = smp(matrix, b, l, num_iterations, convergence_factor);
+        if (length(parameters) > 3)
+            tolerance = parameters(4);
+        else
+            tolerance = 0;
+        end
+        x1 = smp(matrix, b, l, num_iterations, convergence_factor, tolerance);
 
    case 'ssmp'
+        % Name should be ssmp(inner,outer) or ssmp(inner,outer,l) or
+        % ssmp(inner,outer,l,batch); with batch > 1 up to batch coordinates
+        % with disjoint buckets are updated at once, in parallel.
         num_inner_iterations = parameters(1);
         num_outer_iterations = parameters(2);
         if recovery_sparsity < 0 && length(parameters) <= 1
@@ -146,8 +156,18 @@ switch lower(type)
         else
             l = recovery_sparsity;
         end
-        x1 = smp_queue(matrix.N, matrix.M, matrix.D, matrix.neighbors, b, ...
-                       num_inner_iterations, num_outer_iterations, l);
+        if (length(parameters) > 3)
+            batch = parameters(4);
+        else
+            batch = 1;
+        end
+        if isfield(matrix, 'handle')
+            x1 = matrix_handle('ssmp', matrix.handle, b, ...
+                               num_inner_iterations, num_outer_iterations, l, batch);
+        else
+            x1 = smp_queue(matrix.N, matrix.M, matrix.D, matrix.neighbors, b, ...
+                           num_inner_iterations, num_outer_iterations, l, batch);
+        end
 
     otherwise
         error(['Unknown recovery type ' type '.']);
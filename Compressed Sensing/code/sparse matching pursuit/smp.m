@@ -1,4 +1,4 @@
-% x = smp(matrix, b, l, T)
+% x = smp(matrix, b, l, T [, convergence_factor [, tolerance]])
 % Sparse Matching Pursuit algorithm - recover a vector from the sketch b and
 % given measurement matrix; use T iterations and l recovery sparsity.
 %
@@ -7,22 +7,48 @@
 % (convergence_factor * |x|_1). Helps to force convergence when the matrix has
 % too few measurements to be an l-expander.
 %
+% tolerance is optional. If given and greater than 0, the algorithm stops
+% early once the change of x in an iteration is at most tolerance * |x|_1.
+%
+% If the matrix has a handle (see attach_handle.m), the whole loop runs
+% natively (matrix_handle('smp', ...)), with x kept sparse.
+%
 % Written by Radu Berinde, 2008
 
-function x = smp(matrix, b, l, T, convergence_factor)
+function x = smp(matrix, b, l, T, convergence_factor, tolerance)
 
 if (nargin < 5)
     convergence_factor = 0;
 end
+if (nargin < 6)
+    tolerance = 0;
+end
+
+if isfield(matrix, 'handle')
+    x = full(matrix_handle('smp', matrix.handle, b, l, T, convergence_factor, tolerance));
+    return;
+end
 
 N = matrix.N;
-x = zeros(N, 1);
+
+% With native kernels that take sparse input, x and u are kept as sparse
+% vectors (sparsify builds them directly from the largest entries)
+sparse_iterate = isfield(matrix, 'sparse_input') && matrix.sparse_input;
+if sparse_iterate
+    x = sparse(N, 1);
+else
+    x = zeros(N, 1);
+end
 
 for j = 1:T
     disp(sprintf('SMP iteration %d', j));
     c = b - matrix.Afun(x);
     uStar = matrix.MedianRecoveryFun(c);
-    u = sparsify(uStar, 2*l);
+    if sparse_iterate
+        u = sparsify(uStar, 2*l, 'sparse');
+    else
+        u = sparsify(uStar, 2*l);
+    end
 
     % Convergence control
     if (j > 1 && convergence_factor > 0)
@@ -34,6 +60,13 @@ for j = 1:T
         end
     end
 
+    x_old = x;
     x = x + u; % .* 0.5;
     x = sparsify(x, l);
+
+    if (tolerance > 0 && norm(x - x_old, 1) <= tolerance * norm(x, 1))
+        break;
+    end
 end
+
+x = full(x);